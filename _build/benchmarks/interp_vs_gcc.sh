@@ -0,0 +1,35 @@
+#!/bin/sh
+# Compares the wall time of running a program with --interp against compiling it with gcc.
+# usage: interp_vs_gcc.sh [program.lf] [runs]
+cd `dirname $0`
+
+PROGRAM=${1:-fib.lf}
+RUNS=${2:-5}
+LEAF=../bin/leaf
+
+if [ ! -x $LEAF ]; then
+    echo "Could not find $LEAF, build the compiler first."
+    exit 1
+fi
+
+now_ms() {
+    echo $(($(date +%s%N) / 1000000))
+}
+
+bench() {
+    start=`now_ms`
+    i=0
+    while [ $i -lt $RUNS ]; do
+        $LEAF "$@" $PROGRAM > /dev/null
+        i=$((i + 1))
+    done
+    end=`now_ms`
+    echo $(((end - start) / RUNS))
+}
+
+INTERP_MS=`bench --interp`
+GCC_MS=`bench --no-cache`
+
+echo "Program: $PROGRAM ($RUNS runs)"
+echo "--interp:   ${INTERP_MS} ms per run"
+echo "gcc:        ${GCC_MS} ms per run"
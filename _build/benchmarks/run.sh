@@ -0,0 +1,88 @@
+#!/bin/sh
+# Runs the runtime benchmarks several times each and reports the median and the spread of their
+# run times, comparing the medians against a stored baseline to flag regressions.
+# usage: run.sh [runs] [--save]
+#   runs     times each program is run (default 5)
+#   --save   stores the medians as the new baseline
+# Set LEAF_BENCH_THRESHOLD to the percentage a median can grow before it counts as a regression
+# (default 10), and LEAF_BENCH_FLAGS to the options passed to the compiler, e.g. --nanbox.
+# Exits with status 1 if any program regressed.
+cd `dirname $0`
+
+RUNS=5
+SAVE=0
+for arg in "$@"; do
+    case $arg in
+        --save) SAVE=1 ;;
+        *) RUNS=$arg ;;
+    esac
+done
+LEAF=../bin/leaf
+FLAGS=$LEAF_BENCH_FLAGS
+BASELINE=baseline.txt
+THRESHOLD=${LEAF_BENCH_THRESHOLD:-10}
+PROGRAMS="lists sieve values dicts records strings split_join loops recursion memory"
+
+if [ ! -x $LEAF ]; then
+    echo "Could not find $LEAF, build the compiler first."
+    exit 1
+fi
+
+# Wall time in ms of the program alone, as reported by the compiler, so gcc and startup are left out
+run_ms() {
+    $LEAF $FLAGS --time-passes=json $1.lf 2>&1 >/dev/null \
+        | sed -n 's/.*{"name": "run", "wall_ms": \([0-9.]*\).*/\1/p'
+}
+
+# Prints the median, the standard deviation and the coefficient of variation of the numbers read
+stats() {
+    sort -n | awk '
+        { v[NR] = $1; sum += $1 }
+        END {
+            median = (NR % 2) ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2
+            mean = sum / NR
+            for (i = 1; i <= NR; ++i) var += (v[i] - mean) ^ 2
+            stddev = (NR > 1) ? sqrt(var / (NR - 1)) : 0
+            printf "%.1f %.1f %.1f\n", median, stddev, (mean > 0) ? 100 * stddev / mean : 0
+        }'
+}
+
+RESULTS=`mktemp`
+REGRESSED=0
+printf "%-12s %10s %10s %7s %10s %8s\n" "program" "median ms" "stddev ms" "cv %" "base ms" "change"
+for program in $PROGRAMS; do
+    # The first run compiles the program into the cache
+    if ! $LEAF $FLAGS $program.lf > /dev/null; then
+        echo "$program: failed"
+        REGRESSED=1
+        continue
+    fi
+    times=""
+    i=0
+    while [ $i -lt $RUNS ]; do
+        times="$times `run_ms $program`"
+        i=$((i + 1))
+    done
+    set -- `echo $times | tr ' ' '\n' | stats`
+    median=$1
+    echo "$program $median" >> $RESULTS
+
+    base=`[ -f $BASELINE ] && awk -v p=$program '$1 == p { print $2 }' $BASELINE`
+    if [ "$base" = "" ]; then
+        printf "%-12s %10s %10s %7s %10s %8s\n" $program $1 $2 $3 "-" "-"
+    else
+        change=`awk -v m=$median -v b=$base 'BEGIN { printf "%+.1f%%", (b > 0) ? 100 * (m - b) / b : 0 }'`
+        flag=`awk -v m=$median -v b=$base -v t=$THRESHOLD 'BEGIN { if (m > b * (1 + t / 100)) print "REGRESSION" }'`
+        printf "%-12s %10s %10s %7s %10s %8s %s\n" $program $1 $2 $3 $base $change "$flag"
+        [ "$flag" != "" ] && REGRESSED=1
+    fi
+done
+
+if [ $SAVE = 1 ]; then
+    cp $RESULTS $BASELINE
+    echo "Saved baseline to $BASELINE"
+elif [ ! -f $BASELINE ]; then
+    echo "No baseline found, run with --save to store one."
+fi
+rm -f $RESULTS
+exit $REGRESSED
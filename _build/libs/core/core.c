@@ -34,6 +34,43 @@ typedef struct TMemory {
 #define CORE_IMPL
 #include "core.h"
 
+// Containers created between automatic collections, at least, or as many as survived the last one
+#define GC_MIN_ALLOCS 10000
+
+// Lists and dicts start with this header, which links all of them for the cycle collector
+typedef struct GcNode {
+    struct GcNode* prev;
+    struct GcNode* next;
+    size_t refs;    // While collecting, references that do not come from other containers
+    int isDict;
+} GcNode;
+
+static GcNode leaf_gcAll = { &leaf_gcAll, &leaf_gcAll, 0, 0 };
+static size_t leaf_gcLive = 0;
+static size_t leaf_gcAllocs = 0;
+static size_t leaf_gcThreshold = GC_MIN_ALLOCS;
+static int leaf_gcPending = 0;
+
+// Arena blocks are never freed, so they are left out
+static void _GcLink(GcNode* node, int isDict) {
+    node->isDict = isDict;
+    if (!lmem_counted(node)) return;
+    node->prev = leaf_gcAll.prev;
+    node->next = &leaf_gcAll;
+    leaf_gcAll.prev->next = node;
+    leaf_gcAll.prev = node;
+    ++leaf_gcLive;
+    if (++leaf_gcAllocs >= leaf_gcThreshold) leaf_gcPending = 1;
+}
+
+static void _GcUnlink(GcNode* node) {
+    if (!node->next) return;
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = NULL;
+    --leaf_gcLive;
+}
+
 // ------------------------------------
 // App
 // ------------------------------------
@@ -43,9 +80,9 @@ static struct TList* leaf_appArgs = NULL;
 
 void _SetArgs(int argc, char* argv[]) {
     leaf_appName = lstr_alloc(argv[0]);
-    leaf_appArgs = (struct TList*)_IncRef(_CreateList());
+    leaf_appArgs = (struct TList*)_IncRef(_CreatePackedList(TYPE_STRING));
     for (TInt i = 1; i < argc; ++i) {
-        _SetListString(leaf_appArgs, i - 1, argv[i]);
+        _SetPackedString(leaf_appArgs, i - 1, argv[i]);
     }
 }
 
@@ -91,6 +128,22 @@ void _DoAutoDec() {
     lmem_doautorelease();
 }
 
+size_t _AutoDecMark() {
+    return lmem_automark();
+}
+
+// Scopes end between statements, where no container is borrowed without a reference, so pending
+// collections run there
+void _DoAutoDecTo(size_t mark) {
+    lmem_doautoreleaseto(mark);
+    if (leaf_gcPending) CollectGarbage();
+}
+
+void _TrimAutoDec(size_t mark) {
+    lmem_trimautorelease(mark);
+    if (leaf_gcPending) CollectGarbage();
+}
+
 // ------------------------------------
 // Console
 // ------------------------------------
@@ -112,13 +165,13 @@ void Print(const TChar* msg) {
 // ------------------------------------
 
 struct TList* DirContents(const TChar* path) {
-    struct TList* list = _CreateList();
+    struct TList* list = _CreatePackedList(TYPE_STRING);
     DIR* d = (DIR*)opendir(path);
     if (d == NULL) return list;
     struct dirent* entry;
     TInt i = 0;
     while ((entry = (struct dirent*)readdir(d))) {
-        _SetListString(list, i++, entry->d_name);
+        _SetPackedString(list, i++, entry->d_name);
     }
     closedir(d);
     return list;
@@ -159,18 +212,142 @@ void DeleteFile(const TChar* filename) {
 // List
 // ------------------------------------
 
+#ifdef CORE_NANBOX
+
+// Values are packed into 8 bytes. Floats keep their own bits, with NaNs made canonical, and the
+// other types go in the 48 bit payload of negative NaNs, tagged by the top 16 bits. Pointers fit in
+// the payload on current platforms, and ints that do not are boxed.
+typedef struct {
+    unsigned long long bits;
+} Value;
+
+#define VALUE_NAN 0x7FF8000000000000ULL
+#define VALUE_SIGN 0x8000000000000000ULL
+#define VALUE_PAYLOAD 0x0000FFFFFFFFFFFFULL
+#define VALUE_INT_MAX 0x00007FFFFFFFFFFFLL
+#define TAG_INT 0xFFF9ULL
+#define TAG_STRING 0xFFFAULL
+#define TAG_LIST 0xFFFBULL
+#define TAG_DICT 0xFFFCULL
+#define TAG_RAW 0xFFFDULL
+#define TAG_BOXEDINT 0xFFFEULL
+#define TAG_NONE 0xFFFFULL
+
+static Value _ValueTagged(unsigned long long tag, unsigned long long payload) {
+    Value v;
+    v.bits = (tag << 48) | (payload & VALUE_PAYLOAD);
+    return v;
+}
+
+static unsigned long long _ValueTag(const Value v) {
+    return v.bits >> 48;
+}
+
+static TInt _ValueType(const Value v) {
+    switch (_ValueTag(v)) {
+    case TAG_INT: return TYPE_INT;
+    case TAG_BOXEDINT: return TYPE_INT;
+    case TAG_STRING: return TYPE_STRING;
+    case TAG_LIST: return TYPE_LIST;
+    case TAG_DICT: return TYPE_DICT;
+    case TAG_RAW: return TYPE_RAW;
+    case TAG_NONE: return TYPE_VOID;
+    default: return TYPE_FLOAT;
+    }
+}
+
+static void* _ValuePtr(const Value v) {
+    return (void*)(size_t)(v.bits & VALUE_PAYLOAD);
+}
+
+static Value _ValueNone() {
+    return _ValueTagged(TAG_NONE, 0);
+}
+
+static TInt _ValueInt(const Value v) {
+    if (_ValueTag(v) == TAG_BOXEDINT) return *(TInt*)_ValuePtr(v);
+    // Shift the sign of the payload back into place
+    return (TInt)((long long)(v.bits << 16) >> 16);
+}
+
+static TFloat _ValueFloat(const Value v) {
+    double f;
+    memcpy(&f, &v.bits, sizeof(f));
+    return (TFloat)f;
+}
+
+// Does not take a reference
+static Value _ValueFromPtr(TInt type, void* ptr) {
+    switch (type) {
+    case TYPE_STRING: return _ValueTagged(TAG_STRING, (size_t)ptr);
+    case TYPE_LIST: return _ValueTagged(TAG_LIST, (size_t)ptr);
+    case TYPE_DICT: return _ValueTagged(TAG_DICT, (size_t)ptr);
+    default: return _ValueTagged(TAG_RAW, (size_t)ptr);
+    }
+}
+
+Value ValueFromInt(TInt i) {
+    if ((long long)i >= -VALUE_INT_MAX - 1 && (long long)i <= VALUE_INT_MAX) return _ValueTagged(TAG_INT, (unsigned long long)i);
+    TInt* boxed = lmem_alloc(TInt, NULL);
+    *boxed = i;
+    return _ValueTagged(TAG_BOXEDINT, (size_t)boxed);
+}
+
+Value ValueFromFloat(TFloat f) {
+    const double d = f;
+    Value v;
+    memcpy(&v.bits, &d, sizeof(d));
+    // Only the sign of NaNs is kept, so their payload cannot be mistaken for a tag
+    if (d != d) v.bits = (v.bits & VALUE_SIGN) | VALUE_NAN;
+    return v;
+}
+
+TInt ValueIsManaged(const Value v) {
+    const unsigned long long tag = _ValueTag(v);
+    return tag == TAG_STRING || tag == TAG_LIST || tag == TAG_DICT || tag == TAG_BOXEDINT;
+}
+
+#else
+
 typedef struct {
     TInt type;
     union {
         TInt i;
         TFloat f;
-        TChar* s;
-        struct TList* l;
-        struct TDict* h;
-        void* r;
+        void* p;
     } value;
 } Value;
 
+static TInt _ValueType(const Value v) {
+    return v.type;
+}
+
+static void* _ValuePtr(const Value v) {
+    return v.value.p;
+}
+
+static Value _ValueNone() {
+    Value v = {0};
+    v.type = TYPE_VOID;
+    return v;
+}
+
+static TInt _ValueInt(const Value v) {
+    return v.value.i;
+}
+
+static TFloat _ValueFloat(const Value v) {
+    return v.value.f;
+}
+
+// Does not take a reference
+static Value _ValueFromPtr(TInt type, void* ptr) {
+    Value v = {0};
+    v.type = type;
+    v.value.p = ptr;
+    return v;
+}
+
 Value ValueFromInt(TInt i) {
     Value v = {0};
     v.type = TYPE_INT;
@@ -185,103 +362,174 @@ Value ValueFromFloat(TFloat f) {
     return v;
 }
 
+TInt ValueIsManaged(const Value v) {
+    return v.type == TYPE_STRING || v.type == TYPE_LIST || v.type == TYPE_DICT;
+}
+
+#endif
+
 Value ValueFromString(const TChar* s) {
-    Value v = {0};
-    v.type = TYPE_STRING;
-    lmem_assign(v.value.s, lstr_get(s));
-    return v;
+    return _ValueFromPtr(TYPE_STRING, _IncRef(lstr_get(s)));
 }
 
 Value ValueFromList(struct TList* l) {
-    Value v = {0};
-    v.type = TYPE_LIST;
-    lmem_assign(v.value.l, l);
-    return v;
+    return _ValueFromPtr(TYPE_LIST, _IncRef(l));
 }
 
 Value ValueFromDict(struct TDict* h) {
-    Value v = {0};
-    v.type = TYPE_DICT;
-    lmem_assign(v.value.h, h);
-    return v;
+    return _ValueFromPtr(TYPE_DICT, _IncRef(h));
 }
 
 Value ValueFromRaw(void* r) {
-    Value v = {0};
-    v.type = TYPE_RAW;
-    v.value.r = r;
+    return _ValueFromPtr(TYPE_RAW, r);
+}
+
+// For values that are only read, so boxed ints are released with the current scope
+static Value _ValueFromTempInt(TInt i) {
+    const Value v = ValueFromInt(i);
+    if (ValueIsManaged(v)) lmem_autorelease(_ValuePtr(v));
     return v;
 }
 
 TInt ValueToInt(const Value v) {
-    switch (v.type) {
-    case TYPE_INT: return v.value.i;
-    case TYPE_FLOAT: return (TInt)v.value.f;
-    case TYPE_STRING: return Val(v.value.s);
+    switch (_ValueType(v)) {
+    case TYPE_INT: return _ValueInt(v);
+    case TYPE_FLOAT: return (TInt)_ValueFloat(v);
+    case TYPE_STRING: return Val((TChar*)_ValuePtr(v));
     default: return 0;
     }
 }
 
 TFloat ValueToFloat(const Value v) {
-    switch (v.type) {
-    case TYPE_INT: return v.value.i;
-    case TYPE_FLOAT: return v.value.f;
-    case TYPE_STRING: return ValF(v.value.s);
+    switch (_ValueType(v)) {
+    case TYPE_INT: return _ValueInt(v);
+    case TYPE_FLOAT: return _ValueFloat(v);
+    case TYPE_STRING: return ValF((TChar*)_ValuePtr(v));
     default: return 0.0f;
     }
 }
 
 const TChar* ValueToString(const Value v) {
-    switch (v.type) {
-    case TYPE_INT: return Str(v.value.i);
-    case TYPE_FLOAT: return StrF(v.value.f);
-    case TYPE_STRING: return v.value.s;
-    case TYPE_LIST: return _ListToString(v.value.l);
-    case TYPE_DICT: return _DictToString(v.value.h);
+    switch (_ValueType(v)) {
+    case TYPE_INT: return Str(_ValueInt(v));
+    case TYPE_FLOAT: return StrF(_ValueFloat(v));
+    case TYPE_STRING: return (TChar*)_ValuePtr(v);
+    case TYPE_LIST: return _ListToString((struct TList*)_ValuePtr(v));
+    case TYPE_DICT: return _DictToString((struct TDict*)_ValuePtr(v));
     default: return lstr_get("");
     }
 }
 
 struct TList* ValueToList(const Value v) {
-    switch (v.type) {
-    case TYPE_RAW: return (struct TList*)v.value.r;
-    case TYPE_LIST: return v.value.l;
+    switch (_ValueType(v)) {
+    case TYPE_RAW: return (struct TList*)_ValuePtr(v);
+    case TYPE_LIST: return (struct TList*)_ValuePtr(v);
     default: return _CreateList();
     }
 }
 
 struct TDict* ValueToDict(const Value v) {
-    switch (v.type) {
-    case TYPE_RAW: return (struct TDict*)v.value.r;
-    case TYPE_DICT: return v.value.h;
+    switch (_ValueType(v)) {
+    case TYPE_RAW: return (struct TDict*)_ValuePtr(v);
+    case TYPE_DICT: return (struct TDict*)_ValuePtr(v);
     default: return _CreateDict();
     }
 }
 
 void* ValueToRaw(const Value v) {
-    switch (v.type) {
+    switch (_ValueType(v)) {
     case TYPE_INT: return NULL;
     case TYPE_FLOAT: return NULL;
-    case TYPE_STRING: return v.value.s;
-    case TYPE_LIST: return v.value.l;
-    case TYPE_DICT: return v.value.h;
-    default: return v.value.r;
+    default: return _ValuePtr(v);
     }
 }
 
-TInt ValueIsManaged(const Value v) {
-    return v.type == TYPE_STRING || v.type == TYPE_LIST || v.type == TYPE_DICT;
-}
-
+// Lists created for a single scalar type pack their elements without tags. Storing a value of any
+// other type, or past the end so that it leaves a gap, unpacks them, so they behave like any other
+// list.
 typedef struct TList {
-    Value* elems;
+    GcNode gc;
+    TInt elemType;  // TYPE_INT, TYPE_FLOAT or TYPE_STRING when packed, TYPE_VOID otherwise
+    union {
+        Value* elems;
+        TInt* ints;
+        TFloat* floats;
+        TChar** strings;
+    };
 } TList;
 
+// The element still belongs to the list
+static Value _ListValue(TList* list, size_t index) {
+    switch (list->elemType) {
+    case TYPE_INT:
+        return _ValueFromTempInt(list->ints[index]);
+    case TYPE_FLOAT:
+        return ValueFromFloat(list->floats[index]);
+    case TYPE_STRING:
+        return _ValueFromPtr(TYPE_STRING, list->strings[index]);
+    default:
+        return list->elems[index];
+    }
+}
+
+static void _UnpackList(TList* list) {
+    Value* elems = NULL;
+    const size_t size = arrlenu(list->elems);
+    arrsetlen(elems, size);
+    for (size_t i = 0; i < size; ++i) {
+        switch (list->elemType) {
+        case TYPE_INT:
+            elems[i] = ValueFromInt(list->ints[i]);
+            break;
+        case TYPE_FLOAT:
+            elems[i] = ValueFromFloat(list->floats[i]);
+            break;
+        default:
+            // Strings move to the new storage along with their reference
+            elems[i] = _ValueFromPtr(TYPE_STRING, list->strings[i]);
+        }
+    }
+    arrfree(list->elems);
+    list->elems = elems;
+    list->elemType = TYPE_VOID;
+}
+
+// Whether a value of the type stored at the index stays packed, unpacking the list if it packs
+// another type or the index leaves a gap, since only unpacked lists can hold empty values
+static int _PacksAt(TList* list, TInt type, size_t index) {
+    if (list->elemType == type && index <= arrlenu(list->elems)) return 1;
+    if (list->elemType != TYPE_VOID) _UnpackList(list);
+    return 0;
+}
+
+// Makes room for the given index. Packed lists only grow by one, and gaps in unpacked lists are
+// filled with empty values.
+static void _GrowList(TList* list, size_t index) {
+    const size_t size = arrlenu(list->elems);
+    if (index < size) return;
+    switch (list->elemType) {
+    case TYPE_INT:
+        arrsetlen(list->ints, index + 1);
+        break;
+    case TYPE_FLOAT:
+        arrsetlen(list->floats, index + 1);
+        break;
+    case TYPE_STRING:
+        arrsetlen(list->strings, index + 1);
+        list->strings[index] = NULL;    // The setter releases what it replaces
+        break;
+    default:
+        arrsetlen(list->elems, index + 1);
+        for (size_t i = size; i < index; ++i) list->elems[i] = _ValueNone();
+    }
+}
+
 void _ClearListValue(TList* list, size_t index) {
     if (index >= 0 && index < ListSize(list)) {
-        const Value value = list->elems[index];
-        if (ValueIsManaged(value)) {
-            _DecRef(value.value.r);
+        if (list->elemType == TYPE_STRING) {
+            _DecRef(list->strings[index]);
+        } else if (list->elemType == TYPE_VOID && ValueIsManaged(list->elems[index])) {
+            _DecRef(_ValuePtr(list->elems[index]));
         }
     }
 }
@@ -294,103 +542,185 @@ void _DestroyList(TList* list) {
     list->elems = NULL;
 }
 
-TList* _CreateList() {
-    TList* list = lmem_allocauto(TList, (void*)_DestroyList);
+void _FreeList(TList* list) {
+    _GcUnlink(&list->gc);
+    _DestroyList(list);
+}
+
+static TList* _NewList(TInt elemType) {
+    TList* list = lmem_alloc(TList, (void*)_FreeList);
+    list->elemType = elemType;
     list->elems = NULL;
+    _GcLink(&list->gc, 0);
+    return list;
+}
+
+TList* _CreateList() {
+    return (TList*)lmem_autorelease(_NewList(TYPE_VOID));
+}
+
+TList* _CreatePackedList(TInt elemType) {
+    return (TList*)lmem_autorelease(_NewList(elemType));
+}
+
+// Empties a list referenced only by the caller, keeping its storage for the new elements.
+// Without a list, creates one owned by the caller.
+TList* _RecycleList(TList* list) {
+    return _RecyclePackedList(list, TYPE_VOID);
+}
+
+TList* _RecyclePackedList(TList* list, TInt elemType) {
+    if (!list) return _NewList(elemType);
+    for (size_t i = 0; i < arrlenu(list->elems); ++i) {
+        _ClearListValue(list, i);
+    }
+    // The storage is sized for the elements of one type
+    if (list->elemType != elemType) {
+        arrfree(list->elems);
+        list->elems = NULL;
+        list->elemType = elemType;
+    }
+    arrsetlen(list->elems, 0);
     return list;
 }
 
 TList* _SetListInt(TList* list, size_t index, TInt value) {
+    if (_PacksAt(list, TYPE_INT, index)) return _SetPackedInt(list, index, value);
     _ClearListValue(list, index);
-    if (index >= ListSize(list)) arrsetlen(list->elems, index + 1);
+    _GrowList(list, index);
     list->elems[index] = ValueFromInt(value);
     return list;
 }
 
 TList* _SetListFloat(TList* list, size_t index, TFloat value) {
+    if (_PacksAt(list, TYPE_FLOAT, index)) return _SetPackedFloat(list, index, value);
     _ClearListValue(list, index);
-    if (index >= ListSize(list)) arrsetlen(list->elems, index + 1);
+    _GrowList(list, index);
     list->elems[index] = ValueFromFloat(value);
     return list;
 }
 
 TList* _SetListString(TList* list, size_t index, const TChar* value) {
+    if (_PacksAt(list, TYPE_STRING, index)) return _SetPackedString(list, index, value);
     _IncRef((TChar*)value);
     _ClearListValue(list, index);
-    if (index >= ListSize(list)) arrsetlen(list->elems, index + 1);
+    _GrowList(list, index);
     list->elems[index] = ValueFromString(value);
     _DecRef((TChar*)value);
     return list;
 }
 
 TList* _SetListList(TList* list, size_t index, TList* value) {
+    _PacksAt(list, TYPE_LIST, index);
     _IncRef((TChar*)value);
     _ClearListValue(list, index);
-    if (index >= ListSize(list)) arrsetlen(list->elems, index + 1);
+    _GrowList(list, index);
     list->elems[index] = ValueFromList(value);
     _DecRef((TChar*)value);
     return list;
 }
 
 TList* _SetListDict(TList* list, size_t index, struct TDict* value) {
+    _PacksAt(list, TYPE_DICT, index);
     _IncRef((TChar*)value);
     _ClearListValue(list, index);
-    if (index >= ListSize(list)) arrsetlen(list->elems, index + 1);
+    _GrowList(list, index);
     list->elems[index] = ValueFromDict(value);
     _DecRef((TChar*)value);
     return list;
 }
 
 TList* _SetListRaw(TList* list, size_t index, void* value) {
+    _PacksAt(list, TYPE_RAW, index);
     _ClearListValue(list, index);
-    if (index >= ListSize(list)) arrsetlen(list->elems, index + 1);
+    _GrowList(list, index);
     list->elems[index] = ValueFromRaw(value);
     return list;
 }
 
+// Lists packed with the type asked for skip the conversion
 TInt _ListInt(TList* list, size_t index) {
-    return (index >= 0 && index < ListSize(list))
-        ? ValueToInt(list->elems[index])
-        : 0;
+    if (index >= ListSize(list)) return 0;
+    return (list->elemType == TYPE_INT) ? list->ints[index] : ValueToInt(_ListValue(list, index));
 }
 
 TFloat _ListFloat(TList* list, size_t index) {
-    return (index >= 0 && index < ListSize(list))
-        ? ValueToFloat(list->elems[index])
-        : 0.0f;
+    if (index >= ListSize(list)) return 0.0f;
+    return (list->elemType == TYPE_FLOAT) ? list->floats[index] : ValueToFloat(_ListValue(list, index));
 }
 
 const TChar* _ListString(TList* list, size_t index) {
-    return (index >= 0 && index < ListSize(list))
-        ? ValueToString(list->elems[index])
-        : lstr_get("");
+    if (index >= ListSize(list)) return lstr_get("");
+    return ValueToString(_ListValue(list, index));
 }
 
 TList* _ListList(TList* list, size_t index) {
     return (index >= 0 && index < ListSize(list))
-        ? ValueToList(list->elems[index])
+        ? ValueToList(_ListValue(list, index))
         : _CreateList();
 }
 
 struct TDict* _ListDict(TList* list, size_t index) {
     return (index >= 0 && index < ListSize(list))
-        ? ValueToDict(list->elems[index])
+        ? ValueToDict(_ListValue(list, index))
         : _CreateDict();
 }
 
 void* _ListRaw(TList* list, size_t index) {
     return (index >= 0 && index < ListSize(list))
-        ? ValueToRaw(list->elems[index])
+        ? ValueToRaw(_ListValue(list, index))
         : NULL;
 }
 
+// Accessors for lists the compiler knows to be packed, which fall back to the generic ones if not,
+// or if the index leaves a gap
+TList* _SetPackedInt(TList* list, size_t index, TInt value) {
+    if (list->elemType != TYPE_INT || index > arrlenu(list->ints)) return _SetListInt(list, index, value);
+    _GrowList(list, index);
+    list->ints[index] = value;
+    return list;
+}
+
+TList* _SetPackedFloat(TList* list, size_t index, TFloat value) {
+    if (list->elemType != TYPE_FLOAT || index > arrlenu(list->floats)) return _SetListFloat(list, index, value);
+    _GrowList(list, index);
+    list->floats[index] = value;
+    return list;
+}
+
+TList* _SetPackedString(TList* list, size_t index, const TChar* value) {
+    if (list->elemType != TYPE_STRING || index > arrlenu(list->strings)) return _SetListString(list, index, value);
+    _GrowList(list, index);
+    TChar* prev = list->strings[index];
+    list->strings[index] = lstr_alloc(value);
+    _DecRef(prev);
+    return list;
+}
+
+TInt _PackedInt(TList* list, size_t index) {
+    if (list->elemType != TYPE_INT) return _ListInt(list, index);
+    return (index < arrlenu(list->ints)) ? list->ints[index] : 0;
+}
+
+TFloat _PackedFloat(TList* list, size_t index) {
+    if (list->elemType != TYPE_FLOAT) return _ListFloat(list, index);
+    return (index < arrlenu(list->floats)) ? list->floats[index] : 0.0f;
+}
+
+const TChar* _PackedString(TList* list, size_t index) {
+    if (list->elemType != TYPE_STRING || index >= arrlenu(list->strings)) {
+        return _ListString(list, index);
+    }
+    return list->strings[index];
+}
+
 const TChar* _ListToString(TList* list) {
     TChar content[65536];
     content[0] = '\0';
     strcpy(content, "[");
     for (size_t i = 0; i < arrlenu(list->elems); ++i) {
-        const Value value = list->elems[i];
-        const TChar* prefix = (value.type == TYPE_STRING)
+        const Value value = _ListValue(list, i);
+        const TChar* prefix = (_ValueType(value) == TYPE_STRING)
             ? "\""
             : "";
         if (i > 0) strcat(content, ", ");
@@ -405,7 +735,19 @@ const TChar* _ListToString(TList* list) {
 void RemoveIndex(TList* list, TInt index) {
     if (index >= 0 && index < ListSize(list)) {
         _ClearListValue(list, index);
-        arrdel(list->elems, index);
+        switch (list->elemType) {
+        case TYPE_INT:
+            arrdel(list->ints, index);
+            break;
+        case TYPE_FLOAT:
+            arrdel(list->floats, index);
+            break;
+        case TYPE_STRING:
+            arrdel(list->strings, index);
+            break;
+        default:
+            arrdel(list->elems, index);
+        }
     }
 }
 
@@ -421,126 +763,299 @@ void ClearList(TList* list) {
 // Dict
 // ------------------------------------
 
+// Dicts with up to this many entries are searched linearly, larger ones get a hash index
+#define DICT_SMALL_MAX 8
+
 typedef struct {
-    const TChar* key;
+    TChar* key;         // Retained or copied, NULL once the entry has been removed from an indexed dict
+    unsigned int hash;
     Value value;
 } DictEntry;
 
 typedef struct TDict {
-    DictEntry* entries;
+    GcNode gc;
+    DictEntry* entries; // In insertion order
+    size_t count;       // Entries that have not been removed
+    unsigned int* slots;// Open addressing index of entries + 1 (0 means empty), NULL for small dicts
+    size_t mask;
 } TDict;
 
-void _ClearDictValue(TDict* dict, const TChar* key) {
-    const Value value = shget(dict->entries, key);
-    if (Contains(dict, key) && ValueIsManaged(value)) {
-        _DecRef(value.value.r);
+// Keys cache their FNV-1a hash, so it is only computed once per string
+static unsigned int _DictHash(const TChar* key) {
+    const unsigned int hash = lstr_hash(key);
+    return hash ^ (hash >> 15);
+}
+
+// Compacts the entries and indexes them in a table at most a quarter full
+static void _DictIndex(TDict* dict) {
+    size_t count = 0;
+    for (size_t i = 0; i < arrlenu(dict->entries); ++i) {
+        if (dict->entries[i].key) dict->entries[count++] = dict->entries[i];
+    }
+    arrsetlen(dict->entries, count);
+    size_t size = 32;
+    while (size < count * 4) size *= 2;
+    free(dict->slots);
+    dict->slots = (unsigned int*)calloc(size, sizeof(unsigned int));
+    dict->mask = size - 1;
+    for (size_t i = 0; i < count; ++i) {
+        size_t slot = dict->entries[i].hash & dict->mask;
+        while (dict->slots[slot]) slot = (slot + 1) & dict->mask;
+        dict->slots[slot] = (unsigned int)i + 1;
     }
 }
 
-void _DestroyDict(TDict* dict) {
-    for (size_t i = 0; i < shlenu(dict->entries); ++i) {
-        if (ValueIsManaged(dict->entries[i].value)) {
-            _DecRef(dict->entries[i].value.value.r);
+static int _DictMatch(const DictEntry* entry, const TChar* key, unsigned int hash) {
+    return entry->hash == hash && entry->key && (entry->key == key || strcmp(entry->key, key) == 0);
+}
+
+// Index of the entry with the given key, or -1
+static TInt _DictFind(const TDict* dict, const TChar* key, unsigned int hash) {
+    if (!dict->slots) {
+        for (size_t i = 0; i < arrlenu(dict->entries); ++i) {
+            if (_DictMatch(&dict->entries[i], key, hash)) return i;
         }
+        return -1;
+    }
+    for (size_t slot = hash & dict->mask; dict->slots[slot]; slot = (slot + 1) & dict->mask) {
+        if (_DictMatch(&dict->entries[dict->slots[slot] - 1], key, hash)) return dict->slots[slot] - 1;
+    }
+    return -1;
+}
+
+// Accesses with a constant key remember the entry where they found it, which holds the same key in
+// every dict filled in the same order, and look there before searching
+static TInt _DictFindAt(const TDict* dict, const TChar* key, unsigned int hash, size_t* site) {
+    if (*site < arrlenu(dict->entries) && _DictMatch(&dict->entries[*site], key, hash)) return *site;
+    const TInt index = _DictFind(dict, key, hash);
+    if (index != -1) *site = index;
+    return index;
+}
+
+static size_t _DictAdd(TDict* dict, const TChar* key, unsigned int hash) {
+    DictEntry entry;
+    // Arena strings keep no count, so their owner could still grow them in place
+    entry.key = lmem_counted((void*)key) ? (TChar*)_IncRef((void*)key) : lstr_allocn(key, lstr_len(key));
+    entry.hash = hash;
+    entry.value = ValueFromInt(0);
+    arrput(dict->entries, entry);
+    ++dict->count;
+    return arrlenu(dict->entries) - 1;
+}
+
+// Index of the entry with the given key, added with an unmanaged value if the key is new
+static size_t _DictPut(TDict* dict, const TChar* key, unsigned int hash) {
+    if (!dict->slots) {
+        const TInt index = _DictFind(dict, key, hash);
+        if (index != -1) return index;
+        if (arrlenu(dict->entries) < DICT_SMALL_MAX) return _DictAdd(dict, key, hash);
+        _DictIndex(dict);
+    } else if ((arrlenu(dict->entries) + 1) * 2 > dict->mask + 1) {
+        _DictIndex(dict);
     }
-    shfree(dict->entries);
+    size_t slot = hash & dict->mask;
+    for (; dict->slots[slot]; slot = (slot + 1) & dict->mask) {
+        if (_DictMatch(&dict->entries[dict->slots[slot] - 1], key, hash)) return dict->slots[slot] - 1;
+    }
+    dict->slots[slot] = (unsigned int)arrlenu(dict->entries) + 1;
+    return _DictAdd(dict, key, hash);
+}
+
+static size_t _DictPutAt(TDict* dict, const TChar* key, unsigned int hash, size_t* site) {
+    if (*site < arrlenu(dict->entries) && _DictMatch(&dict->entries[*site], key, hash)) return *site;
+    *site = _DictPut(dict, key, hash);
+    return *site;
+}
+
+static const Value* _DictValue(TDict* dict, TInt index) {
+    return (index != -1) ? &dict->entries[index].value : NULL;
+}
+
+// The previous value is released after the new one is stored, since it may be what keeps the key alive
+static void _DictStore(TDict* dict, size_t index, Value value) {
+    const Value prev = dict->entries[index].value;
+    dict->entries[index].value = value;
+    if (ValueIsManaged(prev)) _DecRef(_ValuePtr(prev));
+}
+
+// Releases the keys and values, keeping the storage
+static void _EmptyDict(TDict* dict) {
+    for (size_t i = 0; i < arrlenu(dict->entries); ++i) {
+        const DictEntry entry = dict->entries[i];
+        lmem_release(entry.key);
+        if (ValueIsManaged(entry.value)) _DecRef(_ValuePtr(entry.value));
+    }
+    arrsetlen(dict->entries, 0);
+    dict->count = 0;
+    if (dict->slots) memset(dict->slots, 0, (dict->mask + 1) * sizeof(unsigned int));
+}
+
+void _DestroyDict(TDict* dict) {
+    _EmptyDict(dict);
+    arrfree(dict->entries);
+    free(dict->slots);
     dict->entries = NULL;
+    dict->slots = NULL;
+    dict->mask = 0;
 }
 
-TDict* _CreateDict() {
-    TDict* dict = lmem_allocauto(TDict, (void*)_DestroyDict);
+void _FreeDict(TDict* dict) {
+    _GcUnlink(&dict->gc);
+    _DestroyDict(dict);
+}
+
+static TDict* _NewDict() {
+    TDict* dict = lmem_alloc(TDict, (void*)_FreeDict);
     dict->entries = NULL;
+    dict->count = 0;
+    dict->slots = NULL;
+    dict->mask = 0;
+    _GcLink(&dict->gc, 1);
+    return dict;
+}
+
+TDict* _CreateDict() {
+    return (TDict*)lmem_autorelease(_NewDict());
+}
+
+// Empties a dict referenced only by the caller, or creates one owned by the caller
+TDict* _RecycleDict(TDict* dict) {
+    if (!dict) return _NewDict();
+    _EmptyDict(dict);
     return dict;
 }
 
 TDict* _SetDictInt(TDict* dict, const TChar* key, TInt value) {
-    _ClearDictValue(dict, key);
-    shput(dict->entries, key, ValueFromInt(value));
+    _DictStore(dict, _DictPut(dict, key, _DictHash(key)), ValueFromInt(value));
+    return dict;
+}
+
+TDict* _SetDictIntAt(TDict* dict, const TChar* key, unsigned int hash, size_t* site, TInt value) {
+    _DictStore(dict, _DictPutAt(dict, key, hash, site), ValueFromInt(value));
     return dict;
 }
 
 TDict* _SetDictFloat(TDict* dict, const TChar* key, TFloat value) {
-    _ClearDictValue(dict, key);
-    shput(dict->entries, key, ValueFromFloat(value));
+    _DictStore(dict, _DictPut(dict, key, _DictHash(key)), ValueFromFloat(value));
+    return dict;
+}
+
+TDict* _SetDictFloatAt(TDict* dict, const TChar* key, unsigned int hash, size_t* site, TFloat value) {
+    _DictStore(dict, _DictPutAt(dict, key, hash, site), ValueFromFloat(value));
     return dict;
 }
 
 TDict* _SetDictString(TDict* dict, const TChar* key, const TChar* value) {
-    _IncRef((TChar*)value);
-    _ClearDictValue(dict, key);
-    shput(dict->entries, key, ValueFromString(value));
-    _DecRef((TChar*)value);
+    _DictStore(dict, _DictPut(dict, key, _DictHash(key)), ValueFromString(value));
+    return dict;
+}
+
+TDict* _SetDictStringAt(TDict* dict, const TChar* key, unsigned int hash, size_t* site, const TChar* value) {
+    _DictStore(dict, _DictPutAt(dict, key, hash, site), ValueFromString(value));
     return dict;
 }
 
 TDict* _SetDictList(TDict* dict, const TChar* key, TList* value) {
-    _IncRef(value);
-    _ClearDictValue(dict, key);
-    shput(dict->entries, key, ValueFromList(value));
-    _DecRef(value);
+    _DictStore(dict, _DictPut(dict, key, _DictHash(key)), ValueFromList(value));
+    return dict;
+}
+
+TDict* _SetDictListAt(TDict* dict, const TChar* key, unsigned int hash, size_t* site, TList* value) {
+    _DictStore(dict, _DictPutAt(dict, key, hash, site), ValueFromList(value));
     return dict;
 }
 
 TDict* _SetDictDict(TDict* dict, const TChar* key, TDict* value) {
-    _IncRef(value);
-    _ClearDictValue(dict, key);
-    shput(dict->entries, key, ValueFromDict(value));
-    _DecRef(value);
+    _DictStore(dict, _DictPut(dict, key, _DictHash(key)), ValueFromDict(value));
+    return dict;
+}
+
+TDict* _SetDictDictAt(TDict* dict, const TChar* key, unsigned int hash, size_t* site, TDict* value) {
+    _DictStore(dict, _DictPutAt(dict, key, hash, site), ValueFromDict(value));
     return dict;
 }
 
 TDict* _SetDictRaw(TDict* dict, const TChar* key, void* value) {
-    _ClearDictValue(dict, key);
-    shput(dict->entries, key, ValueFromRaw(value));
+    _DictStore(dict, _DictPut(dict, key, _DictHash(key)), ValueFromRaw(value));
+    return dict;
+}
+
+TDict* _SetDictRawAt(TDict* dict, const TChar* key, unsigned int hash, size_t* site, void* value) {
+    _DictStore(dict, _DictPutAt(dict, key, hash, site), ValueFromRaw(value));
     return dict;
 }
 
 TInt _DictInt(TDict* dict, const TChar* key) {
-    return (Contains(dict, key))
-        ? ValueToInt(shget(dict->entries, key))
-        : 0;
+    const Value* value = _DictValue(dict, _DictFind(dict, key, _DictHash(key)));
+    return value ? ValueToInt(*value) : 0;
+}
+
+TInt _DictIntAt(TDict* dict, const TChar* key, unsigned int hash, size_t* site) {
+    const Value* value = _DictValue(dict, _DictFindAt(dict, key, hash, site));
+    return value ? ValueToInt(*value) : 0;
 }
 
 TFloat _DictFloat(TDict* dict, const TChar* key) {
-    return (Contains(dict, key))
-        ? ValueToFloat(shget(dict->entries, key))
-        : 0.0f;
+    const Value* value = _DictValue(dict, _DictFind(dict, key, _DictHash(key)));
+    return value ? ValueToFloat(*value) : 0.0f;
+}
+
+TFloat _DictFloatAt(TDict* dict, const TChar* key, unsigned int hash, size_t* site) {
+    const Value* value = _DictValue(dict, _DictFindAt(dict, key, hash, site));
+    return value ? ValueToFloat(*value) : 0.0f;
 }
 
 const TChar* _DictString(TDict* dict, const TChar* key) {
-    return (Contains(dict, key))
-        ? ValueToString(shget(dict->entries, key))
-        : lstr_get("");
+    const Value* value = _DictValue(dict, _DictFind(dict, key, _DictHash(key)));
+    return value ? ValueToString(*value) : lstr_get("");
+}
+
+const TChar* _DictStringAt(TDict* dict, const TChar* key, unsigned int hash, size_t* site) {
+    const Value* value = _DictValue(dict, _DictFindAt(dict, key, hash, site));
+    return value ? ValueToString(*value) : lstr_get("");
 }
 
 TList* _DictList(TDict* dict, const TChar* key) {
-    return (Contains(dict, key))
-        ? ValueToList(shget(dict->entries, key))
-        : _CreateList();
+    const Value* value = _DictValue(dict, _DictFind(dict, key, _DictHash(key)));
+    return value ? ValueToList(*value) : _CreateList();
+}
+
+TList* _DictListAt(TDict* dict, const TChar* key, unsigned int hash, size_t* site) {
+    const Value* value = _DictValue(dict, _DictFindAt(dict, key, hash, site));
+    return value ? ValueToList(*value) : _CreateList();
 }
 
 TDict* _DictDict(TDict* dict, const TChar* key) {
-    return (Contains(dict, key))
-        ? ValueToDict(shget(dict->entries, key))
-        : _CreateDict();
+    const Value* value = _DictValue(dict, _DictFind(dict, key, _DictHash(key)));
+    return value ? ValueToDict(*value) : _CreateDict();
+}
+
+TDict* _DictDictAt(TDict* dict, const TChar* key, unsigned int hash, size_t* site) {
+    const Value* value = _DictValue(dict, _DictFindAt(dict, key, hash, site));
+    return value ? ValueToDict(*value) : _CreateDict();
 }
 
 void* _DictRaw(TDict* dict, const TChar* key) {
-    return (Contains(dict, key))
-        ? ValueToRaw(shget(dict->entries, key))
-        : NULL;
+    const Value* value = _DictValue(dict, _DictFind(dict, key, _DictHash(key)));
+    return value ? ValueToRaw(*value) : NULL;
+}
+
+void* _DictRawAt(TDict* dict, const TChar* key, unsigned int hash, size_t* site) {
+    const Value* value = _DictValue(dict, _DictFindAt(dict, key, hash, site));
+    return value ? ValueToRaw(*value) : NULL;
 }
 
 const TChar* _DictToString(TDict* dict) {
     TChar content[65536];
     content[0] = '\0';
     strcpy(content, "{");
-    for (size_t i = 0; i < shlenu(dict->entries); ++i) {
+    for (size_t i = 0; i < arrlenu(dict->entries); ++i) {
         const DictEntry* entry = &dict->entries[i];
-        const TChar* prefix = (entry->value.type == TYPE_STRING)
+        if (!entry->key) continue;
+        const TChar* prefix = (_ValueType(entry->value) == TYPE_STRING)
             ? "\""
             : "";
-        if (i > 0) strcat(content, ", ");
+        if (content[1] != '\0') strcat(content, ", ");
         strcat(content, "\"");
         strcat(content, entry->key);
         strcat(content, "\": ");
@@ -553,22 +1068,104 @@ const TChar* _DictToString(TDict* dict) {
 }
 
 TInt Contains(TDict* dict, const TChar* key) {
-    return shlenu(dict->entries) > 0;
+    return _DictFind(dict, key, _DictHash(key)) != -1;
 }
 
+// Removed entries of indexed dicts stay as tombstones until the next reindex
 void RemoveKey(TDict* dict, const TChar* key) {
-    if (Contains(dict, key)) {
-        _ClearDictValue(dict, key);
-        shdel(dict->entries, key);
+    const TInt index = _DictFind(dict, key, _DictHash(key));
+    if (index == -1) return;
+    const DictEntry entry = dict->entries[index];
+    if (dict->slots) {
+        dict->entries[index].key = NULL;
+        dict->entries[index].value = ValueFromInt(0);
+    } else {
+        arrdel(dict->entries, index);
     }
+    --dict->count;
+    lmem_release(entry.key);
+    if (ValueIsManaged(entry.value)) _DecRef(_ValuePtr(entry.value));
 }
 
 TInt DictSize(TDict* dict) {
-    return shlenu(dict->entries);
+    return dict->count;
 }
 
 void ClearDict(TDict* dict) {
-    _DestroyDict(dict);
+    _EmptyDict(dict);
+}
+
+// ------------------------------------
+// Garbage collection
+// ------------------------------------
+
+// Calls visit on every counted container stored in the given one
+static void _GcVisitChildren(GcNode* node, void (*visit)(GcNode*, GcNode***), GcNode*** stack) {
+    // Packed lists hold no containers
+    const TList* list = (TList*)node;
+    const size_t count = node->isDict
+        ? arrlenu(((TDict*)node)->entries)
+        : ((list->elemType == TYPE_VOID) ? arrlenu(list->elems) : 0);
+    for (size_t i = 0; i < count; ++i) {
+        const Value v = node->isDict ? ((TDict*)node)->entries[i].value : list->elems[i];
+        const TInt type = _ValueType(v);
+        if ((type == TYPE_LIST || type == TYPE_DICT) && lmem_counted(_ValuePtr(v))) {
+            visit((GcNode*)_ValuePtr(v), stack);
+        }
+    }
+}
+
+static void _GcDiscount(GcNode* child, GcNode*** stack) {
+    if (child->refs > 0) --child->refs;
+}
+
+static void _GcReach(GcNode* child, GcNode*** stack) {
+    if (child->refs == 0) {
+        child->refs = 1;
+        arrput(*stack, child);
+    }
+}
+
+// Trial deletion: references that remain after discounting the ones between containers come from
+// variables or temporaries, and whatever those can reach is alive. The rest are unreachable cycles,
+// and the containers only referenced from them.
+TInt CollectGarbage() {
+    GcNode** stack = NULL;
+    GcNode** garbage = NULL;
+    for (GcNode* node = leaf_gcAll.next; node != &leaf_gcAll; node = node->next) {
+        node->refs = lmem_count(node);
+    }
+    for (GcNode* node = leaf_gcAll.next; node != &leaf_gcAll; node = node->next) {
+        _GcVisitChildren(node, _GcDiscount, NULL);
+    }
+    for (GcNode* node = leaf_gcAll.next; node != &leaf_gcAll; node = node->next) {
+        if (node->refs > 0) arrput(stack, node);
+    }
+    while (arrlenu(stack) > 0) {
+        _GcVisitChildren(arrpop(stack), _GcReach, &stack);
+    }
+    for (GcNode* node = leaf_gcAll.next; node != &leaf_gcAll; node = node->next) {
+        if (node->refs == 0) arrput(garbage, node);
+    }
+
+    // Keep the garbage alive while the references between them are dropped, then free it
+    const size_t count = arrlenu(garbage);
+    for (size_t i = 0; i < count; ++i) lmem_retain(garbage[i]);
+    for (size_t i = 0; i < count; ++i) {
+        if (garbage[i]->isDict) {
+            _DestroyDict((TDict*)garbage[i]);
+        } else {
+            _DestroyList((TList*)garbage[i]);
+        }
+    }
+    for (size_t i = 0; i < count; ++i) lmem_release(garbage[i]);
+    arrfree(stack);
+    arrfree(garbage);
+
+    leaf_gcAllocs = 0;
+    leaf_gcThreshold = (leaf_gcLive > GC_MIN_ALLOCS) ? leaf_gcLive : GC_MIN_ALLOCS;
+    leaf_gcPending = 0;
+    return (TInt)count;
 }
 
 // ------------------------------------
@@ -752,7 +1349,7 @@ void PokeFloat(TMemory* mem, TInt offset, TFloat val) {
 }
 
 void PokeString(TMemory* mem, TInt offset, const TChar* val) {
-    memcpy(&(mem->ptr[offset]), val, strlen(val) + 1);
+    memcpy(&(mem->ptr[offset]), val, lstr_len(val) + 1);
 }
 
 void PokeRaw(TMemory* mem, TInt offset, void* val) {
@@ -763,30 +1360,34 @@ void PokeRaw(TMemory* mem, TInt offset, void* val) {
 // String
 // ------------------------------------
 
+// Copies count characters from offset, clamped to the len characters of the string
+static const TChar* _Substr(const TChar* str, size_t len, TInt offset, TInt count) {
+    if (offset < 0) offset = 0;
+    if ((size_t)offset > len) offset = len;
+    if (count < 0) count = 0;
+    if ((size_t)count > len - offset) count = len - offset;
+    return (const TChar*)lmem_autorelease(lstr_allocn(str + offset, count));
+}
+
 TInt Len(const TChar* str) {
-    return strlen(str);
+    return lstr_len(str);
 }
 
 const TChar* Left(const TChar* str, TInt count) {
-    TChar* result = lstr_allocempty(count);
-    strncpy(result, str, count);
-    return (const TChar*)lmem_autorelease(result);
+    return _Substr(str, lstr_len(str), 0, count);
 }
 
 const TChar* Right(const TChar* str, TInt count) {
-    TChar* result = lstr_allocempty(count);
-    strncpy(result, str + strlen(str) - count, count);
-    return (const TChar*)lmem_autorelease(result);
+    const size_t len = lstr_len(str);
+    return _Substr(str, len, ((size_t)count < len) ? (len - count) : 0, count);
 }
 
 const TChar* Mid(const TChar* str, TInt offset, TInt count) {
-    TChar* result = lstr_allocempty(count);
-    strncpy(result, str + offset, count);
-    return (const TChar*)lmem_autorelease(result);
+    return _Substr(str, lstr_len(str), offset, count);
 }
 
 const TChar* Lower(const TChar* str) {
-    const size_t len = strlen(str);
+    const size_t len = lstr_len(str);
     TChar* result = lstr_allocempty(len);
     for (size_t i = 0; i < len; ++i) {
         result[i] = (TChar)tolower(str[i]);
@@ -795,7 +1396,7 @@ const TChar* Lower(const TChar* str) {
 }
 
 const TChar* Upper(const TChar* str) {
-    const size_t len = strlen(str);
+    const size_t len = lstr_len(str);
     TChar* result = lstr_allocempty(len);
     for (size_t i = 0; i < len; ++i) {
         result[i] = (TChar)toupper(str[i]);
@@ -811,94 +1412,100 @@ TInt Find(const TChar* str, const TChar* find, TInt offset) {
         return (p - str);
 }
 
-TChar* _ReplaceOne(const TChar* str, size_t pos, size_t len, const TChar* rep, size_t rlen) {
-    TChar* result = lstr_allocempty(strlen(str) + rlen - len);
-    strncpy(result, str, pos);
-    strcat(result, rep);
-    strcat(result, &str[pos + len]);
-    return (TChar*)lmem_autorelease(result);
-}
-
+// Matches are counted first, so the result is allocated once with its final length
 const TChar* Replace(const TChar* str, const TChar* find, const TChar* replace) {
-    TChar* result = lstr_get(str);
-    const size_t rlen = strlen(replace);
-    const size_t find_len = strlen(find);
-    size_t find_pos = Find(result, find, 0);
-    while (find_pos != -1) {
-        result = _ReplaceOne(result, find_pos, find_len, replace, rlen);
-        find_pos = Find(result, find, find_pos + rlen);
+    const size_t len = lstr_len(str);
+    const size_t find_len = lstr_len(find);
+    const size_t rlen = lstr_len(replace);
+    if (find_len == 0) return _Substr(str, len, 0, len);
+    size_t count = 0;
+    for (const TChar* p = strstr(str, find); p; p = strstr(p + find_len, find)) ++count;
+    TChar* result = lstr_allocempty(len - count * find_len + count * rlen);
+    TChar* out = result;
+    const TChar* prev = str;
+    for (const TChar* p = strstr(str, find); p; p = strstr(p + find_len, find)) {
+        memcpy(out, prev, p - prev);
+        memcpy(out + (p - prev), replace, rlen);
+        out += (p - prev) + rlen;
+        prev = p + find_len;
     }
-    return result;
+    memcpy(out, prev, str + len - prev);
+    return (const TChar*)lmem_autorelease(result);
 }
 
 const TChar* Trim(const TChar* str) {
-    const size_t len = strlen(str);
+    const size_t len = lstr_len(str);
     size_t offset = 0;
     while (offset < len && isspace(str[offset])) ++offset;
-    size_t count = len - offset - 1;
-    while (count > 0 && isspace(str[offset + count])) --count;
-    return Mid(str, offset, count + 1);
+    size_t end = len;
+    while (end > offset && isspace(str[end - 1])) --end;
+    return _Substr(str, len, offset, end - offset);
 }
 
 const TChar* Join(TList* list, const TChar* separator) {
     size_t current_len = 0;
     size_t current_max = 1000;
-    TChar* tmp = (TChar*)calloc(current_max, sizeof(TChar));
+    TChar* tmp = (TChar*)malloc(current_max * sizeof(TChar));
     const TInt size = ListSize(list);
-    const size_t seplen = strlen(separator);
+    const size_t seplen = lstr_len(separator);
     for (TInt i = 0; i < size; ++i) {
         const TChar* str = (const TChar*)_IncRef((void*)_ListString(list, i));
-        size_t len = strlen(str);
-        if (i > 0) len += seplen;
-        if (current_max < current_len + len + 1) {
-            current_max += (TInt)Max(1000, len + 1);
+        const size_t len = lstr_len(str);
+        const size_t needed = current_len + ((i > 0) ? seplen : 0) + len;
+        if (current_max < needed) {
+            current_max = (current_max * 2 > needed) ? current_max * 2 : needed;
             tmp = (TChar*)realloc(tmp, current_max * sizeof(TChar));
         }
-        if (i > 0) strcat(tmp, separator);
-        strcat(tmp, str);
+        if (i > 0) {
+            memcpy(tmp + current_len, separator, seplen * sizeof(TChar));
+            current_len += seplen;
+        }
+        memcpy(tmp + current_len, str, len * sizeof(TChar));
         current_len += len;
         _DecRef((void*)str);
     }
-    TChar* result = lstr_get(tmp);
+    TChar* result = (TChar*)lmem_autorelease(lstr_allocn(tmp, current_len));
     free(tmp);
     return result;
 }
 
 TList* _SplitChars(const TChar* str) {
     const TInt len = Len(str);
-    TList* list = _CreateList();
+    TList* list = _CreatePackedList(TYPE_STRING);
     for (TInt i = 0; i < len; ++i) {
-        _SetListString(list, i, Chr(str[i]));
+        _SetPackedString(list, i, Chr(str[i]));
     }
     return list;
 }
 
 TList* _SplitBySep(const TChar* str, const TChar* separator) {
-    const size_t seplen = strlen(separator);
-    TList* list = _CreateList();
+    const size_t len = lstr_len(str);
+    const size_t seplen = lstr_len(separator);
+    TList* list = _CreatePackedList(TYPE_STRING);
     TInt prevoffset = 0;
     TInt nextoffset = 0;
     TInt i = 0;
     while ((nextoffset = Find(str, separator, prevoffset)) != -1) {
-        _SetListString(list, i++, Mid(str, prevoffset, nextoffset - prevoffset));
+        _SetPackedString(list, i++, _Substr(str, len, prevoffset, nextoffset - prevoffset));
         prevoffset = nextoffset + seplen;
     }
-    _SetListString(list, i++, lstr_get(str + prevoffset));
+    _SetPackedString(list, i++, _Substr(str, len, prevoffset, len - prevoffset));
     return list;
 }
 
 TList* Split(const TChar* str, const TChar* separator) {
-    if (strcmp(separator, "") == 0) {
+    if (separator[0] == '\0') {
         return _SplitChars(str);
     } else {
         return _SplitBySep(str, separator);
     }
 }
 
+// The compiler uses the file name functions on its own strings too, so they measure them
 const TChar* StripExt(const TChar* filename) {
     const TChar* endp = strrchr(filename, '.');
     if (!endp) return lstr_get(filename);
-    return Mid(filename, 0, endp - filename);
+    return _Substr(filename, strlen(filename), 0, endp - filename);
 }
 
 const TChar* StripDir(const TChar* filename) {
@@ -906,15 +1513,17 @@ const TChar* StripDir(const TChar* filename) {
     const TChar* bendp = strrchr(filename, '\\');
     const TChar* endp = (fendp >= bendp) ? fendp : bendp;
     if (!endp) return lstr_get(filename);
+    const size_t len = strlen(filename);
     const size_t offset = endp - filename + 1;
-    return Mid(filename, offset, strlen(filename) - offset);
+    return _Substr(filename, len, offset, len - offset);
 }
 
 const TChar* ExtractExt(const TChar* filename) {
     const TChar* endp = strrchr(filename, '.');
     if (!endp) return lstr_get("");
+    const size_t len = strlen(filename);
     const size_t offset = endp - filename + 1;
-    return Mid(filename, offset, strlen(filename) - offset);
+    return _Substr(filename, len, offset, len - offset);
 }
 
 const TChar* ExtractDir(const TChar* filename) {
@@ -923,7 +1532,7 @@ const TChar* ExtractDir(const TChar* filename) {
     const TChar* endp = (fendp >= bendp) ? fendp : bendp;
     if (!endp) return lstr_get("");
     const size_t size = endp - filename;
-    return Mid(filename, 0, size);
+    return _Substr(filename, strlen(filename), 0, size);
 }
 
 TInt Asc(const TChar* str, TInt index) {
@@ -48,6 +48,10 @@ typedef float TFloat;
 typedef char TChar;
 #endif
 
+// Strings passed to the list, dict and string functions must be runtime strings, created by
+// lstr_alloc or declared with LSTR_STATIC, since their length and hash are stored in front of the
+// characters. Plain C strings are only accepted where a filename is expected, and by lstr_alloc
+
 #ifndef CORE_IMPL
 typedef void TMemory;
 #else
@@ -69,6 +73,9 @@ void* _IncRef(void* ptr);
 void _DecRef(void* ptr);
 void* _AutoDec(void* ptr);
 void _DoAutoDec();
+size_t _AutoDecMark();
+void _DoAutoDecTo(size_t mark);
+void _TrimAutoDec(size_t mark);   // Only releases once the scope holds enough temporaries
 
 // ------------------------------------
 // Console
@@ -98,6 +105,9 @@ void DeleteFile(const TChar* filename);
 // ------------------------------------
 
 struct TList* _CreateList();
+struct TList* _CreatePackedList(TInt elemType);
+struct TList* _RecycleList(struct TList* list);
+struct TList* _RecyclePackedList(struct TList* list, TInt elemType);
 struct TList* _SetListInt(struct TList* list, size_t index, TInt value);
 struct TList* _SetListFloat(struct TList* list, size_t index, TFloat value);
 struct TList* _SetListString(struct TList* list, size_t index, const TChar* value);
@@ -110,6 +120,12 @@ const TChar* _ListString(struct TList* list, size_t index);
 struct TList* _ListList(struct TList* list, size_t index);
 struct TDict* _ListDict(struct TList* list, size_t index);
 void* _ListRaw(struct TList* list, size_t index);
+struct TList* _SetPackedInt(struct TList* list, size_t index, TInt value);
+struct TList* _SetPackedFloat(struct TList* list, size_t index, TFloat value);
+struct TList* _SetPackedString(struct TList* list, size_t index, const TChar* value);
+TInt _PackedInt(struct TList* list, size_t index);
+TFloat _PackedFloat(struct TList* list, size_t index);
+const TChar* _PackedString(struct TList* list, size_t index);
 const TChar* _ListToString(struct TList* list);
 void RemoveIndex(struct TList* list, TInt index);
 TInt ListSize(struct TList* list);
@@ -120,24 +136,43 @@ void ClearList(struct TList* list);
 // ------------------------------------
 
 struct TDict* _CreateDict();
+struct TDict* _RecycleDict(struct TDict* dict);
 struct TDict* _SetDictInt(struct TDict* dict, const TChar* key, TInt value);
+struct TDict* _SetDictIntAt(struct TDict* dict, const TChar* key, unsigned int hash, size_t* site, TInt value);
 struct TDict* _SetDictFloat(struct TDict* dict, const TChar* key, TFloat value);
+struct TDict* _SetDictFloatAt(struct TDict* dict, const TChar* key, unsigned int hash, size_t* site, TFloat value);
 struct TDict* _SetDictString(struct TDict* dict, const TChar* key, const TChar* value);
+struct TDict* _SetDictStringAt(struct TDict* dict, const TChar* key, unsigned int hash, size_t* site, const TChar* value);
 struct TDict* _SetDictList(struct TDict* dict, const TChar* key, struct TList* value);
+struct TDict* _SetDictListAt(struct TDict* dict, const TChar* key, unsigned int hash, size_t* site, struct TList* value);
 struct TDict* _SetDictDict(struct TDict* dict, const TChar* key, struct TDict* value);
+struct TDict* _SetDictDictAt(struct TDict* dict, const TChar* key, unsigned int hash, size_t* site, struct TDict* value);
 struct TDict* _SetDictRaw(struct TDict* dict, const TChar* key, void* value);
+struct TDict* _SetDictRawAt(struct TDict* dict, const TChar* key, unsigned int hash, size_t* site, void* value);
 TInt _DictInt(struct TDict* dict, const TChar* key);
+TInt _DictIntAt(struct TDict* dict, const TChar* key, unsigned int hash, size_t* site);
 TFloat _DictFloat(struct TDict* dict, const TChar* key);
+TFloat _DictFloatAt(struct TDict* dict, const TChar* key, unsigned int hash, size_t* site);
 const TChar* _DictString(struct TDict* dict, const TChar* key);
+const TChar* _DictStringAt(struct TDict* dict, const TChar* key, unsigned int hash, size_t* site);
 struct TList* _DictList(struct TDict* dict, const TChar* key);
+struct TList* _DictListAt(struct TDict* dict, const TChar* key, unsigned int hash, size_t* site);
 struct TDict* _DictDict(struct TDict* dict, const TChar* key);
+struct TDict* _DictDictAt(struct TDict* dict, const TChar* key, unsigned int hash, size_t* site);
 void* _DictRaw(struct TDict* dict, const TChar* key);
+void* _DictRawAt(struct TDict* dict, const TChar* key, unsigned int hash, size_t* site);
 const TChar* _DictToString(struct TDict* dict);
 TInt Contains(struct TDict* dict, const TChar* key);
 void RemoveKey(struct TDict* dict, const TChar* key);
 TInt DictSize(struct TDict* dict);
 void ClearDict(struct TDict* dict);
 
+// ------------------------------------
+// Garbage collection
+// ------------------------------------
+
+TInt CollectGarbage();
+
 // ------------------------------------
 // Math
 // ------------------------------------
@@ -13,24 +13,82 @@ No warranty implied. Use as you wish and at your own risk
 #define lmem_alloc(T, F) (T*)_lmem_alloc(sizeof(T), F)
 #define lmem_allocauto(T, F) (T*)lmem_autorelease(_lmem_alloc(sizeof(T), F))
 #define lmem_assign(V, E) (_lmem_assign((void**)&V, E), V)
+#define lmem_move(V, E) (_lmem_move((void**)&V, E), V)
+
+/* Blocks an autorelease scope can accumulate before lmem_trimautorelease drains it */
+#ifndef LMEM_POOL_HIGHWATER
+#define LMEM_POOL_HIGHWATER 64
+#endif
+
+/* Blocks up to this size, header included, are served from free lists of fixed size classes
+   instead of malloc. Define it as 0 to use malloc for everything, e.g. when debugging memory. */
+#ifndef LMEM_SMALL_MAX
+#define LMEM_SMALL_MAX 256
+#endif
+
+/* Defining LMEM_ARENA bump-allocates blocks from chunks that are only freed when the program exits,
+   so reference counting does nothing for them. Once the arena has mapped LMEM_ARENA_LIMIT megabytes,
+   if set, new blocks are reference counted as usual. */
+#ifndef LMEM_ARENA_LIMIT
+#define LMEM_ARENA_LIMIT 0
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
+/* The delete function is stored as an index into a table, to keep the header at 8 bytes */
+typedef struct {
+  unsigned int count;
+  unsigned char type;
+  unsigned char sizeclass;  /* Free list the block belongs to, or 0 if it came from malloc */
+  unsigned short flags;
+} lmem_rc_t;
+
+
+/* Strings keep their length and hash in front of the reference count, so the count still precedes
+   the characters like in any other block */
+typedef struct {
+  unsigned int len;
+  unsigned int hash;        /* Only valid once LSTR_HASHED is set */
+} lstr_head_t;
+
+
+#define LMEM_STRING 1
+#define LSTR_HASHED 2
+
+/* Static strings start with a count that is never released down to zero */
+#define LSTR_STATIC_COUNT 0x40000000u
+#define LSTR_STATIC(name, s) \
+  static struct { lstr_head_t head; lmem_rc_t rc; char data[sizeof(s)]; } name = \
+    {{sizeof(s) - 1, 0}, {LSTR_STATIC_COUNT, 0, 0, LMEM_STRING}, s}
+
+
 void* _lmem_alloc(size_t size, void* func);
 size_t lmem_retain(void* block);
 size_t lmem_release(void* block);
 size_t lmem_count(void* block);
+int lmem_counted(void* block);
 void* lmem_autorelease(void* block);
 void lmem_doautorelease();
+size_t lmem_automark();
+void lmem_doautoreleaseto(size_t mark);
+void lmem_trimautorelease(size_t mark);
 void _lmem_assign(void** varptr, void* data);
+void _lmem_move(void** varptr, void* data);
 
 
+/* lstr_alloc and lstr_get take any C string. The other functions only take strings created by
+   this library, since they read the length stored in front of them. */
 char* lstr_alloc(const char* s);
+char* lstr_allocn(const char* s, size_t n);
 char* lstr_allocempty(size_t n);
 char* lstr_get(const char* s);
+char* lstr_cat(const char* a, const char* b);
+char* lstr_append(char* s, const char* b);
+size_t lstr_len(const char* s);
+unsigned int lstr_hash(const char* s);
 
 
 #ifdef __cplusplus
@@ -51,31 +109,199 @@ char* lstr_get(const char* s);
 
 #include <stdlib.h>
 #include <string.h>
+#if defined(LMEM_ARENA) && !defined(_WIN32)
+#include <sys/mman.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
-typedef struct {
-  size_t count;
-  void (* delfunc)(void*);
-} lmem_rc_t;
+#define LMEM_CLASS_STEP 16
+#define LMEM_NUM_CLASSES (LMEM_SMALL_MAX / LMEM_CLASS_STEP)
+#define LMEM_SLAB_SIZE 65536
+#define LMEM_MAX_TYPES 256
+#define LMEM_OWNTYPE 4      /* Flag of blocks whose delete function did not fit in the table */
+#define LMEM_ARENA_CHUNK (1024 * 1024)
+#define LMEM_ARENA_CLASS 255
 
 
 typedef struct {
   void** blocks;
   size_t numblocks;
+  size_t capacity;
 } lmem_pool_t;
 
 
+/* Once the table is full, a block keeps its delete function in front of the header instead, padded
+   so the data stays 8-byte aligned */
+typedef union {
+  void (* func)(void*);
+  double align;
+} lmem_slot_t;
+
+
 static lmem_pool_t _lmem_pool = {};
+static void* _lmem_free[LMEM_NUM_CLASSES + 1];
+static void (* _lmem_types[LMEM_MAX_TYPES])(void*);
+static size_t _lmem_numtypes = 1;
+
+
+#ifdef LMEM_ARENA
+static char* _lmem_arenatop = NULL;
+static char* _lmem_arenaend = NULL;
+static size_t _lmem_arenamapped = 0;
+
+
+static size_t _lmem_arenaround(size_t size) {
+  return (size + LMEM_CLASS_STEP - 1) / LMEM_CLASS_STEP * LMEM_CLASS_STEP;
+}
+
+
+/* Fresh chunks are already zeroed */
+static char* _lmem_arenachunk(size_t size) {
+#ifdef _WIN32
+  return (char*)calloc(1, size);
+#else
+  void* chunk = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return (chunk != MAP_FAILED) ? (char*)chunk : NULL;
+#endif
+}
+
+
+/* Returns NULL once the arena is over its limit */
+static lmem_rc_t* _lmem_arenablock(size_t size) {
+  lmem_rc_t* rc;
+  size = _lmem_arenaround(size);
+  if ((size_t)(_lmem_arenaend - _lmem_arenatop) < size) {
+    const size_t chunksize = (size > LMEM_ARENA_CHUNK) ? size : LMEM_ARENA_CHUNK;
+    char* chunk;
+    if (LMEM_ARENA_LIMIT > 0 && _lmem_arenamapped + chunksize > (size_t)LMEM_ARENA_LIMIT * 1024 * 1024) return NULL;
+    chunk = _lmem_arenachunk(chunksize);
+    if (!chunk) return NULL;
+    _lmem_arenatop = chunk;
+    _lmem_arenaend = chunk + chunksize;
+    _lmem_arenamapped += chunksize;
+  }
+  rc = (lmem_rc_t*)_lmem_arenatop;
+  _lmem_arenatop += size;
+  rc->sizeclass = LMEM_ARENA_CLASS;
+  return rc;
+}
+#endif
+
+
+/* Carves a new slab into blocks of the class, which are never returned to the system */
+static void _lmem_refill(size_t sizeclass) {
+  const size_t blocksize = sizeclass * LMEM_CLASS_STEP;
+  const size_t numblocks = LMEM_SLAB_SIZE / blocksize;
+  char* slab = (char*)malloc(numblocks * blocksize);
+  size_t i;
+  for (i = numblocks; i > 0; --i) {
+    void** block = (void**)(slab + (i - 1) * blocksize);
+    *block = _lmem_free[sizeclass];
+    _lmem_free[sizeclass] = block;
+  }
+}
+
+
+/* Returns a block of at least the given size, header included, with only the header cleared
+   unless zeroed is set */
+static lmem_rc_t* _lmem_newblock(size_t size, int zeroed) {
+  const size_t sizeclass = (size + LMEM_CLASS_STEP - 1) / LMEM_CLASS_STEP;
+  lmem_rc_t* rc;
+#ifdef LMEM_ARENA
+  rc = _lmem_arenablock(size);
+  if (rc) return rc;
+#endif
+  if (sizeclass > LMEM_NUM_CLASSES) {
+    rc = (lmem_rc_t*)(zeroed ? calloc(1, size) : malloc(size));
+    memset(rc, 0, sizeof(lmem_rc_t));
+    return rc;
+  }
+  if (!_lmem_free[sizeclass]) _lmem_refill(sizeclass);
+  rc = (lmem_rc_t*)_lmem_free[sizeclass];
+  _lmem_free[sizeclass] = *(void**)rc;
+  if (zeroed) {
+    memset(rc, 0, sizeclass * LMEM_CLASS_STEP);
+  } else {
+    memset(rc, 0, sizeof(lmem_rc_t));
+  }
+  rc->sizeclass = (unsigned char)sizeclass;
+  return rc;
+}
+
+
+/* Where the block of a header starts, which is before it for strings and blocks with their own
+   delete function */
+static void* _lmem_base(lmem_rc_t* rc) {
+  if (rc->flags & LMEM_STRING) return (lstr_head_t*)rc - 1;
+  if (rc->flags & LMEM_OWNTYPE) return (lmem_slot_t*)rc - 1;
+  return rc;
+}
+
+
+static void _lmem_freeblock(lmem_rc_t* rc) {
+  void* base = _lmem_base(rc);
+#ifdef LMEM_ARENA
+  if (rc->sizeclass == LMEM_ARENA_CLASS) return;
+#endif
+  if (rc->sizeclass) {
+    const size_t sizeclass = rc->sizeclass;
+    *(void**)base = _lmem_free[sizeclass];
+    _lmem_free[sizeclass] = base;
+  } else {
+    free(base);
+  }
+}
+
+
+/* Whether a pooled block can hold size bytes, growing it in place when it is the last one taken
+   from the arena */
+static int _lmem_fits(lmem_rc_t* rc, size_t used, size_t size) {
+#ifdef LMEM_ARENA
+  if (rc->sizeclass == LMEM_ARENA_CLASS) {
+    char* block = (char*)_lmem_base(rc);
+    if (block + _lmem_arenaround(used) != _lmem_arenatop) return 0;
+    if ((size_t)(_lmem_arenaend - block) < _lmem_arenaround(size)) return 0;
+    _lmem_arenatop = block + _lmem_arenaround(size);
+    return 1;
+  }
+#endif
+  return size <= rc->sizeclass * LMEM_CLASS_STEP;
+}
+
+
+/* Programs use a handful of delete functions, so they are looked up linearly. Returns 0 when there
+   is none, or when the table is full */
+static unsigned char _lmem_typeof(void* func) {
+  size_t i;
+  if (!func) return 0;
+  for (i = 1; i < _lmem_numtypes; ++i) {
+    if (_lmem_types[i] == (void (*)(void*))func) return (unsigned char)i;
+  }
+  if (_lmem_numtypes == LMEM_MAX_TYPES) return 0;
+  _lmem_types[_lmem_numtypes] = (void (*)(void*))func;
+  return (unsigned char)_lmem_numtypes++;
+}
 
 
 void* _lmem_alloc(size_t size, void* func) {
-  lmem_rc_t* rc = (lmem_rc_t*)calloc(1, sizeof(lmem_rc_t) + size);
+  const unsigned char type = _lmem_typeof(func);
+  lmem_rc_t* rc;
+  if (func && !type) {
+    lmem_slot_t* slot = (lmem_slot_t*)_lmem_newblock(sizeof(lmem_slot_t) + sizeof(lmem_rc_t) + size, 1);
+    const unsigned char sizeclass = ((lmem_rc_t*)slot)->sizeclass;
+    slot->func = (void (*)(void*))func;
+    rc = (lmem_rc_t*)(slot + 1);
+    rc->sizeclass = sizeclass;
+    rc->flags = LMEM_OWNTYPE;
+  } else {
+    rc = _lmem_newblock(sizeof(lmem_rc_t) + size, 1);
+  }
   rc->count = 1;
-  rc->delfunc = (void (*)(void*))func;
+  rc->type = type;
   return rc + 1;
 }
 
@@ -83,6 +309,9 @@ void* _lmem_alloc(size_t size, void* func) {
 size_t lmem_retain(void* block) {
   if (block) {
     lmem_rc_t* rc = (lmem_rc_t*)block - 1;
+#ifdef LMEM_ARENA
+    if (rc->sizeclass == LMEM_ARENA_CLASS) return rc->count;
+#endif
     return ++rc->count;
   } else {
     return 0;
@@ -94,10 +323,14 @@ size_t lmem_release(void* block) {
   if (block) {
     size_t count;
     lmem_rc_t* rc = (lmem_rc_t*)block - 1;
+#ifdef LMEM_ARENA
+    if (rc->sizeclass == LMEM_ARENA_CLASS) return rc->count;
+#endif
     count = --rc->count;
     if (count == 0) {
-      if (rc->delfunc) rc->delfunc(block);
-      free(rc);
+      if (rc->type) _lmem_types[rc->type](block);
+      else if (rc->flags & LMEM_OWNTYPE) ((lmem_slot_t*)rc - 1)->func(block);
+      _lmem_freeblock(rc);
     }
     return count;
   } else {
@@ -115,23 +348,51 @@ size_t lmem_count(void* block) {
 }
 
 
+/* Whether the block is freed when its count drops to zero (arena blocks never are) */
+int lmem_counted(void* block) {
+  if (!block) return 0;
+#ifdef LMEM_ARENA
+  if (((lmem_rc_t*)block - 1)->sizeclass == LMEM_ARENA_CLASS) return 0;
+#endif
+  return 1;
+}
+
+
 void* lmem_autorelease(void* block) {
-  _lmem_pool.blocks = (void**)realloc(
-    _lmem_pool.blocks,
-    ++_lmem_pool.numblocks * sizeof(void*));
-  _lmem_pool.blocks[_lmem_pool.numblocks - 1] = block;
+#ifdef LMEM_ARENA
+  if (block && ((lmem_rc_t*)block - 1)->sizeclass == LMEM_ARENA_CLASS) return block;
+#endif
+  if (_lmem_pool.numblocks == _lmem_pool.capacity) {
+    _lmem_pool.capacity = (_lmem_pool.capacity > 0) ? _lmem_pool.capacity * 2 : 256;
+    _lmem_pool.blocks = (void**)realloc(
+      _lmem_pool.blocks,
+      _lmem_pool.capacity * sizeof(void*));
+  }
+  _lmem_pool.blocks[_lmem_pool.numblocks++] = block;
   return block;
 }
 
 
 void lmem_doautorelease() {
-  size_t i;
-  for (i = 0; i < _lmem_pool.numblocks; ++i) {
-    lmem_release(_lmem_pool.blocks[i]);
+  lmem_doautoreleaseto(0);
+}
+
+
+/* Scopes are nested by taking a mark when they begin and releasing down to it when they end */
+size_t lmem_automark() {
+  return _lmem_pool.numblocks;
+}
+
+
+void lmem_doautoreleaseto(size_t mark) {
+  while (_lmem_pool.numblocks > mark) {
+    lmem_release(_lmem_pool.blocks[--_lmem_pool.numblocks]);
   }
-  free(_lmem_pool.blocks);
-  _lmem_pool.blocks = NULL;
-  _lmem_pool.numblocks = 0;
+}
+
+
+void lmem_trimautorelease(size_t mark) {
+  if (_lmem_pool.numblocks > mark + LMEM_POOL_HIGHWATER) lmem_doautoreleaseto(mark);
 }
 
 
@@ -142,15 +403,48 @@ void _lmem_assign(void** varptr, void* data) {
 }
 
 
+/* Like assign, but the variable takes over the reference the caller owns instead of retaining it */
+void _lmem_move(void** varptr, void* data) {
+  void* old = *varptr;
+  memcpy(varptr, &data, sizeof(void*));
+  lmem_release(old);
+}
+
+
+static lstr_head_t* _lstr_head(const char* s) {
+  return (lstr_head_t*)((lmem_rc_t*)s - 1) - 1;
+}
+
+
+/* Returns a string of n characters whose contents are left to the caller, only terminated */
+static char* _lstr_new(size_t n) {
+  const size_t size = sizeof(lstr_head_t) + sizeof(lmem_rc_t) + (n + 1) * sizeof(char);
+  lstr_head_t* head = (lstr_head_t*)_lmem_newblock(size, 0);
+  const unsigned char sizeclass = ((lmem_rc_t*)head)->sizeclass;
+  lmem_rc_t* rc = (lmem_rc_t*)(head + 1);
+  char* s = (char*)(rc + 1);
+  head->len = (unsigned int)n;
+  rc->count = 1;
+  rc->type = 0;
+  rc->sizeclass = sizeclass;
+  rc->flags = LMEM_STRING;
+  s[n] = 0;
+  return s;
+}
+
+
 char* lstr_alloc(const char* s) {
-  char* string = (char*)_lmem_alloc((strlen(s) + 1) * sizeof(char), NULL);
-  strcpy(string, s);
-  return string;
+  return lstr_allocn(s, strlen(s));
+}
+
+
+char* lstr_allocn(const char* s, size_t n) {
+  return (char*)memcpy(_lstr_new(n), s, n * sizeof(char));
 }
 
 
 char* lstr_allocempty(size_t n) {
-  return (char*)_lmem_alloc((n + 1) * sizeof(char), NULL);
+  return (char*)memset(_lstr_new(n), 0, n * sizeof(char));
 }
 
 
@@ -159,6 +453,68 @@ char* lstr_get(const char* s) {
 }
 
 
+char* lstr_cat(const char* a, const char* b) {
+  const size_t alen = lstr_len(a);
+  const size_t blen = lstr_len(b);
+  char* s = _lstr_new(alen + blen);
+  memcpy(s, a, alen * sizeof(char));
+  memcpy(s + alen, b, blen * sizeof(char));
+  return s;
+}
+
+
+/* Appends in place when the caller holds the only reference to s, returning the string to use from then on */
+char* lstr_append(char* s, const char* b) {
+  size_t len, blen, size;
+  lmem_rc_t* rc;
+  lstr_head_t* head;
+  if (!s) return lstr_allocn(b, lstr_len(b));
+  if (lmem_count(s) != 1) {
+    char* string = lstr_cat(s, b);
+    lmem_release(s);
+    return string;
+  }
+  len = lstr_len(s);
+  blen = lstr_len(b);
+  size = sizeof(lstr_head_t) + sizeof(lmem_rc_t) + (len + blen + 1) * sizeof(char);
+  head = _lstr_head(s);
+  rc = (lmem_rc_t*)(head + 1);
+  if (!rc->sizeclass) {
+    head = (lstr_head_t*)realloc(head, size);
+  } else if (!_lmem_fits(rc, sizeof(lstr_head_t) + sizeof(lmem_rc_t) + (len + 1) * sizeof(char), size)) {
+    char* grown = _lstr_new(len + blen);
+    memcpy(grown, s, len * sizeof(char));
+    _lmem_freeblock(rc);
+    head = _lstr_head(grown);
+  }
+  s = (char*)((lmem_rc_t*)(head + 1) + 1);
+  memcpy(s + len, b, (blen + 1) * sizeof(char));
+  head->len = (unsigned int)(len + blen);
+  ((lmem_rc_t*)(head + 1))->flags &= ~LSTR_HASHED;
+  return s;
+}
+
+
+size_t lstr_len(const char* s) {
+  return s ? _lstr_head(s)->len : 0;
+}
+
+
+/* FNV-1a, computed the first time it is asked for */
+unsigned int lstr_hash(const char* s) {
+  lstr_head_t* head = _lstr_head(s);
+  lmem_rc_t* rc = (lmem_rc_t*)(head + 1);
+  if (!(rc->flags & LSTR_HASHED)) {
+    unsigned int hash = 2166136261u;
+    size_t i;
+    for (i = 0; i < head->len; ++i) hash = (hash ^ (unsigned char)s[i]) * 16777619u;
+    head->hash = hash;
+    rc->flags |= LSTR_HASHED;
+  }
+  return head->hash;
+}
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -13,4 +13,7 @@ echo Moving to _build/bin dir...
 mkdir _build\bin
 move "_CMAKE\leaf.exe" "_build/bin/leaf.exe"
 
+echo Moving core library to _build/libs/core dir...
+move "_CMAKE\libleafcore.a" "_build/libs/core/libleafcore.a"
+
 pause
@@ -13,3 +13,6 @@ cd ..
 echo "Moving to _build/bin dir..."
 mkdir -p _build/bin
 mv _CMAKE/leaf _build/bin/leaf
+
+echo "Moving core library to _build/libs/core dir..."
+mv _CMAKE/libleafcore.a _build/libs/core/libleafcore.a
@@ -0,0 +1,212 @@
+#if defined(_WIN32)
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../generator.h"
+#include "../optimizer.h"
+#include "../parser.h"
+#include "../swan/platform.hh"
+#include "../swan/time.hh"
+
+using namespace std;
+using namespace swan;
+
+#define MAX_SCALE 1000  // Keeps the largest size, 20000 units times the scale, within an int
+
+// Many small functions that call each other
+static string GenerateFunctions(int size) {
+    string source;
+    for (int i = 0; i < size; ++i) {
+        const string id = strmanip::fromint(i);
+        source += "function F" + id + ":Int(a:Int, b:Int)\n";
+        source += "    c = a * 2 + b\n";
+        source += "    if c > 100 then\n";
+        source += "        return c - " + id + "\n";
+        source += "    end\n";
+        source += "    return F" + strmanip::fromint(i > 0 ? i - 1 : 0) + "(c, b)\n";
+        source += "end\n";
+    }
+    source += "r = F" + strmanip::fromint(size - 1) + "(1, 2)\n";
+    return source;
+}
+
+// A single function with a long body, using a growing set of locals
+static string GenerateLongFunction(int size) {
+    string source = "function Long:Int(a:Int)\n    v0 = a\n";
+    for (int i = 1; i < size; ++i) {
+        const string id = strmanip::fromint(i);
+        const string prev = strmanip::fromint(i - 1);
+        source += "    v" + id + " = v" + prev + " * 3 + " + id + "\n";
+        source += "    s" + id + " = \"item\" + v" + id + ":String\n";
+    }
+    source += "    return v" + strmanip::fromint(size - 1) + "\nend\nr = Long(1)\n";
+    return source;
+}
+
+// Blocks of alternating if and for statements, nested 50 levels deep
+static string GenerateNesting(int size) {
+    const int depth = 50;
+    string source = "function Nested:Int(a:Int)\n    x = a\n";
+    for (int block = 0; block < size / depth; ++block) {
+        for (int level = 0; level < depth; ++level) {
+            const string indent((level + 1) * 4, ' ');
+            const string id = strmanip::fromint(level);
+            if (level % 2 == 0) {
+                source += indent + "if x > " + id + " then\n";
+            } else {
+                source += indent + "for i" + id + " = 0 to 2 do\n";
+            }
+            source += indent + "    x = x + 1\n";
+        }
+        for (int level = depth - 1; level >= 0; --level) {
+            source += string((level + 1) * 4, ' ') + "end\n";
+        }
+    }
+    source += "    return x\nend\nr = Nested(1)\n";
+    return source;
+}
+
+// Huge list and dict literals
+static string GenerateLiterals(int size) {
+    string list = "numbers = [";
+    string dict = "names = {";
+    for (int i = 0; i < size; ++i) {
+        const string id = strmanip::fromint(i);
+        if (i > 0) {
+            list += ", ";
+            dict += ", ";
+        }
+        list += id;
+        dict += "\"key" + id + "\": \"value" + id + "\"";
+    }
+    return list + "]\n" + dict + "}\n";
+}
+
+// Statements with long chains of binary operators on parameters, which cannot be folded
+static string GenerateExpressions(int size) {
+    const char* ops[] = {" + ", " * ", " - ", " / "};
+    string source = "function Chains:Float(a:Int, b:Float)\n";
+    for (int statement = 0; statement < 10; ++statement) {
+        string exp = "a";
+        for (int i = 0; i < size / 10; ++i) {
+            exp += string(ops[i % 4]) + ((i % 3 == 0) ? "b" : (i % 3 == 1) ? "a" : strmanip::fromint(i + 1));
+        }
+        source += "    c" + strmanip::fromint(statement) + " = " + exp + "\n";
+    }
+    source += "    return c9\nend\nr = Chains(1, 2.5)\n";
+    return source;
+}
+
+static double Seconds(clock_t start) {
+    return double(clock() - start) / CLOCKS_PER_SEC;
+}
+
+// Files given to gcc go to the temporary folder, named after the process so that runs do not clash
+static string GetTempPrefix() {
+#if defined(_WIN32)
+    string dir = platform::getenv("TEMP");
+    if (dir == "") dir = ".";
+#else
+    string dir = platform::getenv("TMPDIR");
+    if (dir == "") dir = "/tmp";
+#endif
+    return dir + "/compiler_bench." + strmanip::fromint((int)getpid());
+}
+
+static void Run(const char* name, string (*generateSource)(int), int size, bool useGcc) {
+    const string source = generateSource(size);
+
+    clock_t start = clock();
+    const vector<Token> tokens = ParseTokens(source, "bench.lf");
+    const double lex = Seconds(start);
+
+    start = clock();
+    Parser parser(tokens);
+    parser.Parse();
+    const double parse = Seconds(start);
+
+    start = clock();
+    Optimizer().FoldConstants(parser.GetProgram());
+    Optimizer().AnalyzeEscapes(parser.GetProgram());
+    Optimizer().NumberDictSites(parser.GetProgram());
+    Optimizer().InferListTypes(parser.GetProgram());
+    const double optimize = Seconds(start);
+
+    start = clock();
+    Emitter out;
+    Generator().GenProgram(parser.GetProgram(), out);
+    const double generate = Seconds(start);
+
+    const double total = lex + parse + optimize + generate;
+    const double megabytes = double(source.length()) / (1024 * 1024);
+    printf("%-12s %7d %9lu %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f",
+        name, size, (unsigned long)tokens.size(),
+        lex * 1000, parse * 1000, optimize * 1000, generate * 1000, total * 1000, megabytes / total);
+
+    if (useGcc) {
+        const string prefix = GetTempPrefix();
+        const string filename = prefix + ".c";
+        const string objFilename = prefix + ".o";
+        SaveString(filename.c_str(), out.GetBuffer().c_str(), false);
+        const unsigned int gccStart = time::millisecs();
+        const int result = System(("gcc -c -w -O2 -I\"" LEAF_LIBS_DIR "\" -o \"" + objFilename + "\" \"" + filename + "\"").c_str());
+        const unsigned int gcc = time::millisecs() - gccStart;
+        DeleteFile(filename.c_str());
+        DeleteFile(objFilename.c_str());
+        if (result == 0) {
+            printf(" %9u %9.0f", gcc, total * 1000 + gcc);
+        } else {
+            printf(" %9s", "failed");
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+    _DoAutoDec();
+}
+
+int main(int argc, char* argv[]) {
+    // usage: compiler_bench [scale] [--no-gcc], in any order
+    int scale = 1;
+    bool useGcc = true;
+    for (int i = 1; i < argc; ++i) {
+        char* end;
+        const long value = strtol(argv[i], &end, 10);
+        if (strcmp(argv[i], "--no-gcc") == 0) {
+            useGcc = false;
+        } else if (*argv[i] != '\0' && *end == '\0' && value > 0 && value <= MAX_SCALE) {
+            scale = (int)value;
+        } else {
+            fprintf(stderr, "usage: compiler_bench [scale] [--no-gcc]\nscale must be a whole number from 1 to %d\n", MAX_SCALE);
+            return 1;
+        }
+    }
+    const struct {
+        const char* name;
+        string (*generate)(int);
+        int size;
+    } cases[] = {
+        {"functions", GenerateFunctions, 1000},
+        {"long_func", GenerateLongFunction, 2000},
+        {"nesting", GenerateNesting, 1000},
+        {"literals", GenerateLiterals, 2000},
+        {"expressions", GenerateExpressions, 5000}
+    };
+
+    // Each case runs at three sizes, so that time per unit growing with the size shows superlinear spots.
+    // gcc is much slower than the compiler, so it only runs on the smallest size.
+    printf("%-12s %7s %9s %8s %8s %8s %8s %8s %8s", "case", "size", "tokens", "lex ms", "parse ms", "opt ms", "gen ms", "total ms", "MB/s");
+    if (useGcc) printf(" %9s %9s", "gcc ms", "+gcc ms");
+    printf("\n");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        for (int factor = 1; factor <= 4; factor *= 2) {
+            Run(cases[i].name, cases[i].generate, cases[i].size * scale * factor, useGcc && factor == 1);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include "../../_build/libs/core/core.h"
+#include "../../_build/libs/core/litemem.h"
+
+// Counts every heap allocation of the process, including the ones made by the runtime, and the
+// bytes in use. On glibc this is done by replacing the allocator functions, elsewhere allocations
+// are not reported.
+static size_t numAllocs = 0;
+static long heapBytes = 0;
+#if defined(__GLIBC__)
+#define COUNT_ALLOCS
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+static void* Track(void* ptr) { heapBytes += malloc_usable_size(ptr); return ptr; }
+void* malloc(size_t size) { ++numAllocs; return Track(__libc_malloc(size)); }
+void* calloc(size_t count, size_t size) { ++numAllocs; return Track(__libc_calloc(count, size)); }
+void* realloc(void* ptr, size_t size) { ++numAllocs; heapBytes -= malloc_usable_size(ptr); return Track(__libc_realloc(ptr, size)); }
+void free(void* ptr) { heapBytes -= malloc_usable_size(ptr); __libc_free(ptr); }
+}
+#endif
+
+// Each benchmark does its setup, then calls Start before the measured loop and Stop after it,
+// before releasing what it built, so the heap growth shows the memory its data takes
+static clock_t startClock;
+static clock_t elapsed;
+static size_t startAllocs;
+static size_t allocs;
+static long startBytes;
+static long bytes;
+
+static void Start() {
+    startAllocs = numAllocs;
+    startBytes = heapBytes;
+    startClock = clock();
+}
+
+static void Stop() {
+    elapsed = clock() - startClock;
+    allocs = numAllocs - startAllocs;
+    bytes = heapBytes - startBytes;
+}
+
+// Keys and texts are built before measuring, so only the runtime calls are timed
+static char** MakeKeys(int count) {
+    char** keys = (char**)malloc(count * sizeof(char*));
+    for (int i = 0; i < count; ++i) {
+        char key[32];
+        sprintf(key, "key%d", i);
+        keys[i] = lstr_alloc(key);
+    }
+    return keys;
+}
+
+static void FreeKeys(char** keys, int count) {
+    for (int i = 0; i < count; ++i) lmem_release(keys[i]);
+    free(keys);
+}
+
+static struct TList* MakeItems(int count) {
+    struct TList* list = (struct TList*)_IncRef(_CreateList());
+    for (int i = 0; i < count; ++i) {
+        char item[32];
+        sprintf(item, "item%d", i);
+        _SetListString(list, i, lstr_get(item));
+    }
+    _DoAutoDec();
+    return list;
+}
+
+static void ListSet(int n) {
+    struct TList* list = (struct TList*)_IncRef(_CreateList());
+    Start();
+    for (int i = 0; i < n; ++i) _SetListInt(list, i, i);
+    Stop();
+    _DecRef(list);
+    _DoAutoDec();
+}
+
+static void ListGet(int n) {
+    struct TList* list = (struct TList*)_IncRef(_CreateList());
+    for (int i = 0; i < n; ++i) _SetListInt(list, i, i);
+    TInt total = 0;
+    Start();
+    for (int i = 0; i < n; ++i) total += _ListInt(list, i);
+    Stop();
+    if (total == -1) printf("unexpected total\n");
+    _DecRef(list);
+    _DoAutoDec();
+}
+
+static void DictSet(int n) {
+    char** keys = MakeKeys(n);
+    struct TDict* dict = (struct TDict*)_IncRef(_CreateDict());
+    const TChar* value = lstr_alloc("value");
+    Start();
+    for (int i = 0; i < n; ++i) _SetDictString(dict, keys[i], value);
+    Stop();
+    lmem_release((void*)value);
+    _DecRef(dict);
+    FreeKeys(keys, n);
+    _DoAutoDec();
+}
+
+static void DictGet(int n) {
+    char** keys = MakeKeys(n);
+    struct TDict* dict = (struct TDict*)_IncRef(_CreateDict());
+    const TChar* value = lstr_alloc("value");
+    for (int i = 0; i < n; ++i) _SetDictString(dict, keys[i], value);
+    size_t total = 0;
+    Start();
+    for (int i = 0; i < n; ++i) total += strlen(_DictString(dict, keys[i]));
+    Stop();
+    if (total == 0) printf("unexpected total\n");
+    lmem_release((void*)value);
+    _DecRef(dict);
+    FreeKeys(keys, n);
+    _DoAutoDec();
+}
+
+// Dicts of a few keys, like the ones used as records, each filled and read back
+static void DictSmall(int n) {
+    const int size = 6;
+    char** keys = MakeKeys(size);
+    TInt total = 0;
+    Start();
+    for (int i = 0; i < n; i += size) {
+        struct TDict* dict = (struct TDict*)_IncRef(_CreateDict());
+        for (int j = 0; j < size; ++j) _SetDictInt(dict, keys[j], j);
+        for (int j = 0; j < size; ++j) total += _DictInt(dict, keys[j]);
+        _DecRef(dict);
+        if (i % 600 == 0) _DoAutoDec();
+    }
+    _DoAutoDec();
+    Stop();
+    if (total == -1) printf("unexpected total\n");
+    FreeKeys(keys, size);
+}
+
+// Reads the fields of a record-style dict by constant keys, as generated code does with and without
+// the cache of each access site
+LSTR_STATIC(positionX, "position_x");
+LSTR_STATIC(positionY, "position_y");
+LSTR_STATIC(velocityX, "velocity_x");
+LSTR_STATIC(velocityY, "velocity_y");
+LSTR_STATIC(health, "health");
+LSTR_STATIC(name, "name");
+static const char* fieldNames[] = {positionX.data, positionY.data, velocityX.data, velocityY.data, health.data, name.data};
+static const int numFields = sizeof(fieldNames) / sizeof(fieldNames[0]);
+
+static struct TDict* MakeRecord() {
+    struct TDict* dict = (struct TDict*)_IncRef(_CreateDict());
+    for (int i = 0; i < numFields; ++i) _SetDictInt(dict, fieldNames[i], i);
+    return dict;
+}
+
+// Same as the hash computed for constant keys by the generator
+static unsigned int HashKey(const char* key) {
+    unsigned int hash = 2166136261u;
+    for (; *key; ++key) hash = (hash ^ (unsigned char)*key) * 16777619u;
+    return hash ^ (hash >> 15);
+}
+
+static void DictField(int n) {
+    struct TDict* dict = MakeRecord();
+    TInt total = 0;
+    Start();
+    for (int i = 0; i < n; ++i) total += _DictInt(dict, fieldNames[i % numFields]);
+    Stop();
+    if (total == -1) printf("unexpected total\n");
+    _DecRef(dict);
+    _DoAutoDec();
+}
+
+static void DictFieldSite(int n) {
+    struct TDict* dict = MakeRecord();
+    unsigned int hashes[numFields];
+    size_t sites[numFields] = {0};
+    for (int i = 0; i < numFields; ++i) hashes[i] = HashKey(fieldNames[i]);
+    TInt total = 0;
+    Start();
+    for (int i = 0; i < n; ++i) {
+        const int field = i % numFields;
+        total += _DictIntAt(dict, fieldNames[field], hashes[field], &sites[field]);
+    }
+    Stop();
+    if (total == -1) printf("unexpected total\n");
+    _DecRef(dict);
+    _DoAutoDec();
+}
+
+static void DictRemove(int n) {
+    const int size = 1000;
+    char** keys = MakeKeys(size);
+    struct TDict* dict = (struct TDict*)_IncRef(_CreateDict());
+    for (int i = 0; i < size; ++i) _SetDictInt(dict, keys[i], i);
+    Start();
+    for (int i = 0; i < n; ++i) {
+        RemoveKey(dict, keys[i % size]);
+        _SetDictInt(dict, keys[i % size], i);
+    }
+    Stop();
+    _DecRef(dict);
+    FreeKeys(keys, size);
+    _DoAutoDec();
+}
+
+static void Autorelease(int n) {
+    Start();
+    for (int i = 0; i < n; ++i) {
+        lmem_autorelease(lstr_alloc("temporary"));
+        if (i % 100 == 99) lmem_doautorelease();
+    }
+    lmem_doautorelease();
+    Stop();
+}
+
+static void ShortStrings(int n) {
+    char** strings = (char**)malloc(n * sizeof(char*));
+    Start();
+    for (int i = 0; i < n; ++i) strings[i] = lstr_alloc("short");
+    Stop();
+    for (int i = 0; i < n; ++i) lmem_release(strings[i]);
+    free(strings);
+}
+
+static void StrVal(int n) {
+    TInt total = 0;
+    Start();
+    for (int i = 0; i < n; ++i) {
+        total += Val(Str(i));
+        if (i % 100 == 99) _DoAutoDec();
+    }
+    _DoAutoDec();
+    Stop();
+    if (total == -1) printf("unexpected total\n");
+}
+
+// Separators and patterns are runtime strings, as the core functions require
+LSTR_STATIC(comma, ",");
+LSTR_STATIC(item, "item");
+LSTR_STATIC(entry, "entry");
+
+static void FindText(int n) {
+    struct TList* items = MakeItems(1000);
+    const TChar* text = (const TChar*)_IncRef((void*)Join(items, comma.data));
+    TInt total = 0;
+    Start();
+    for (int i = 0; i < n; ++i) total += Find(text, "item999", 0);
+    Stop();
+    if (total == -1) printf("unexpected total\n");
+    _DecRef((void*)text);
+    _DecRef(items);
+    _DoAutoDec();
+}
+
+static void ReplaceText(int n) {
+    struct TList* items = MakeItems(100);
+    const TChar* text = (const TChar*)_IncRef((void*)Join(items, comma.data));
+    Start();
+    for (int i = 0; i < n; ++i) {
+        Replace(text, item.data, entry.data);
+        _DoAutoDec();
+    }
+    Stop();
+    _DecRef((void*)text);
+    _DecRef(items);
+    _DoAutoDec();
+}
+
+static void SplitText(int n) {
+    struct TList* items = MakeItems(100);
+    const TChar* text = (const TChar*)_IncRef((void*)Join(items, comma.data));
+    Start();
+    for (int i = 0; i < n; ++i) {
+        Split(text, comma.data);
+        _DoAutoDec();
+    }
+    Stop();
+    _DecRef((void*)text);
+    _DecRef(items);
+    _DoAutoDec();
+}
+
+static void JoinList(int n) {
+    struct TList* items = MakeItems(100);
+    Start();
+    for (int i = 0; i < n; ++i) {
+        Join(items, comma.data);
+        _DoAutoDec();
+    }
+    Stop();
+    _DecRef(items);
+    _DoAutoDec();
+}
+
+static void PeekPoke(int n) {
+    const int count = 1024;
+    TMemory* mem = Dim(count * 4);
+    TInt total = 0;
+    Start();
+    for (int i = 0; i < n; ++i) {
+        const TInt offset = (i % count) * 4;
+        PokeInt(mem, offset, PeekInt(mem, offset) + i);
+    }
+    total = PeekInt(mem, 0);
+    Stop();
+    if (total == -1) printf("unexpected total\n");
+    Undim(mem);
+}
+
+int main(int argc, char* argv[]) {
+    const int scale = (argc > 1 && atoi(argv[1]) > 0) ? atoi(argv[1]) : 1;
+    const struct {
+        const char* name;
+        void (*run)(int);
+        int ops;
+    } cases[] = {
+        {"list_set_int", ListSet, 1000000},
+        {"list_get_int", ListGet, 1000000},
+        {"dict_set_string", DictSet, 200000},
+        {"dict_get_string", DictGet, 200000},
+        {"dict_small", DictSmall, 1200000},
+        {"dict_remove", DictRemove, 200000},
+        {"dict_field", DictField, 6000000},
+        {"dict_field_site", DictFieldSite, 6000000},
+        {"autorelease", Autorelease, 1000000},
+        {"short_strings", ShortStrings, 1000000},
+        {"str_val", StrVal, 500000},
+        {"find", FindText, 20000},
+        {"replace_100", ReplaceText, 2000},
+        {"split_100", SplitText, 2000},
+        {"join_100", JoinList, 2000},
+        {"peek_poke_int", PeekPoke, 10000000}
+    };
+
+    printf("%-16s %10s %10s %12s %12s\n", "case", "ops", "ns/op", "allocs/op", "heap B/op");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        const int ops = cases[i].ops * scale;
+        cases[i].run(ops);
+        const double ns = double(elapsed) / CLOCKS_PER_SEC * 1000000000 / ops;
+#ifdef COUNT_ALLOCS
+        printf("%-16s %10d %10.1f %12.2f %12.2f\n", cases[i].name, ops, ns, double(allocs) / ops, double(bytes) / ops);
+#else
+        printf("%-16s %10d %10.1f %12s %12s\n", cases[i].name, ops, ns, "n/a", "n/a");
+#endif
+        fflush(stdout);
+    }
+    return 0;
+}
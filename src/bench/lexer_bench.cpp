@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../token.h"
+
+using namespace std;
+
+// Representative Leaf code, repeated until the source reaches the requested size
+static const char* snippet =
+    "function Fib:Int(n:Int)\r\n"
+    "    if n < 2 then\r\n"
+    "        return n\r\n"
+    "    end\r\n"
+    "    return Fib(n - 1) + Fib(n - 2) // Recursive\r\n"
+    "end\r\n"
+    "\r\n"
+    "/* Build some\r\n   collections */\r\n"
+    "names = [\"John\", \"Laura\", \"Peter\"]\r\n"
+    "ages = {\"John\": 32, \"Laura\": 28.5}\n"
+    "for i = 0 to ListSize(names) - 1 step 1 do\n"
+    "    Print(names[i]:String + \" is \" + ages[names[i]:String]:String)\n"
+    "end\n"
+    "while counter <> 0 and not done or total >= 100.25 do\n"
+    "    counter = counter - 1; total = total * 2 mod 7\n"
+    "end\n";
+
+int main(int argc, char* argv[]) {
+    const size_t megabytes = (argc > 1) ? atoi(argv[1]) : 16;
+    const int iterations = (argc > 2) ? atoi(argv[2]) : 5;
+
+    string source;
+    source.reserve(megabytes * 1024 * 1024 + 1024);
+    while (source.length() < megabytes * 1024 * 1024) source += snippet;
+
+    size_t numTokens = 0;
+    double best = 0;
+    for (int i = 0; i < iterations; ++i) {
+        const clock_t start = clock();
+        const vector<Token> tokens = ParseTokens(source, "bench.lf");
+        const double seconds = double(clock() - start) / CLOCKS_PER_SEC;
+        numTokens = tokens.size();
+        if (i == 0 || seconds < best) best = seconds;
+    }
+
+    const double size = double(source.length()) / (1024 * 1024);
+    printf("Source: %.1f MB, %lu tokens\n", size, (unsigned long)numTokens);
+    printf("Best of %d: %.3f s, %.1f MB/s, %.1f Mtokens/s\n",
+        iterations, best, size / best, numTokens / best / 1000000);
+    return 0;
+}
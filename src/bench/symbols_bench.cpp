@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../parser.h"
+
+using namespace std;
+using namespace swan;
+
+// Generates a program with half of the symbols as globals and half as functions that use them
+static string GenerateSource(int numSymbols) {
+    string source;
+    for (int i = 0; i < numSymbols / 2; ++i) {
+        const string id = strmanip::fromint(i);
+        source += "g" + id + " = " + id + "\n";
+    }
+    for (int i = 0; i < numSymbols / 2; ++i) {
+        const string id = strmanip::fromint(i);
+        const string prev = strmanip::fromint(i > 0 ? i - 1 : 0);
+        source += "function F" + id + ":Int(a:Int)\n";
+        source += "    x = a + g" + id + "\n";
+        source += "    return x + g" + prev + "\n";
+        source += "end\n";
+    }
+    source += "r = F0(1)\n";
+    return source;
+}
+
+int main(int argc, char* argv[]) {
+    const int maxSymbols = (argc > 1) ? atoi(argv[1]) : 100000;
+    for (int numSymbols = maxSymbols / 8; numSymbols <= maxSymbols; numSymbols *= 2) {
+        const string source = GenerateSource(numSymbols);
+        const clock_t start = clock();
+        const vector<Token> tokens = ParseTokens(source, "bench.lf");
+        Parser parser(tokens);
+        parser.Parse();
+        const double seconds = double(clock() - start) / CLOCKS_PER_SEC;
+        printf("%7d symbols: %8.3f s, %6.2f us per symbol\n",
+            numSymbols, seconds, seconds * 1000000 / numSymbols);
+    }
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include "builtins.h"
+
+using namespace std;
+
+#define L(n) ((struct TList*)r[n].p)
+#define D(n) ((struct TDict*)r[n].p)
+
+// App
+static void bi_AppName(Reg* r) { r[0].s = AppName(); }
+static void bi_AppArgs(Reg* r) { r[0].p = AppArgs(); }
+static void bi_Run(Reg* r) { r[0].s = Run(r[0].s); }
+static void bi_System(Reg* r) { r[0].i = System(r[0].s); }
+
+// Console
+static void bi_Input(Reg* r) { r[0].s = Input(r[0].s); }
+static void bi_Print(Reg* r) { Print(r[0].s); }
+
+// Dir
+static void bi_DirContents(Reg* r) { r[0].p = DirContents(r[0].s); }
+static void bi_CurrentDir(Reg* r) { r[0].s = CurrentDir(); }
+static void bi_ChangeDir(Reg* r) { ChangeDir(r[0].s); }
+static void bi_FullPath(Reg* r) { r[0].s = FullPath(r[0].s); }
+
+// File
+static void bi_FileType(Reg* r) { r[0].i = FileType(r[0].s); }
+static void bi_DeleteFile(Reg* r) { DeleteFile(r[0].s); }
+
+// List
+static void bi__CreateList(Reg* r) { r[0].p = _CreateList(); }
+static void bi__SetListInt(Reg* r) { _SetListInt(L(0), r[1].i, r[2].i); }
+static void bi__SetListFloat(Reg* r) { _SetListFloat(L(0), r[1].i, r[2].f); }
+static void bi__SetListString(Reg* r) { _SetListString(L(0), r[1].i, r[2].s); }
+static void bi__SetListList(Reg* r) { _SetListList(L(0), r[1].i, L(2)); }
+static void bi__SetListDict(Reg* r) { _SetListDict(L(0), r[1].i, D(2)); }
+static void bi__SetListRaw(Reg* r) { _SetListRaw(L(0), r[1].i, r[2].p); }
+static void bi__ListInt(Reg* r) { r[0].i = _ListInt(L(0), r[1].i); }
+static void bi__ListFloat(Reg* r) { r[0].f = _ListFloat(L(0), r[1].i); }
+static void bi__ListString(Reg* r) { r[0].s = _ListString(L(0), r[1].i); }
+static void bi__ListList(Reg* r) { r[0].p = _ListList(L(0), r[1].i); }
+static void bi__ListDict(Reg* r) { r[0].p = _ListDict(L(0), r[1].i); }
+static void bi__ListRaw(Reg* r) { r[0].p = _ListRaw(L(0), r[1].i); }
+static void bi__ListToString(Reg* r) { r[0].s = _ListToString(L(0)); }
+static void bi_RemoveIndex(Reg* r) { RemoveIndex(L(0), r[1].i); }
+static void bi_ListSize(Reg* r) { r[0].i = ListSize(L(0)); }
+static void bi_ClearList(Reg* r) { ClearList(L(0)); }
+
+// Dict
+static void bi__CreateDict(Reg* r) { r[0].p = _CreateDict(); }
+static void bi__SetDictInt(Reg* r) { _SetDictInt(D(0), r[1].s, r[2].i); }
+static void bi__SetDictFloat(Reg* r) { _SetDictFloat(D(0), r[1].s, r[2].f); }
+static void bi__SetDictString(Reg* r) { _SetDictString(D(0), r[1].s, r[2].s); }
+static void bi__SetDictList(Reg* r) { _SetDictList(D(0), r[1].s, L(2)); }
+static void bi__SetDictDict(Reg* r) { _SetDictDict(D(0), r[1].s, D(2)); }
+static void bi__SetDictRaw(Reg* r) { _SetDictRaw(D(0), r[1].s, r[2].p); }
+static void bi__DictInt(Reg* r) { r[0].i = _DictInt(D(0), r[1].s); }
+static void bi__DictFloat(Reg* r) { r[0].f = _DictFloat(D(0), r[1].s); }
+static void bi__DictString(Reg* r) { r[0].s = _DictString(D(0), r[1].s); }
+static void bi__DictList(Reg* r) { r[0].p = _DictList(D(0), r[1].s); }
+static void bi__DictDict(Reg* r) { r[0].p = _DictDict(D(0), r[1].s); }
+static void bi__DictRaw(Reg* r) { r[0].p = _DictRaw(D(0), r[1].s); }
+static void bi__DictToString(Reg* r) { r[0].s = _DictToString(D(0)); }
+static void bi_Contains(Reg* r) { r[0].i = Contains(D(0), r[1].s); }
+static void bi_RemoveKey(Reg* r) { RemoveKey(D(0), r[1].s); }
+static void bi_DictSize(Reg* r) { r[0].i = DictSize(D(0)); }
+static void bi_ClearDict(Reg* r) { ClearDict(D(0)); }
+
+// Math
+static void bi_ASin(Reg* r) { r[0].f = ASin(r[0].f); }
+static void bi_ATan(Reg* r) { r[0].f = ATan(r[0].f); }
+static void bi_ATan2(Reg* r) { r[0].f = ATan2(r[0].f, r[1].f); }
+static void bi_Abs(Reg* r) { r[0].f = Abs(r[0].f); }
+static void bi_Ceil(Reg* r) { r[0].f = Ceil(r[0].f); }
+static void bi_Clamp(Reg* r) { r[0].f = Clamp(r[0].f, r[1].f, r[2].f); }
+static void bi_Cos(Reg* r) { r[0].f = Cos(r[0].f); }
+static void bi_Exp(Reg* r) { r[0].f = Exp(r[0].f); }
+static void bi_Floor(Reg* r) { r[0].f = Floor(r[0].f); }
+static void bi_Log(Reg* r) { r[0].f = Log(r[0].f); }
+static void bi_Max(Reg* r) { r[0].f = Max(r[0].f, r[1].f); }
+static void bi_Min(Reg* r) { r[0].f = Min(r[0].f, r[1].f); }
+static void bi_Pow(Reg* r) { r[0].f = Pow(r[0].f, r[1].f); }
+static void bi_Sgn(Reg* r) { r[0].f = Sgn(r[0].f); }
+static void bi_Sin(Reg* r) { r[0].f = Sin(r[0].f); }
+static void bi_Sqrt(Reg* r) { r[0].f = Sqrt(r[0].f); }
+static void bi_Tan(Reg* r) { r[0].f = Tan(r[0].f); }
+
+// Memory
+static void bi_Dim(Reg* r) { r[0].p = Dim(r[0].i); }
+static void bi_Undim(Reg* r) { Undim(r[0].p); }
+static void bi_Redim(Reg* r) { Redim(r[0].p, r[1].i); }
+static void bi_LoadDim(Reg* r) { r[0].p = LoadDim(r[0].s); }
+static void bi_SaveDim(Reg* r) { SaveDim(r[0].p, r[1].s); }
+static void bi_DimSize(Reg* r) { r[0].i = DimSize(r[0].p); }
+static void bi_PeekByte(Reg* r) { r[0].i = PeekByte(r[0].p, r[1].i); }
+static void bi_PeekShort(Reg* r) { r[0].i = PeekShort(r[0].p, r[1].i); }
+static void bi_PeekInt(Reg* r) { r[0].i = PeekInt(r[0].p, r[1].i); }
+static void bi_PeekFloat(Reg* r) { r[0].f = PeekFloat(r[0].p, r[1].i); }
+static void bi_PeekString(Reg* r) { r[0].s = PeekString(r[0].p, r[1].i); }
+static void bi_PeekRaw(Reg* r) { r[0].p = PeekRaw(r[0].p, r[1].i); }
+static void bi_PokeByte(Reg* r) { PokeByte(r[0].p, r[1].i, r[2].i); }
+static void bi_PokeShort(Reg* r) { PokeShort(r[0].p, r[1].i, r[2].i); }
+static void bi_PokeInt(Reg* r) { PokeInt(r[0].p, r[1].i, r[2].i); }
+static void bi_PokeFloat(Reg* r) { PokeFloat(r[0].p, r[1].i, r[2].f); }
+static void bi_PokeString(Reg* r) { PokeString(r[0].p, r[1].i, r[2].s); }
+static void bi_PokeRaw(Reg* r) { PokeRaw(r[0].p, r[1].i, r[2].p); }
+static void bi_CollectGarbage(Reg* r) { r[0].i = CollectGarbage(); }
+
+// String
+static void bi_Len(Reg* r) { r[0].i = Len(r[0].s); }
+static void bi_Left(Reg* r) { r[0].s = Left(r[0].s, r[1].i); }
+static void bi_Right(Reg* r) { r[0].s = Right(r[0].s, r[1].i); }
+static void bi_Mid(Reg* r) { r[0].s = Mid(r[0].s, r[1].i, r[2].i); }
+static void bi_Lower(Reg* r) { r[0].s = Lower(r[0].s); }
+static void bi_Upper(Reg* r) { r[0].s = Upper(r[0].s); }
+static void bi_Find(Reg* r) { r[0].i = Find(r[0].s, r[1].s, r[2].i); }
+static void bi_Replace(Reg* r) { r[0].s = Replace(r[0].s, r[1].s, r[2].s); }
+static void bi_Trim(Reg* r) { r[0].s = Trim(r[0].s); }
+static void bi_Join(Reg* r) { r[0].s = Join(L(0), r[1].s); }
+static void bi_Split(Reg* r) { r[0].p = Split(r[0].s, r[1].s); }
+static void bi_StripExt(Reg* r) { r[0].s = StripExt(r[0].s); }
+static void bi_StripDir(Reg* r) { r[0].s = StripDir(r[0].s); }
+static void bi_ExtractExt(Reg* r) { r[0].s = ExtractExt(r[0].s); }
+static void bi_ExtractDir(Reg* r) { r[0].s = ExtractDir(r[0].s); }
+static void bi_Asc(Reg* r) { r[0].i = Asc(r[0].s, r[1].i); }
+static void bi_Chr(Reg* r) { r[0].s = Chr(r[0].i); }
+static void bi_Str(Reg* r) { r[0].s = Str(r[0].i); }
+static void bi_StrF(Reg* r) { r[0].s = StrF(r[0].f); }
+static void bi_Val(Reg* r) { r[0].i = Val(r[0].s); }
+static void bi_ValF(Reg* r) { r[0].f = ValF(r[0].s); }
+static void bi_LoadString(Reg* r) { r[0].s = LoadString(r[0].s); }
+static void bi_SaveString(Reg* r) { SaveString(r[0].s, r[1].s, r[2].i); }
+
+#undef L
+#undef D
+
+struct Builtin {
+    const char* name;
+    BuiltinFunc func;
+};
+
+#define BUILTIN(name) {#name, bi_##name}
+
+static const Builtin builtins[] = {
+    BUILTIN(AppName), BUILTIN(AppArgs), BUILTIN(Run), BUILTIN(System),
+    BUILTIN(Input), BUILTIN(Print),
+    BUILTIN(DirContents), BUILTIN(CurrentDir), BUILTIN(ChangeDir), BUILTIN(FullPath),
+    BUILTIN(FileType), BUILTIN(DeleteFile),
+    BUILTIN(_CreateList), BUILTIN(_SetListInt), BUILTIN(_SetListFloat), BUILTIN(_SetListString),
+    BUILTIN(_SetListList), BUILTIN(_SetListDict), BUILTIN(_SetListRaw), BUILTIN(_ListInt),
+    BUILTIN(_ListFloat), BUILTIN(_ListString), BUILTIN(_ListList), BUILTIN(_ListDict),
+    BUILTIN(_ListRaw), BUILTIN(_ListToString), BUILTIN(RemoveIndex), BUILTIN(ListSize),
+    BUILTIN(ClearList),
+    BUILTIN(_CreateDict), BUILTIN(_SetDictInt), BUILTIN(_SetDictFloat), BUILTIN(_SetDictString),
+    BUILTIN(_SetDictList), BUILTIN(_SetDictDict), BUILTIN(_SetDictRaw), BUILTIN(_DictInt),
+    BUILTIN(_DictFloat), BUILTIN(_DictString), BUILTIN(_DictList), BUILTIN(_DictDict),
+    BUILTIN(_DictRaw), BUILTIN(_DictToString), BUILTIN(Contains), BUILTIN(RemoveKey),
+    BUILTIN(DictSize), BUILTIN(ClearDict),
+    BUILTIN(ASin), BUILTIN(ATan), BUILTIN(ATan2), BUILTIN(Abs), BUILTIN(Ceil), BUILTIN(Clamp),
+    BUILTIN(Cos), BUILTIN(Exp), BUILTIN(Floor), BUILTIN(Log), BUILTIN(Max), BUILTIN(Min),
+    BUILTIN(Pow), BUILTIN(Sgn), BUILTIN(Sin), BUILTIN(Sqrt), BUILTIN(Tan),
+    BUILTIN(Dim), BUILTIN(Undim), BUILTIN(Redim), BUILTIN(LoadDim), BUILTIN(SaveDim),
+    BUILTIN(DimSize), BUILTIN(PeekByte), BUILTIN(PeekShort), BUILTIN(PeekInt),
+    BUILTIN(PeekFloat), BUILTIN(PeekString), BUILTIN(PeekRaw), BUILTIN(PokeByte),
+    BUILTIN(PokeShort), BUILTIN(PokeInt), BUILTIN(PokeFloat), BUILTIN(PokeString),
+    BUILTIN(PokeRaw), BUILTIN(CollectGarbage),
+    BUILTIN(Len), BUILTIN(Left), BUILTIN(Right), BUILTIN(Mid), BUILTIN(Lower), BUILTIN(Upper),
+    BUILTIN(Find), BUILTIN(Replace), BUILTIN(Trim), BUILTIN(Join), BUILTIN(Split),
+    BUILTIN(StripExt), BUILTIN(StripDir), BUILTIN(ExtractExt), BUILTIN(ExtractDir),
+    BUILTIN(Asc), BUILTIN(Chr), BUILTIN(Str), BUILTIN(StrF), BUILTIN(Val), BUILTIN(ValF),
+    BUILTIN(LoadString), BUILTIN(SaveString)
+};
+
+#undef BUILTIN
+
+int FindBuiltin(const string& name) {
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(Builtin); ++i) {
+        if (name == builtins[i].name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+BuiltinFunc GetBuiltin(int index) {
+    return builtins[index].func;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "bytecode.h"
+
+// Builtins take their arguments from consecutive registers, and write the result to the first one
+typedef void (*BuiltinFunc)(Reg* r);
+
+int FindBuiltin(const std::string& name);
+BuiltinFunc GetBuiltin(int index);
@@ -0,0 +1,531 @@
+#include <stdlib.h>
+#include <string.h>
+#include "builtins.h"
+#include "bytecode.h"
+#include "error.h"
+#include "token.h"
+#include "../_build/libs/core/litemem.h"
+
+using namespace std;
+
+BytecodeGen::BytecodeGen(const Lib& lib)
+        : lib(lib), program(NULL), out(NULL), func(NULL), def(NULL), top(0) {
+}
+
+void BytecodeGen::GenProgram(const IrProgram& program, BcProgram& out) {
+    this->program = &program;
+    this->out = &out;
+    for (size_t i = 0; i < program.globals.size(); ++i) {
+        out.globalTypes.push_back(program.globals[i].type);
+    }
+
+    // Functions are indexed by declaration order, which is also the order of definition
+    out.functions.resize(program.definitions.size());
+    for (size_t i = 0; i < program.definitions.size(); ++i) {
+        GenFunction(program.definitions[i], out.functions[i]);
+    }
+
+    def = NULL;
+    func = &out.main;
+    func->name = "main";
+    top = 0;
+    GenBlock(program.main);
+    Emit(OP_END, 0);
+}
+
+void BytecodeGen::GenFunction(const IrFunction& def, BcFunction& func) {
+    this->def = &def;
+    this->func = &func;
+    func.name = def.func.name;
+    func.numParams = def.func.params.size();
+    func.returnType = def.func.type;
+    for (size_t i = 0; i < def.locals.size(); ++i) {
+        if (IsManaged(def.locals[i].type)) {
+            func.managedLocals.push_back(i);
+            if (i < def.func.params.size()) func.managedParams.push_back(i);
+        }
+    }
+    top = def.locals.size();
+    func.numRegs = (top > 0) ? top : 1;
+    GenBlock(def.block);
+    Emit(OP_RETV, 0);
+}
+
+void BytecodeGen::GenBlock(const IrNode* block) {
+    for (size_t i = 0; i < block->children.size(); ++i) {
+        GenStatement(block->children[i]);
+    }
+}
+
+void BytecodeGen::GenStatement(const IrNode* node) {
+    const int prevTop = top;
+    switch (node->kind) {
+    case IR_EXPSTMT: {
+        const IrNode* exp = node->children[0];
+        const int reg = AllocReg();
+        GenExp(exp, reg);
+        break;
+    }
+    case IR_VARDEF:
+    case IR_ASSIGN:
+        GenStore(node, VarReg(node));
+        break;
+    case IR_LISTSET:
+        GenSetter(node, "_SetList");
+        break;
+    case IR_DICTSET:
+        GenSetter(node, "_SetDict");
+        break;
+    case IR_IF:
+        GenIf(node);
+        break;
+    case IR_FOR:
+        GenFor(node);
+        break;
+    case IR_WHILE:
+        GenWhile(node);
+        break;
+    case IR_RETURN:
+        GenReturn(node);
+        break;
+    }
+    top = prevTop;
+}
+
+void BytecodeGen::GenIf(const IrNode* node) {
+    vector<int> exits;
+    int jump = EmitWide(OP_JMPF, GenCondition(node->children[0]), 0);
+    GenBlock(node->children[1]);
+    for (size_t i = 2; i < node->children.size(); ++i) {
+        const IrNode* child = node->children[i];
+        exits.push_back(EmitWide(OP_JMP, 0, 0));
+        PatchJump(jump, Label());
+        jump = -1;
+        if (child->kind == IR_ELSEIF) {
+            jump = EmitWide(OP_JMPF, GenCondition(child->children[0]), 0);
+            GenBlock(child->children[1]);
+        } else {
+            GenBlock(child->children[0]);
+        }
+    }
+    if (jump != -1) PatchJump(jump, Label());
+    for (size_t i = 0; i < exits.size(); ++i) {
+        PatchJump(exits[i], Label());
+    }
+}
+
+void BytecodeGen::GenFor(const IrNode* node) {
+    const IrNode* assignment = node->children[0];
+    const int type = assignment->type;
+    const int prevTop = top;
+    GenStatement(assignment);
+
+    // The control variable is copied into a register, and stored back before each iteration
+    const int var = assignment->global ? AllocReg() : VarReg(assignment);
+    if (assignment->global) EmitWide(OP_GETG, var, assignment->index);
+    const int start = Label();
+    const int to = GenOperand(node->children[1], type);
+    const int cond = AllocReg();
+    Emit((type == TYPE_FLOAT) ? OP_LEF : OP_LEI, cond, var, to);
+    const int exit = EmitWide(OP_JMPF, cond, 0);
+    top = cond + 1;
+    GenBlock(node->children[3]);
+    if (assignment->global) EmitWide(OP_GETG, var, assignment->index);
+    const int step = GenOperand(node->children[2], type);
+    Emit((type == TYPE_FLOAT) ? OP_ADDF : OP_ADDI, var, var, step);
+    if (assignment->global) EmitWide(OP_SETG, var, assignment->index);
+    EmitWide(MakesTemporaries(node) ? OP_LOOP : OP_JMP, 0, start);
+    PatchJump(exit, Label());
+    top = prevTop;
+}
+
+void BytecodeGen::GenWhile(const IrNode* node) {
+    const int start = Label();
+    const int exit = EmitWide(OP_JMPF, GenCondition(node->children[0]), 0);
+    GenBlock(node->children[1]);
+    EmitWide(MakesTemporaries(node) ? OP_LOOP : OP_JMP, 0, start);
+    PatchJump(exit, Label());
+}
+
+void BytecodeGen::GenReturn(const IrNode* node) {
+    if (node->children.size() > 0) {
+        Emit(OP_RET, GenOperand(node->children[0], def->func.type));
+    } else {
+        Emit(OP_RETV, 0);
+    }
+}
+
+void BytecodeGen::GenStore(const IrNode* node, int reg) {
+    const IrNode* exp = node->children[0];
+    const bool managed = IsManaged(node->type);
+    if (node->global) {
+        const int value = GenOperand(exp, node->type);
+        EmitWide(managed ? OP_SETGM : OP_SETG, value, node->index);
+    } else if (!managed && exp->kind == IR_BINARY && exp->op != TOK_AND && exp->op != TOK_OR
+            && exp->type == node->type) {
+        // Arithmetic reads all of its operands before writing, so it can target the variable
+        GenExp(exp, reg);
+    } else {
+        const int value = GenOperand(exp, node->type);
+        if (value != reg) Emit(managed ? OP_MOVEM : OP_MOVE, reg, value);
+    }
+}
+
+void BytecodeGen::GenSetter(const IrNode* node, const string& prefix) {
+    const int base = AllocReg();
+    AllocReg();
+    AllocReg();
+    GenExp(node->children[0], base);
+    GenExp(node->children[1], base + 1);
+    GenExp(node->children[2], base + 2);
+    GenBuiltin(prefix + TypeSuffix(node->children[2]->type), base, base);
+}
+
+int BytecodeGen::GenOperand(const IrNode* node, int type) {
+    if (node->kind == IR_VAR && !node->global && node->type == type) {
+        return VarReg(node);
+    } else {
+        const int reg = AllocReg();
+        GenExp(node, reg);
+        GenConvert(reg, node->type, type);
+        return reg;
+    }
+}
+
+void BytecodeGen::GenExp(const IrNode* node, int dst) {
+    const int prevTop = top;
+    switch (node->kind) {
+    case IR_LITERAL: {
+        Reg value;
+        value.i = 0;
+        if (node->op == TOK_INTLITERAL) {
+            value.i = (TInt)strtoll(node->data.c_str(), NULL, 10);
+        } else if (node->op == TOK_FLOATLITERAL) {
+            value.f = (TFloat)strtod(node->data.c_str(), NULL);
+        } else if (node->op == TOK_TRUELITERAL) {
+            value.i = 1;
+        } else if (node->op == TOK_STRINGLITERAL) {
+            EmitWide(OP_LOADK, dst, GenStringConstant(node->data));
+            break;
+        }
+        EmitWide(OP_LOADK, dst, GenConstant(value));
+        break;
+    }
+    case IR_VAR:
+        if (node->global) {
+            EmitWide(OP_GETG, dst, node->index);
+        } else if (VarReg(node) != dst) {
+            Emit(OP_MOVE, dst, VarReg(node));
+        }
+        break;
+    case IR_CALL:
+    case IR_LIBCALL:
+        GenCall(node, dst);
+        break;
+    case IR_BINARY:
+        if (node->op == TOK_AND || node->op == TOK_OR) {
+            GenLogicalExp(node, dst);
+        } else {
+            GenBinaryExp(node, dst);
+        }
+        break;
+    case IR_NOT:
+        Emit(OP_NOT, dst, GenCondition(node->children[0]));
+        break;
+    case IR_NEG:
+        Emit((node->type == TYPE_FLOAT) ? OP_NEGF : OP_NEGI, dst, GenOperand(node->children[0], node->type));
+        break;
+    case IR_GROUP:
+        GenExp(node->children[0], dst);
+        break;
+    case IR_CAST:
+        GenCastExp(node, dst);
+        break;
+    case IR_LIST:
+    case IR_DICT:
+        GenContainer(node, dst);
+        break;
+    case IR_LISTGET:
+        GenGetter(node, dst, "_List");
+        break;
+    case IR_DICTGET:
+        GenGetter(node, dst, "_Dict");
+        break;
+    }
+    top = prevTop;
+}
+
+void BytecodeGen::GenBinaryExp(const IrNode* node, int dst) {
+    const int left = GenOperand(node->children[0], node->argType);
+    const int right = GenOperand(node->children[1], node->argType);
+    Emit(BinaryOpcode(node->op, node->argType), dst, left, right);
+}
+
+void BytecodeGen::GenLogicalExp(const IrNode* node, int dst) {
+    // Like the generated C, the result is the value of the operand that decided the expression
+    GenExp(node->children[0], dst);
+    GenConvert(dst, node->children[0]->type, node->type);
+    const int cond = AllocReg();
+    switch (node->type) {
+    case TYPE_INT:
+        Emit(OP_MOVE, cond, dst);
+        break;
+    case TYPE_FLOAT:
+        Emit(OP_BOOLF, cond, dst);
+        break;
+    case TYPE_STRING:
+        Emit(OP_BOOLS, cond, dst);
+        break;
+    default:
+        Emit(OP_BOOLP, cond, dst);
+    }
+    const int jump = EmitWide((node->op == TOK_AND) ? OP_JMPF : OP_JMPT, cond, 0);
+    GenExp(node->children[1], dst);
+    GenConvert(dst, node->children[1]->type, node->type);
+    PatchJump(jump, Label());
+}
+
+void BytecodeGen::GenCastExp(const IrNode* node, int dst) {
+    const IrNode* exp = node->children[0];
+    GenExp(exp, dst);
+    if (node->type == TYPE_STRING) {
+        switch (exp->type) {
+        case TYPE_INT:
+            GenBuiltin("Str", dst, dst);
+            break;
+        case TYPE_FLOAT:
+            GenBuiltin("StrF", dst, dst);
+            break;
+        case TYPE_LIST:
+            GenBuiltin("_ListToString", dst, dst);
+            break;
+        case TYPE_DICT:
+            GenBuiltin("_DictToString", dst, dst);
+            break;
+        }
+    } else if (exp->type == TYPE_STRING) {
+        GenBuiltin((node->type == TYPE_FLOAT) ? "ValF" : "Val", dst, dst);
+    } else {
+        GenConvert(dst, exp->type, node->type);
+    }
+}
+
+void BytecodeGen::GenCall(const IrNode* node, int dst) {
+    const vector<Var>& params = (node->kind == IR_CALL)
+        ? program->functions[node->index].params
+        : lib[node->index].params;
+    const int base = AllocReg();
+    for (size_t i = 1; i < node->children.size(); ++i) {
+        AllocReg();
+    }
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        GenExp(node->children[i], base + i);
+        GenConvert(base + i, node->children[i]->type, params[i].type);
+    }
+    if (node->kind == IR_CALL) {
+        EmitWide(OP_CALL, base, node->index);
+    } else {
+        GenBuiltin(node->data, base, base);
+    }
+    if (dst != base) Emit(OP_MOVE, dst, base);
+}
+
+void BytecodeGen::GenContainer(const IrNode* node, int dst) {
+    const bool isList = node->kind == IR_LIST;
+    const int base = AllocReg();
+    AllocReg();
+    AllocReg();
+    GenBuiltin(isList ? "_CreateList" : "_CreateDict", base, base);
+    for (size_t i = 0; i < node->children.size(); i += isList ? 1 : 2) {
+        Reg index;
+        index.i = i;
+        const IrNode* value = node->children[isList ? i : (i + 1)];
+        if (isList) {
+            EmitWide(OP_LOADK, base + 1, GenConstant(index));
+        } else {
+            GenExp(node->children[i], base + 1);
+        }
+        GenExp(value, base + 2);
+        GenBuiltin((isList ? "_SetList" : "_SetDict") + TypeSuffix(value->type), base, base);
+    }
+    if (dst != base) Emit(OP_MOVE, dst, base);
+}
+
+void BytecodeGen::GenGetter(const IrNode* node, int dst, const string& prefix) {
+    const int base = AllocReg();
+    AllocReg();
+    GenExp(node->children[0], base);
+    GenExp(node->children[1], base + 1);
+    GenBuiltin(prefix + TypeSuffix(node->type), base, dst);
+}
+
+void BytecodeGen::GenConvert(int reg, int fromType, int toType) {
+    if (fromType == TYPE_INT && toType == TYPE_FLOAT) {
+        Emit(OP_ITOF, reg, reg);
+    } else if (fromType == TYPE_FLOAT && toType == TYPE_INT) {
+        Emit(OP_FTOI, reg, reg);
+    }
+}
+
+int BytecodeGen::GenCondition(const IrNode* node) {
+    if (node->type == TYPE_INT) return GenOperand(node, TYPE_INT);
+    const int reg = GenOperand(node, node->type);
+    const int cond = AllocReg();
+    switch (node->type) {
+    case TYPE_FLOAT:
+        Emit(OP_BOOLF, cond, reg);
+        break;
+    case TYPE_STRING:
+        Emit(OP_BOOLS, cond, reg);
+        break;
+    default:
+        Emit(OP_BOOLP, cond, reg);
+    }
+    return cond;
+}
+
+void BytecodeGen::GenBuiltin(const string& name, int base, int dst) {
+    const int index = FindBuiltin(name);
+    if (index == -1) Error("Function not available in the interpreter: " + name);
+    EmitWide(OP_CALLB, base, index);
+    if (dst != base) Emit(OP_MOVE, dst, base);
+}
+
+int BytecodeGen::GenConstant(const Reg& value) {
+    out->constants.push_back(value);
+    return out->constants.size() - 1;
+}
+
+static int HexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Resolves the escape sequences of a literal the same way the C compiler does for generated code
+static string Unescape(const string& str) {
+    string result;
+    for (size_t i = 0; i < str.size(); ++i) {
+        if (str[i] != '\\' || i + 1 == str.size()) {
+            result += str[i];
+            continue;
+        }
+        const char c = str[++i];
+        if (c == 'x') {
+            unsigned int value = 0;
+            while (i + 1 < str.size() && HexDigit(str[i + 1]) != -1) value = value * 16 + HexDigit(str[++i]);
+            result += (char)value;
+        } else if (c >= '0' && c <= '7') {
+            unsigned int value = c - '0';
+            for (int n = 1; n < 3 && i + 1 < str.size() && str[i + 1] >= '0' && str[i + 1] <= '7'; ++n) {
+                value = value * 8 + (str[++i] - '0');
+            }
+            result += (char)value;
+        } else {
+            // Other characters, like quotes and backslashes, stand for themselves
+            static const char names[] = "abfnrtv";
+            static const char chars[] = "\a\b\f\n\r\t\v";
+            const char* name = c ? strchr(names, c) : NULL;
+            result += name ? chars[name - names] : c;
+        }
+    }
+    return result;
+}
+
+int BytecodeGen::GenStringConstant(const string& str) {
+    // String constants live for the whole run, so they never go through the autorelease pool
+    const string unescaped = Unescape(str);
+    Reg value;
+    value.s = lstr_allocn(unescaped.c_str(), unescaped.size());
+    return GenConstant(value);
+}
+
+int BytecodeGen::Emit(int op, int a, int b, int c) {
+    Instr instr;
+    instr.op = op;
+    instr.a = a;
+    instr.b = b;
+    instr.c = c;
+    func->code.push_back(instr);
+    return func->code.size() - 1;
+}
+
+int BytecodeGen::EmitWide(int op, int a, int wide) {
+    return Emit(op, a, wide & 0xffff, (wide >> 16) & 0xffff);
+}
+
+void BytecodeGen::PatchJump(int instr, int target) {
+    func->code[instr].b = target & 0xffff;
+    func->code[instr].c = (target >> 16) & 0xffff;
+}
+
+int BytecodeGen::Label() const {
+    return func->code.size();
+}
+
+int BytecodeGen::AllocReg() {
+    if (top >= 0xffff) Error("Too many registers needed in function " + func->name);
+    ++top;
+    if (top > func->numRegs) func->numRegs = top;
+    return top - 1;
+}
+
+int BytecodeGen::VarReg(const IrNode* node) const {
+    return node->index;
+}
+
+int BinaryOpcode(int tokenType, int argType) {
+    const bool isFloat = argType == TYPE_FLOAT;
+    switch (tokenType) {
+    case TOK_PLUS:
+        return (argType == TYPE_STRING) ? OP_CONCAT : isFloat ? OP_ADDF : OP_ADDI;
+    case TOK_MINUS:
+        return isFloat ? OP_SUBF : OP_SUBI;
+    case TOK_MUL:
+        return isFloat ? OP_MULF : OP_MULI;
+    case TOK_DIV:
+        return isFloat ? OP_DIVF : OP_DIVI;
+    case TOK_MOD:
+        return isFloat ? OP_MODF : OP_MODI;
+    }
+    const int base =
+        (argType == TYPE_INT) ? OP_EQI :
+        (argType == TYPE_FLOAT) ? OP_EQF :
+        (argType == TYPE_STRING) ? OP_EQS :
+        OP_EQP;
+    if (base == OP_EQP && tokenType != TOK_EQUAL && tokenType != TOK_NOTEQUAL) {
+        return OP_NEP; // Should not get here, the parser only allows equality on references
+    }
+    switch (tokenType) {
+    case TOK_EQUAL:
+        return base;
+    case TOK_NOTEQUAL:
+        return base + 1;
+    case TOK_LESSER:
+        return base + 2;
+    case TOK_LEQUAL:
+        return base + 3;
+    case TOK_GREATER:
+        return base + 4;
+    default:
+        return base + 5;
+    }
+}
+
+string TypeSuffix(int type) {
+    switch (type) {
+    case TYPE_INT:
+        return "Int";
+    case TYPE_FLOAT:
+        return "Float";
+    case TYPE_STRING:
+        return "String";
+    case TYPE_LIST:
+        return "List";
+    case TYPE_DICT:
+        return "Dict";
+    default:
+        return "Raw";
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "common.h"
+#include "ir.h"
+
+// Operands a, b and c are registers of the current frame, unless noted otherwise.
+// Wide operands (jump targets, constants, globals and functions) are stored in b and c.
+#define BC_OPCODES(X) \
+    X(OP_LOADK)     /* a = constants[wide] */ \
+    X(OP_MOVE)      /* a = b */ \
+    X(OP_MOVEM)     /* a = b, retaining b and releasing the previous value of a */ \
+    X(OP_GETG)      /* a = globals[wide] */ \
+    X(OP_SETG)      /* globals[wide] = a */ \
+    X(OP_SETGM)     /* globals[wide] = a, retaining a and releasing the previous value */ \
+    X(OP_ADDI) X(OP_SUBI) X(OP_MULI) X(OP_DIVI) X(OP_MODI) \
+    X(OP_ADDF) X(OP_SUBF) X(OP_MULF) X(OP_DIVF) X(OP_MODF) \
+    X(OP_NEGI) X(OP_NEGF) \
+    X(OP_EQI) X(OP_NEI) X(OP_LTI) X(OP_LEI) X(OP_GTI) X(OP_GEI) \
+    X(OP_EQF) X(OP_NEF) X(OP_LTF) X(OP_LEF) X(OP_GTF) X(OP_GEF) \
+    X(OP_EQS) X(OP_NES) X(OP_LTS) X(OP_LES) X(OP_GTS) X(OP_GES) \
+    X(OP_EQP) X(OP_NEP) \
+    X(OP_CONCAT)    /* a = b + c, on strings */ \
+    X(OP_ITOF) X(OP_FTOI) \
+    X(OP_BOOLF) X(OP_BOOLS) X(OP_BOOLP)   /* a = truth value of b */ \
+    X(OP_NOT)       /* a = !b, on an int truth value */ \
+    X(OP_JMP)       /* ip = wide */ \
+    X(OP_JMPF)      /* if (!a) ip = wide */ \
+    X(OP_JMPT)      /* if (a) ip = wide */ \
+    X(OP_LOOP)      /* ip = wide, trimming the temporaries of the finished iteration */ \
+    X(OP_CALL)      /* a = functions[wide](a, a+1, ...) */ \
+    X(OP_CALLB)     /* a = builtins[wide](a, a+1, ...) */ \
+    X(OP_RET)       /* return a */ \
+    X(OP_RETV)      /* return without value */ \
+    X(OP_END)       /* end of the main program */
+
+#define BC_ENUM(op) op,
+enum Opcode {
+    BC_OPCODES(BC_ENUM)
+    NUM_OPCODES
+};
+#undef BC_ENUM
+
+union Reg {
+    TInt i;
+    TFloat f;
+    const TChar* s;
+    void* p;
+};
+
+struct Instr {
+    unsigned short op;
+    unsigned short a;
+    unsigned short b;
+    unsigned short c;
+
+    int Wide() const {
+        return (int)b | ((int)c << 16);
+    }
+};
+
+struct BcFunction {
+    std::string name;
+    int numParams;
+    int numRegs;
+    int returnType;
+    std::vector<int> managedLocals;   // Registers released when the function returns
+    std::vector<int> managedParams;   // Parameters retained while the function runs
+    std::vector<Instr> code;
+
+    BcFunction() : numParams(0), numRegs(1), returnType(TYPE_VOID) {
+    }
+};
+
+struct BcProgram {
+    std::vector<BcFunction> functions;
+    BcFunction main;
+    std::vector<Reg> constants;
+    std::vector<int> globalTypes;
+};
+
+class BytecodeGen {
+public:
+    BytecodeGen(const Lib& lib);
+    void GenProgram(const IrProgram& program, BcProgram& out);
+private:
+    const Lib& lib;
+    const IrProgram* program;
+    BcProgram* out;
+    BcFunction* func;
+    const IrFunction* def;
+    int top;
+
+    void GenFunction(const IrFunction& def, BcFunction& func);
+    void GenBlock(const IrNode* block);
+    void GenStatement(const IrNode* node);
+    void GenIf(const IrNode* node);
+    void GenFor(const IrNode* node);
+    void GenWhile(const IrNode* node);
+    void GenReturn(const IrNode* node);
+    void GenStore(const IrNode* node, int reg);
+    void GenSetter(const IrNode* node, const std::string& prefix);
+    int GenOperand(const IrNode* node, int type);
+    void GenExp(const IrNode* node, int dst);
+    void GenBinaryExp(const IrNode* node, int dst);
+    void GenLogicalExp(const IrNode* node, int dst);
+    void GenCastExp(const IrNode* node, int dst);
+    void GenCall(const IrNode* node, int dst);
+    void GenContainer(const IrNode* node, int dst);
+    void GenGetter(const IrNode* node, int dst, const std::string& prefix);
+    void GenConvert(int reg, int fromType, int toType);
+    int GenCondition(const IrNode* node);
+    void GenBuiltin(const std::string& name, int base, int dst);
+    int GenConstant(const Reg& value);
+    int GenStringConstant(const std::string& str);
+    int Emit(int op, int a, int b = 0, int c = 0);
+    int EmitWide(int op, int a, int wide);
+    void PatchJump(int instr, int target);
+    int Label() const;
+    int AllocReg();
+    int VarReg(const IrNode* node) const;
+};
+
+int BinaryOpcode(int tokenType, int argType);
+std::string TypeSuffix(int type);
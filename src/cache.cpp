@@ -0,0 +1,147 @@
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+#include <sys/stat.h>
+#include <algorithm>
+#include "cache.h"
+#include "swan/dir.hh"
+#include "swan/platform.hh"
+
+using namespace std;
+using namespace swan;
+
+static const unsigned long long FNV_OFFSET = 14695981039346656037ULL;
+static const unsigned long long FNV_PRIME = 1099511628211ULL;
+static const unsigned long long DEFAULT_CACHE_MB = 256;
+
+struct CacheEntry {
+    time_t mtime;
+    unsigned long long size;
+    string filename;
+
+    bool operator<(const CacheEntry& other) const {
+        return mtime < other.mtime;
+    }
+};
+
+static unsigned long long HashBytes(unsigned long long hash, const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= (unsigned char)data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+string HashContents(const vector<string>& contents) {
+    unsigned long long hash = FNV_OFFSET;
+    for (size_t i = 0; i < contents.size(); ++i) {
+        // Mix in the length so that moving bytes between parts changes the hash
+        const unsigned long long len = contents[i].length();
+        hash = HashBytes(hash, (const char*)&len, sizeof(len));
+        hash = HashBytes(hash, contents[i].c_str(), contents[i].length());
+    }
+    char str[17];
+    sprintf(str, "%016llx", hash);
+    return str;
+}
+
+string GetFileStamp(const string& filename) {
+    struct stat fileStat;
+    if (stat(filename.c_str(), &fileStat) != 0) return filename;
+    char str[64];
+    sprintf(str, ":%llu:%lld", (unsigned long long)fileStat.st_size, (long long)fileStat.st_mtime);
+    return filename + str;
+}
+
+string GetCacheDir(const string& rootDir) {
+    const string leafCache = platform::getenv("LEAF_CACHE_DIR");
+    if (leafCache != "") return leafCache;
+#ifdef _WIN32
+    const string localAppData = platform::getenv("LOCALAPPDATA");
+    if (localAppData != "") return localAppData + "/leaf/cache";
+#else
+    const string xdgCache = platform::getenv("XDG_CACHE_HOME");
+    if (xdgCache != "") return xdgCache + "/leaf";
+    const string home = platform::getenv("HOME");
+    if (home != "") return home + "/.cache/leaf";
+#endif
+    return rootDir + "/cache";
+}
+
+bool CreateDirs(const string& path) {
+    for (size_t pos = path.find("/", 1); pos != string::npos; pos = path.find("/", pos + 1)) {
+        const string parent = path.substr(0, pos);
+        if (!FileExists(parent)) dir::create(parent);
+    }
+    if (!FileExists(path)) dir::create(path);
+    return FileExists(path);
+}
+
+bool FileExists(const string& filename) {
+    return FileType(filename.c_str()) != 0;
+}
+
+bool IsOutdated(const string& filename, const vector<string>& dependencies) {
+    struct stat fileStat;
+    if (stat(filename.c_str(), &fileStat) != 0) return true;
+    for (size_t i = 0; i < dependencies.size(); ++i) {
+        struct stat depStat;
+        if (stat(dependencies[i].c_str(), &depStat) == 0 && depStat.st_mtime > fileStat.st_mtime) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TouchFile(const string& filename) {
+    utime(filename.c_str(), NULL);
+}
+
+unsigned long long GetCacheLimit() {
+    const string limit = platform::getenv("LEAF_CACHE_MB");
+    const long long mb = (limit != "") ? atoll(limit.c_str()) : 0;
+    return ((mb > 0) ? (unsigned long long)mb : DEFAULT_CACHE_MB) * 1024 * 1024;
+}
+
+// Cached files are named after their key, which is 16 hex digits, so nothing else is ever removed
+static bool IsCacheEntry(const string& name) {
+    if (name.length() < 16 || (name.length() > 16 && name[16] != '.')) return false;
+    if (name.length() >= 4 && name.compare(name.length() - 4, 4, ".tmp") == 0) return false;
+    return name.find_first_not_of("0123456789abcdef") >= 16;
+}
+
+static void FindCacheEntries(const string& dir, vector<CacheEntry>& entries) {
+    const vector<string> names = dir::contents(dir);
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (names[i] == "." || names[i] == "..") continue;
+        const string filename = dir + "/" + names[i];
+        struct stat fileStat;
+        if (stat(filename.c_str(), &fileStat) != 0) continue;
+        if (S_ISDIR(fileStat.st_mode)) {
+            FindCacheEntries(filename, entries);
+        } else if (IsCacheEntry(names[i])) {
+            CacheEntry entry;
+            entry.mtime = fileStat.st_mtime;
+            entry.size = fileStat.st_size;
+            entry.filename = filename;
+            entries.push_back(entry);
+        }
+    }
+}
+
+void PruneCache(const string& dir, unsigned long long maxBytes) {
+    vector<CacheEntry> entries;
+    FindCacheEntries(dir, entries);
+    unsigned long long total = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        total += entries[i].size;
+    }
+
+    // Entries are touched when they are used, so the oldest ones are the least recently used
+    sort(entries.begin(), entries.end());
+    for (size_t i = 0; i < entries.size() && total > maxBytes; ++i) {
+        if (remove(entries[i].filename.c_str()) == 0) total -= entries[i].size;
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "common.h"
+
+std::string HashContents(const std::vector<std::string>& contents);
+std::string GetFileStamp(const std::string& filename);  // Path, size and modification time, without reading it
+std::string GetCacheDir(const std::string& rootDir);
+bool CreateDirs(const std::string& path);
+bool FileExists(const std::string& filename);
+bool IsOutdated(const std::string& filename, const std::vector<std::string>& dependencies);
+void TouchFile(const std::string& filename);
+unsigned long long GetCacheLimit();
+void PruneCache(const std::string& dir, unsigned long long maxBytes);  // Removes the least recently used entries
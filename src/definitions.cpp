@@ -3,29 +3,35 @@
 using namespace std;
 using namespace swan;
 
+Definitions::Definitions() : locals(&globals) {
+}
+
 void Definitions::AddFunction(const Function& func) {
-    functions.push_back(func);
+    functions.Add(func);
 }
 
 void Definitions::AddGlobal(const Var& global) {
-    globals.push_back(global);
+    globals.Add(global);
 }
 
 void Definitions::AddLocal(const Var& local) {
-    locals.push_back(local);
+    locals.Add(local);
+}
+
+void Definitions::AddRecord(const Record& record) {
+    records.Add(record);
 }
 
 void Definitions::ClearLocals() {
-    locals.clear();
+    locals.Clear();
 }
 
 const Function* Definitions::FindFunction(const string& name) const {
-    for (size_t i = 0; i < functions.size(); ++i) {
-        if (functions[i].name == name) {
-            return &functions[i];
-        }
-    }
-    return NULL;
+    return functions.Lookup(name);
+}
+
+int Definitions::FindFunctionIndex(const string& name) const {
+    return functions.Find(name);
 }
 
 size_t Definitions::NumFunctions() const {
@@ -40,39 +46,48 @@ const Function* Definitions::GetFunction(size_t index) const {
     }
 }
 
+const Record* Definitions::FindRecord(const string& name) const {
+    return records.Lookup(name);
+}
+
+// Returns the type of the record, or TYPE_VOID
+int Definitions::FindRecordType(const string& name) const {
+    const int index = records.Find(name);
+    return (index != -1) ? (index + 1) : TYPE_VOID;
+}
+
+size_t Definitions::NumRecords() const {
+    return records.size();
+}
+
+const Record* Definitions::GetRecord(size_t index) const {
+    return (index < NumRecords()) ? &records[index] : NULL;
+}
+
+const Record* Definitions::GetRecordType(int type) const {
+    return IsRecord(type) ? GetRecord(type - 1) : NULL;
+}
+
 const Var* Definitions::FindVar(const string& name) const {
-    const Var* local = FindLocal(name);
-    return (local != NULL)
-        ? local
-        : FindGlobal(name);
+    return locals.Lookup(name);
 }
 
 const bool Definitions::IsGlobal(const string& name) const {
-    return FindGlobal(name) != NULL;
+    return globals.Find(name) != -1;
 }
 
 const vector<Var>& Definitions::GetGlobals() const {
-    return globals;
+    return globals.GetSymbols();
 }
 
 const vector<Var>& Definitions::GetLocals() const {
-    return locals;
+    return locals.GetSymbols();
 }
 
-const Var* Definitions::FindLocal(const string& name) const {
-    for (size_t i = 0; i < locals.size(); ++i) {
-        if (locals[i].name == name) {
-            return &locals[i];
-        }
-    }
-    return NULL;
+int Definitions::FindLocalIndex(const string& name) const {
+    return locals.Find(name);
 }
 
-const Var* Definitions::FindGlobal(const string& name) const {
-    for (size_t i = 0; i < globals.size(); ++i) {
-        if (globals[i].name == name) {
-            return &globals[i];
-        }
-    }
-    return NULL;
+int Definitions::FindGlobalIndex(const string& name) const {
+    return globals.Find(name);
 }
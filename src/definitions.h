@@ -5,22 +5,33 @@
 
 class Definitions {
 public:
+    Definitions();
     void AddFunction(const Function& func);
     void AddGlobal(const Var& global);
     void AddLocal(const Var& local);
+    void AddRecord(const Record& record);
     void ClearLocals();
     const Function* FindFunction(const std::string& name) const;
+    int FindFunctionIndex(const std::string& name) const;
     size_t NumFunctions() const;
     const Function* GetFunction(size_t index) const;
+    const Record* FindRecord(const std::string& name) const;
+    int FindRecordType(const std::string& name) const;
+    size_t NumRecords() const;
+    const Record* GetRecord(size_t index) const;
+    const Record* GetRecordType(int type) const;
     const Var* FindVar(const std::string& name) const;
     const bool IsGlobal(const std::string& name) const;
+    int FindLocalIndex(const std::string& name) const;
+    int FindGlobalIndex(const std::string& name) const;
     const std::vector<Var>& GetGlobals() const;
     const std::vector<Var>& GetLocals() const;
 private:
-    std::vector<Function> functions;
-    std::vector<Var> globals;
-    std::vector<Var> locals;
-    
-    const Var* FindLocal(const std::string& name) const;
-    const Var* FindGlobal(const std::string& name) const;
+    SymbolTable<Function> functions;
+    SymbolTable<Var> globals;
+    SymbolTable<Var> locals;    // Chained to globals
+    SymbolTable<Record> records;
+
+    Definitions(const Definitions& other);
+    Definitions& operator=(const Definitions& other);
 };
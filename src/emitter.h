@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdio.h>
+#include "common.h"
+
+#define EMITTER_FLUSH_SIZE 65536
+
+// Collects generated code in a single growable buffer. When writing to a file, the buffer is
+// flushed whenever it grows past EMITTER_FLUSH_SIZE, so memory use does not depend on the output size.
+class Emitter {
+public:
+    Emitter(FILE* file = NULL) : file(file) {
+        buffer.reserve(EMITTER_FLUSH_SIZE);
+    }
+
+    ~Emitter() {
+        Flush();
+    }
+
+    Emitter& operator<<(const std::string& str) {
+        buffer += str;
+        if (file && buffer.length() >= EMITTER_FLUSH_SIZE) Flush();
+        return *this;
+    }
+
+    Emitter& operator<<(const char* str) {
+        buffer += str;
+        if (file && buffer.length() >= EMITTER_FLUSH_SIZE) Flush();
+        return *this;
+    }
+
+    Emitter& Write(const char* data, size_t size) {
+        buffer.append(data, size);
+        if (file && buffer.length() >= EMITTER_FLUSH_SIZE) Flush();
+        return *this;
+    }
+
+    Emitter& Indent(int level) {
+        buffer.append(level * 4, ' ');
+        return *this;
+    }
+
+    void Flush() {
+        if (file && !buffer.empty()) {
+            fwrite(buffer.data(), 1, buffer.length(), file);
+            buffer.clear();
+        }
+    }
+
+    // Contents not yet flushed, or everything emitted when there is no file
+    const std::string& GetBuffer() const {
+        return buffer;
+    }
+private:
+    FILE* file;
+    std::string buffer;
+
+    Emitter(const Emitter&);
+    Emitter& operator=(const Emitter&);
+};
@@ -2,9 +2,11 @@
 
 #include <stdlib.h>
 #include "common.h"
+#include "parallel.h"
 #include "swan/console.hh"
 
 inline void Error(const std::string& message) {
+    FailTask(message);
     swan::console::println(message);
     exit(-1);
 }
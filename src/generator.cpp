@@ -1,21 +1,57 @@
 #include "generator.h"
+#include "parallel.h"
 
 using namespace std;
 using namespace swan;
 
-string Generator::GenProgram(const vector<string>& functions, const vector<string>& program, const Definitions& definitions) const {
-    const string headerStr =
+void Generator::GenProgram(const IrProgram& program, Emitter& out, int jobs) {
+    AddSymbols(program, "");
+    GenDeclarations(program, out, jobs);
+    out << "int main(int argc, char* argv[]) {\n";
+    out.Indent(1) << GenScopeMark();
+    out.Indent(1) << "_SetArgs(argc, argv);\n";
+    GenImportInits(program, out);
+    for (size_t i = 0; i < program.main->children.size(); ++i) {
+        out.Indent(1);
+        GenStatement(program.main->children[i], 0, NULL, out);
+    }
+    out.Indent(1) << GenStatement(GenFunctionCleanup(program.globals));
+    out.Indent(1) << "return 0;\n";
+    out << "}\n";
+}
+
+void Generator::GenModule(const IrProgram& program, const string& name, Emitter& out, int jobs) {
+    AddSymbols(program, name);
+    GenDeclarations(program, out, jobs);
+
+    // Globals are exported, so they are not released when initialization finishes
+    out << "void " << GenInitId(name) << "() {\n";
+    out.Indent(1) << "static int initialized = 0;\n";
+    out.Indent(1) << "if (initialized) return;\n";
+    out.Indent(1) << "initialized = 1;\n";
+    out.Indent(1) << GenScopeMark();
+    GenImportInits(program, out);
+    for (size_t i = 0; i < program.main->children.size(); ++i) {
+        out.Indent(1);
+        GenStatement(program.main->children[i], 0, NULL, out);
+    }
+    out.Indent(1) << GenStatement(GenFunctionCleanup(vector<Var>()));
+    out << "}\n";
+}
+
+void Generator::GenDeclarations(const IrProgram& program, Emitter& out, int jobs) const {
+    out <<
         "#include <string.h>\n"
         "#include <core/core.h>\n"
         "#include <core/litemem.h>\n\n"
-        "#define _bool(a, is_str) (a && (is_str ? strcmp((const char*)a, \"\") : 1))\n"
+        "#define _bool(a, is_str) ((a) && (is_str ? strcmp((const char*)(a), \"\") : 1))\n"
         "#define _and(a, b, is_str) (_bool(a, is_str) ? b : a)\n"
         "#define _or(a, b, is_str) (_bool(a, is_str) ? a : b)\n"
         "#define _not(a, is_str) (_bool(a, is_str) ? 0 : 1)\n"
         "#define _TInt2TInt(v) (v)\n"
-        "#define _TInt2TFloat(v) ((float)v)\n"
+        "#define _TInt2TFloat(v) ((float)(v))\n"
         "#define _TInt2TString(v) (Str(v))\n"
-        "#define _TFloat2TInt(v) ((int)v)\n"
+        "#define _TFloat2TInt(v) ((int)(v))\n"
         "#define _TFloat2TFloat(v) (v)\n"
         "#define _TFloat2TString(v) StrF(v)\n"
         "#define _TString2TInt(v) Val(v)\n"
@@ -23,128 +59,432 @@ string Generator::GenProgram(const vector<string>& functions, const vector<strin
         "#define _TString2TString(v) (v)\n"
         "#define _TList2TString(v) _ListToString(v)\n"
         "#define _TDict2TString(v) _DictToString(v)\n"
-        "const TChar* _strcat(const TChar* a, const TChar* b) { TChar* str = (TChar*)lmem_autorelease(lstr_allocempty(strlen(a) + strlen(b))); strcpy(str, a); return strcat(str, b); }\n\n";
-    const string globals = GenVarDefs(definitions.GetGlobals(), GenIndent(0)) + "\n";
-    string functionDeclsStr;
-    for (size_t i = 0; i < definitions.NumFunctions(); ++i) {
-        functionDeclsStr += GenStatement(GenFunctionHeader(*definitions.GetFunction(i)));
-    }
-    functionDeclsStr += "\n";
-    string functionsStr;
-    for (size_t i = 0; i < functions.size(); ++i) {
-        functionsStr += functions[i] + "\n";
-    }
-    string programStr = "int main(int argc, char* argv[]) {\n";
-    programStr += GenIndent(1) + "_SetArgs(argc, argv);\n";
-    for (size_t i = 0; i < program.size(); ++i) {
-        programStr += GenIndent(1) + program[i];
-    }
-    programStr += GenIndent(1) + GenStatement(GenFunctionCleanup(NULL, definitions.GetGlobals()));
-    programStr += GenIndent(1) + "return 0;\n";
-    programStr += "}";
-    return headerStr
-        + globals
-        + functionDeclsStr
-        + functionsStr
-        + programStr
-        + "\n";
-}
-
-string Generator::GenFunctionDef(const Function& func, const string& block, const Definitions& definitions) const {
+        "static const TChar* _strcat(const TChar* a, const TChar* b) { return (const TChar*)lmem_autorelease(lstr_cat(a, b)); }\n"
+        "static int _streq(const TChar* a, const TChar* b) { return a == b || (lstr_len(a) == lstr_len(b) && (lstr_len(a) == 0 || memcmp(a, b, lstr_len(a)) == 0)); }\n"
+        "static int _strcmp(const TChar* a, const TChar* b) { return strcmp(a ? a : \"\", b ? b : \"\"); }\n\n";
+    for (size_t i = 0; i < program.records.size(); ++i) {
+        GenRecord(program.records[i], i + 1, out);
+    }
+    if (!program.imports.empty()) {
+        for (size_t i = 0; i < program.imports.size(); ++i) {
+            out << GenStatement("void " + GenInitId(program.imports[i]) + "()");
+        }
+        for (size_t i = 0; i < program.externFunctions.size(); ++i) {
+            out << GenStatement(GenFunctionHeader(program.externFunctions[i]));
+        }
+        for (size_t i = 0; i < program.externGlobals.size(); ++i) {
+            const Var& global = program.externGlobals[i];
+            out << GenStatement("extern " + GenType(global.type) + " " + GenGlobalId(global.name));
+        }
+        out << "\n";
+    }
+    GenVarDefs(program.globals, 0, true, out);
+    if (program.numDictSites > 0) {
+        out << GenStatement("static size_t _dictsites[" + strmanip::fromint(program.numDictSites) + "]");
+    }
+    for (size_t i = 0; i < program.strings.size(); ++i) {
+        out << GenStatement("LSTR_STATIC(_str" + strmanip::fromint(i) + ", \"" + program.strings[i] + "\")");
+    }
+    out << "\n";
+    for (size_t i = 0; i < program.functions.size(); ++i) {
+        out << GenStatement(GenFunctionHeader(program.functions[i]));
+    }
+    out << "\n";
+    if (jobs > 1) {
+        // Functions are generated into per worker buffers, and then copied out in source order
+        FunctionJob job;
+        job.generator = this;
+        job.program = &program;
+        job.spans.resize(program.definitions.size());
+        for (int i = 0; i < jobs; ++i) {
+            job.buffers.push_back(new Emitter());
+        }
+        RunParallel(program.definitions.size(), jobs, GenFunctionTask, &job);
+        for (size_t i = 0; i < job.spans.size(); ++i) {
+            const Span& span = job.spans[i];
+            out.Write(job.buffers[span.worker]->GetBuffer().data() + span.begin, span.end - span.begin) << "\n";
+        }
+        for (int i = 0; i < jobs; ++i) {
+            delete job.buffers[i];
+        }
+    } else {
+        for (size_t i = 0; i < program.definitions.size(); ++i) {
+            GenFunctionDef(program.definitions[i], out);
+            out << "\n";
+        }
+    }
+}
+
+// Records are structs with a field per member, allocated with a destructor that releases the managed ones
+void Generator::GenRecord(const Record& record, int type, Emitter& out) const {
+    const string typeName = GenType(type);
+    const string id = strmanip::fromint(type);
+    string fields, release, params, init;
+    for (size_t i = 0; i < record.fields.size(); ++i) {
+        const Var& field = record.fields[i];
+        const string fieldId = GenVarId(field.name);
+        fields += GenType(field.type) + " " + fieldId + "; ";
+        if (IsManaged(field.type)) release += "_DecRef(r->" + fieldId + "); ";
+        params += ((i > 0) ? ", " : "") + GenType(field.type) + " " + fieldId;
+        init += IsManaged(field.type)
+            ? ("lmem_assign(r->" + fieldId + ", " + fieldId + "); ")
+            : ("r->" + fieldId + " = " + fieldId + "; ");
+    }
+    out << GenStatement("struct _Record" + id + " { " + fields + "}");
+    if (release != "") {
+        out << "static void _FreeRecord" << id << "(" << typeName << " r) { " << release << "}\n";
+    }
+    out << "static " << typeName << " _NewRecord" << id << "(" << params << ") { "
+        << typeName << " r = lmem_allocauto(struct _Record" << id << ", "
+        << ((release != "") ? ("(void*)_FreeRecord" + id) : string("0")) << "); "
+        << init << "return r; }\n\n";
+}
+
+void Generator::GenImportInits(const IrProgram& program, Emitter& out) const {
+    for (size_t i = 0; i < program.imports.size(); ++i) {
+        out.Indent(1) << GenStatement(GenInitId(program.imports[i]) + "()");
+    }
+}
+
+// Functions and globals of modules get ids prefixed with the module, so modules that are not imported
+// by each other can use the same names
+void Generator::AddSymbols(const IrProgram& program, const string& module) {
+    for (map<string, string>::const_iterator it = program.externModules.begin(); it != program.externModules.end(); ++it) {
+        symbols[it->first] = GenModuleId(it->second, it->first);
+    }
+    if (module == "") return;
+    for (size_t i = 0; i < program.functions.size(); ++i) {
+        symbols[program.functions[i].name] = GenModuleId(module, program.functions[i].name);
+    }
+    for (size_t i = 0; i < program.globals.size(); ++i) {
+        symbols[program.globals[i].name] = GenModuleId(module, program.globals[i].name);
+    }
+}
+
+void Generator::GenFunctionTask(void* data, size_t index, int worker) {
+    FunctionJob* job = (FunctionJob*)data;
+    Emitter& buffer = *job->buffers[worker];
+    Span& span = job->spans[index];
+    span.worker = worker;
+    span.begin = buffer.GetBuffer().length();
+    job->generator->GenFunctionDef(job->program->definitions[index], buffer);
+    span.end = buffer.GetBuffer().length();
+}
+
+void Generator::GenFunctionDef(const IrFunction& def, Emitter& out) const {
+    const Function& func = def.func;
     vector<Var> locals;
-    locals.insert(locals.begin(), definitions.GetLocals().begin() + func.params.size(), definitions.GetLocals().end());
-    return GenFunctionHeader(func) + " {\n"
-        + GenVarDefs(locals, GenIndent(1))
-        + block
-        + GenIndent(1) + GenStatement(GenFunctionCleanup(&func, definitions.GetLocals()))
-        + "}\n";
+    locals.insert(locals.begin(), def.locals.begin() + func.params.size(), def.locals.end());
+    out << GenFunctionHeader(func) << " {\n";
+    GenVarDefs(locals, 1, false, out);
+    out.Indent(1) << GenScopeMark();
+
+    // Parameters are retained while the function runs, and released with the locals
+    const vector<Var> params = GetManagedVars(func.params);
+    for (size_t i = 0; i < params.size(); ++i) {
+        out.Indent(1) << GenStatement("_IncRef(" + GenVarId(params[i].name) + ")");
+    }
+    GenBlock(def.block, 1, &def, out);
+    out.Indent(1) << GenStatement(GenFunctionCleanup(def.locals));
+    out << "}\n";
+}
+
+void Generator::GenBlock(const IrNode* block, int indent, const IrFunction* def, Emitter& out) const {
+    for (size_t i = 0; i < block->children.size(); ++i) {
+        GenStatement(block->children[i], indent, def, out);
+    }
+}
+
+void Generator::GenStatement(const IrNode* node, int indent, const IrFunction* def, Emitter& out) const {
+    switch (node->kind) {
+    case IR_IF:
+        out.Indent(indent) << GenIf(GenExp(node->children[0]));
+        GenBlock(node->children[1], indent + 1, def, out);
+        for (size_t i = 2; i < node->children.size(); ++i) {
+            const IrNode* child = node->children[i];
+            if (child->kind == IR_ELSEIF) {
+                out.Indent(indent) << GenElseIf(GenExp(child->children[0]));
+                GenBlock(child->children[1], indent + 1, def, out);
+            } else {
+                out.Indent(indent) << GenElse();
+                GenBlock(child->children[0], indent + 1, def, out);
+            }
+        }
+        out.Indent(indent) << GenEnd();
+        break;
+    case IR_FOR:
+        out.Indent(indent) << GenFor(
+            GenAssignment(node->children[0], def),
+            GenExp(node->children[1]).code,
+            GenExp(node->children[2]).code);
+        GenBlock(node->children[3], indent + 1, def, out);
+        if (MakesTemporaries(node)) out.Indent(indent + 1) << GenLoopTrim();
+        out.Indent(indent) << GenEnd();
+        break;
+    case IR_WHILE:
+        out.Indent(indent) << GenWhile(GenExp(node->children[0]));
+        GenBlock(node->children[1], indent + 1, def, out);
+        if (MakesTemporaries(node)) out.Indent(indent + 1) << GenLoopTrim();
+        out.Indent(indent) << GenEnd();
+        break;
+    case IR_RETURN: {
+        const vector<Var> locals(def->locals.begin(), def->locals.begin() + node->index);
+        const string exp = (node->children.size() > 0) ? GenExp(node->children[0]).code : "";
+        out.Indent(indent) << GenReturn(&def->func, exp, locals);
+        break;
+    }
+    case IR_EXPSTMT:
+        out.Indent(indent) << GenStatement(GenExp(node->children[0]).code);
+        break;
+    default:
+        out.Indent(indent) << GenStatement(GenAssignment(node, def));
+    }
 }
 
 string Generator::GenStatement(const string& exp) const {
     return exp + ";\n";
 }
 
-string Generator::GenIf(const Expression& exp, const string& block, const string& elseifs, const string& else_, const string& end) const {
-    return "if (" + GenBoolExp(exp.type, exp.code) + ") {\n" + block + elseifs + else_ + end;
+string Generator::GenAssignment(const IrNode* node, const IrFunction* def) const {
+    const bool isVar = node->kind == IR_VARDEF || node->kind == IR_ASSIGN;
+    if (isVar && def && !node->global && def->owned[node->index]) return GenOwnedAssignment(node);
+    const Expression exp = GenExp(node->children.back());
+    switch (node->kind) {
+    case IR_VARDEF:
+        return GenVarDef(Var(node->data, node->type), exp.type, exp.code, node->global);
+    case IR_ASSIGN:
+        return GenAssignment(Var(node->data, node->type), exp.type, exp.code, node->global);
+    case IR_LISTSET:
+        return GenListSetter(GenExp(node->children[0]).code, GenExp(node->children[1]).code, exp, node->argType);
+    case IR_DICTSET:
+        return GenDictSetter(GenExp(node->children[0]).code, GenDictKey(node), exp, node->index >= 0);
+    case IR_FIELDSET:
+        return GenFieldSetter(GenExp(node->children[0]).code, Var(node->data, node->type), exp);
+    default:
+        return ""; // Should not get here
+    }
 }
 
-string Generator::GenElseIf(const Expression& exp, const string& block) const {
-    return "} else if (" + GenBoolExp(exp.type, exp.code) + ")) {\n" + block;
+// Owned locals hold the only reference to their value, so they take over new values without retaining
+// them, and reuse the storage of the previous one when possible
+string Generator::GenOwnedAssignment(const IrNode* node) const {
+    const IrNode* exp = node->children.back();
+    const string varId = GenVarId(node->data);
+    const bool readsVar = CountReads(exp, node->index) > 0;
+    if (exp->kind == IR_LIST || exp->kind == IR_DICT) {
+        vector<Expression> keys;
+        vector<Expression> values;
+        for (size_t i = 0; i < exp->children.size(); ++i) {
+            const bool isKey = exp->kind == IR_DICT && i % 2 == 0;
+            (isKey ? keys : values).push_back(GenExp(exp->children[i]));
+        }
+        const string recycled = readsVar ? string("0") : varId;
+        const string container = (exp->kind == IR_LIST)
+            ? GenList(IsPacked(exp->argType)
+                ? ("_RecyclePackedList(" + recycled + ", " + GenTypeId(exp->argType) + ")")
+                : ("_RecycleList(" + recycled + ")"), values, exp->argType)
+            : GenDict("_RecycleDict(" + recycled + ")", keys, values);
+        return readsVar ? ("lmem_move(" + varId + ", " + container + ")") : (varId + " = " + container);
+    } else if (exp->kind == IR_LITERAL) {
+        return "lmem_move(" + varId + ", lstr_alloc(\"" + exp->data + "\"))";
+    }
+
+    // Appending to the variable itself grows it in place, unless other operands read it too
+    const IrNode* first = exp;
+    while (IsConcat(first)) first = first->children[0];
+    const bool inPlace = first->kind == IR_VAR && !first->global && first->index == node->index
+        && CountReads(exp, node->index) == 1;
+    return inPlace
+        ? (varId + " = " + GenOwnedConcat(exp, true))
+        : ("lmem_move(" + varId + ", " + GenOwnedConcat(exp, false) + ")");
+}
+
+Expression Generator::GenExp(const IrNode* node) const {
+    switch (node->kind) {
+    case IR_LITERAL:
+        // Strings that are only read can use static data instead of a managed copy
+        if (node->transient) return Expression(node->type, "_str" + strmanip::fromint(node->index) + ".data");
+        return Expression(node->type, GenLiteral(node->op, node->data));
+    case IR_VAR:
+        return Expression(node->type, GenVar(Var(node->data, node->type), node->global));
+    case IR_CALL:
+    case IR_LIBCALL: {
+        vector<Expression> args;
+        for (size_t i = 0; i < node->children.size(); ++i) {
+            args.push_back(GenExp(node->children[i]));
+        }
+        return Expression(node->type, GenFunctionCall(node->data, GenArgs(args)));
+    }
+    case IR_BINARY:
+        if (IsConcat(node) && IsConcat(node->children[0])) {
+            return Expression(node->type, "(const TChar*)_AutoDec(" + GenOwnedConcat(node, false) + ")");
+        }
+        return Expression(node->type, GenBinaryExp(
+            node->argType,
+            node->op,
+            GenExp(node->children[0]).code,
+            GenExp(node->children[1]).code));
+    case IR_NOT:
+        return Expression(node->type, GenNotExp(GenExp(node->children[0])));
+    case IR_NEG:
+        return Expression(node->type, GenNegExp(GenExp(node->children[0]).code));
+    case IR_GROUP:
+        return Expression(node->type, GenGroupExp(GenExp(node->children[0]).code));
+    case IR_CAST:
+        return Expression(node->type, GenCastExp(node->type, node->argType, GenExp(node->children[0]).code));
+    case IR_LIST: {
+        vector<Expression> values;
+        for (size_t i = 0; i < node->children.size(); ++i) {
+            values.push_back(GenExp(node->children[i]));
+        }
+        const string list = IsPacked(node->argType)
+            ? ("_CreatePackedList(" + GenTypeId(node->argType) + ")")
+            : string("_CreateList()");
+        return Expression(node->type, GenList(list, values, node->argType));
+    }
+    case IR_DICT: {
+        vector<Expression> keys;
+        vector<Expression> values;
+        for (size_t i = 0; i < node->children.size(); i += 2) {
+            keys.push_back(GenExp(node->children[i]));
+            values.push_back(GenExp(node->children[i + 1]));
+        }
+        return Expression(node->type, GenDict("_CreateDict()", keys, values));
+    }
+    case IR_LISTGET:
+        return Expression(node->type, GenListGetter(
+            node->type,
+            GenExp(node->children[0]).code,
+            GenExp(node->children[1]).code,
+            node->argType));
+    case IR_DICTGET:
+        return Expression(node->type, GenDictGetter(
+            node->type,
+            GenExp(node->children[0]).code,
+            GenDictKey(node),
+            node->index >= 0));
+    case IR_NEW: {
+        vector<Expression> args;
+        for (size_t i = 0; i < node->children.size(); ++i) {
+            args.push_back(GenExp(node->children[i]));
+        }
+        return Expression(node->type, GenNew(node->type, GenArgs(args)));
+    }
+    case IR_FIELDGET:
+        return Expression(node->type, GenFieldGetter(GenExp(node->children[0]).code, Var(node->data, node->type)));
+    default:
+        return Expression(TYPE_VOID, ""); // Should not get here
+    }
+}
+
+// Builds a chain of concatenations into a single string owned by the caller, which grows in place with
+// each operand. The leftmost operand is grown too when it is already owned.
+string Generator::GenOwnedConcat(const IrNode* node, bool inPlace) const {
+    const IrNode* left = node->children[0];
+    const string right = GenExp(node->children[1]).code;
+    if (IsConcat(left)) {
+        return "lstr_append(" + GenOwnedConcat(left, inPlace) + ", " + right + ")";
+    } else {
+        return (inPlace ? "lstr_append(" : "lstr_cat(") + GenExp(left).code + ", " + right + ")";
+    }
 }
 
-string Generator::GenElse(const string& block) const {
-    return "} else {\n" + block;
+string Generator::GenIf(const Expression& exp) const {
+    return "if (" + GenBoolExp(exp.type, exp.code) + ") {\n";
+}
+
+string Generator::GenElseIf(const Expression& exp) const {
+    return "} else if (" + GenBoolExp(exp.type, exp.code) + ") {\n";
+}
+
+string Generator::GenElse() const {
+    return "} else {\n";
 }
 
 string Generator::GenEnd() const {
     return "}\n";
 }
 
-string Generator::GenFor(const Var& _, const string& assignment, const string& to, const string& step, const string& block, const string& end) const {
+// Temporaries are autoreleased into the scope of the function (or main program) running
+string Generator::GenScopeMark() const {
+    return "const size_t _scope = _AutoDecMark();\n";
+}
+
+// Every temporary above the scope mark belongs to a finished statement at the end of an iteration.
+// Loops that never allocate temporaries skip it, since the call keeps gcc from optimizing them.
+string Generator::GenLoopTrim() const {
+    return "_TrimAutoDec(_scope);\n";
+}
+
+string Generator::GenFor(const string& assignment, const string& to, const string& step) const {
     const string varName = assignment.substr(0, assignment.find(" ", 0));
     return "for ("
         + assignment + "; "
         + varName + " <= " + to + "; "
         + varName + " += " + (step != "" ? step : "1")
-        + ") {\n"
-        + block
-        + end;
+        + ") {\n";
 }
 
-string Generator::GenWhile(const Expression& exp, const string& block, const string& end) const {
-    return "while (" + GenBoolExp(exp.type, exp.code) + ") {\n" + block + end;
+string Generator::GenWhile(const Expression& exp) const {
+    return "while (" + GenBoolExp(exp.type, exp.code) + ") {\n";
 }
 
-string Generator::GenReturn(const Function* func, const string& exp, const Definitions& definitions) const {
-    return GenFunctionCleanup(func, definitions.GetLocals(), exp)
-        + " return "
-        + ((func->type == TYPE_STRING || func->type == TYPE_LIST || func->type == TYPE_DICT)
-            ? ("_AutoDec(" + exp + ")")
-            : exp)
-        + ";\n";
+string Generator::GenReturn(const Function* func, const string& exp, const vector<Var>& locals) const {
+    if (exp == "") return GenFunctionCleanup(locals) + " return;\n";
+
+    // The result is computed before the locals are released, and kept alive until the caller gets it
+    const bool managed = IsManaged(func->type);
+    return "{ " + GenType(func->type) + " _result = " + exp + "; "
+        + (managed ? "_IncRef(_result); " : "")
+        + GenFunctionCleanup(locals)
+        + " return " + (managed ? "_AutoDec(_result)" : "_result") + "; }\n";
 }
 
 string Generator::GenVarDef(const Var& var, int expType, const string& exp, bool isGlobal) const {
-    return GenAssignment(var, expType, exp);
+    return GenAssignment(var, expType, exp, isGlobal);
 }
 
-string Generator::GenAssignment(const Var& var, int expType, const string& exp) const {
-    const string varId = GenVarId(var.name);
-    if (expType == TYPE_STRING || expType == TYPE_LIST || expType == TYPE_DICT) {
+string Generator::GenAssignment(const Var& var, int expType, const string& exp, bool isGlobal) const {
+    const string varId = isGlobal ? GenGlobalId(var.name) : GenVarId(var.name);
+    if (IsManaged(expType)) {
         return "lmem_assign(" + varId + ", " + exp + ")";
     } else {
         return varId + " = " + exp;
     }
 }
 
-string Generator::GenBinaryExp(int expType, const Token& token, const string& left, const string& right) const {
+string Generator::GenBinaryExp(int expType, int tokenType, const string& left, const string& right) const {
     const string op =
-        (token.type == TOK_OR) ? " || " :
-        (token.type == TOK_AND) ? " && " :
-        (token.type == TOK_EQUAL) ? " == " :
-        (token.type == TOK_NOTEQUAL) ? " != " :
-        (token.type == TOK_LESSER) ? " < " :
-        (token.type == TOK_LEQUAL) ? " <= " :
-        (token.type == TOK_GREATER) ? " > " :
-        (token.type == TOK_GEQUAL) ? " >= " :
-        (token.type == TOK_PLUS) ? "+" :
-        (token.type == TOK_MINUS) ? "-" :
-        (token.type == TOK_MUL) ? "*" :
-        (token.type == TOK_DIV) ? "/" :
+        (tokenType == TOK_OR) ? " || " :
+        (tokenType == TOK_AND) ? " && " :
+        (tokenType == TOK_EQUAL) ? " == " :
+        (tokenType == TOK_NOTEQUAL) ? " != " :
+        (tokenType == TOK_LESSER) ? " < " :
+        (tokenType == TOK_LEQUAL) ? " <= " :
+        (tokenType == TOK_GREATER) ? " > " :
+        (tokenType == TOK_GEQUAL) ? " >= " :
+        (tokenType == TOK_PLUS) ? "+" :
+        (tokenType == TOK_MINUS) ? "-" :
+        (tokenType == TOK_MUL) ? "*" :
+        (tokenType == TOK_DIV) ? "/" :
         "%";
     return
-        (token.type == TOK_OR) ? ("_or(" + left + ", " + right + ", " + GenIsStr(expType) + ")") : 
-        (token.type == TOK_AND) ? ("_and(" + left + ", " + right + ", " + GenIsStr(expType) + ")") :
-        (token.type == TOK_PLUS && expType == TYPE_STRING) ? ("_strcat(" + left + ", " + right + ")") :
-        (token.type >= TOK_EQUAL && token.type <= TOK_GEQUAL) ? GenBoolExp(expType, left + op + right) :
+        (tokenType == TOK_OR) ? ("_or(" + left + ", " + right + ", " + GenIsStr(expType) + ")") : 
+        (tokenType == TOK_AND) ? ("_and(" + left + ", " + right + ", " + GenIsStr(expType) + ")") :
+        (tokenType == TOK_PLUS && expType == TYPE_STRING) ? ("_strcat(" + left + ", " + right + ")") :
+        (tokenType == TOK_EQUAL && expType == TYPE_STRING) ? ("_streq(" + left + ", " + right + ")") :
+        (tokenType == TOK_NOTEQUAL && expType == TYPE_STRING) ? ("!_streq(" + left + ", " + right + ")") :
+        (tokenType >= TOK_EQUAL && tokenType <= TOK_LEQUAL && expType == TYPE_STRING)
+            ? ("(_strcmp(" + left + ", " + right + ")" + op + "0)") :
+        (tokenType >= TOK_EQUAL && tokenType <= TOK_GEQUAL) ? GenBoolExp(expType, left + op + right) :
         (left + op + right);
 }
 
-string Generator::GenList(const vector<Expression>& values) const {
-    string str = "_CreateList()";
+string Generator::GenList(const string& listCode, const vector<Expression>& values, int elemType) const {
+    string str = listCode;
     for (size_t i = 0; i < values.size(); ++i) {
-        string funcName = "";
-        switch (values[i].type) {
+        string funcName = IsPacked(elemType) ? ("_SetPacked" + GenTypeName(elemType)) : "";
+        switch (IsPacked(elemType) ? TYPE_VOID : values[i].type) {
         case TYPE_INT:
             funcName = "_SetListInt";
             break;
@@ -172,8 +512,8 @@ string Generator::GenList(const vector<Expression>& values) const {
     return str;
 }
 
-string Generator::GenDict(const vector<Expression>& keys, const vector<Expression>& values) const {
-    string str = "_CreateDict()";
+string Generator::GenDict(const string& dictCode, const vector<Expression>& keys, const vector<Expression>& values) const {
+    string str = dictCode;
     for (size_t i = 0; i < values.size(); ++i) {
         string funcName = "";
         switch (values[i].type) {
@@ -212,9 +552,9 @@ string Generator::GenCastExp(int castType, int expType, const std::string& exp)
     const string expTypeName = GenType(expType);
     const string castTypeName = GenType(castType);
     return string("_")
-        + Replace(Replace(Replace(expTypeName.c_str(), "TChar", "TString"), "struct ", ""), "*", "")
+        + strmanip::replaceall(strmanip::replaceall(strmanip::replaceall(expTypeName, "TChar", "TString"), "struct ", ""), "*", "")
         + "2"
-        + Replace(Replace(Replace(castTypeName.c_str(), "TChar", "TString"), "struct ", ""), "*", "")
+        + strmanip::replaceall(strmanip::replaceall(strmanip::replaceall(castTypeName, "TChar", "TString"), "struct ", ""), "*", "")
         + "(" + exp + ")";
 }
 
@@ -226,11 +566,11 @@ string Generator::GenGroupExp(const string& exp) const {
     return "(" + exp + ")";
 }
 
-string Generator::GenFunctionCall(const Function& func, const string& args) const {
-    return GenFuncId(func.name) + args;
+string Generator::GenFunctionCall(const string& name, const string& args) const {
+    return GenFuncId(name) + args;
 }
 
-string Generator::GenArgs(const Function& func, const vector<Expression>& args) const {
+string Generator::GenArgs(const vector<Expression>& args) const {
     string result;
     for (size_t i = 0; i < args.size(); ++i) {
         result += args[i].code;
@@ -239,17 +579,18 @@ string Generator::GenArgs(const Function& func, const vector<Expression>& args)
     return "(" + result + ")";
 }
 
-string Generator::GenVar(const Var& var) const {
-    return GenVarId(var.name);
+string Generator::GenVar(const Var& var, bool isGlobal) const {
+    return isGlobal ? GenGlobalId(var.name) : GenVarId(var.name);
 }
 
-string Generator::GenLiteral(const Token& token) const {
-    switch (token.type) {
+string Generator::GenLiteral(int op, const string& data) const {
+    switch (op) {
     case TOK_INTLITERAL:
     case TOK_FLOATLITERAL:
-        return token.data;
+        // Negative literals must not merge with a preceding minus operator
+        return (data[0] == '-') ? ("(" + data + ")") : data;
     case TOK_STRINGLITERAL:
-        return "lstr_get(\"" + token.data + "\")";
+        return "lstr_get(\"" + data + "\")";
     case TOK_NULLLITERAL:
         return "0";
     case TOK_TRUELITERAL:
@@ -261,7 +602,28 @@ string Generator::GenLiteral(const Token& token) const {
     }
 }
 
-string Generator::GenListGetter(int type, const string& listCode, const std::string& indexCode) const {
+string Generator::GenNew(int type, const string& args) const {
+    return "_NewRecord" + strmanip::fromint(type) + args;
+}
+
+string Generator::GenFieldGetter(const string& objectCode, const Var& field) const {
+    return objectCode + "->" + GenVarId(field.name);
+}
+
+string Generator::GenFieldSetter(const string& objectCode, const Var& field, const Expression& valueExp) const {
+    const string fieldCode = GenFieldGetter(objectCode, field);
+    if (IsManaged(field.type)) {
+        return "lmem_assign(" + fieldCode + ", " + valueExp.code + ")";
+    } else {
+        return fieldCode + " = " + valueExp.code;
+    }
+}
+
+// Elements of packed lists read as another type go through the conversions of the generic getters
+string Generator::GenListGetter(int type, const string& listCode, const std::string& indexCode, int elemType) const {
+    if (type == elemType) {
+        return "_Packed" + GenTypeName(elemType) + "(" + listCode + ", " + indexCode + ")";
+    }
     string funcName = "";
     switch (type) {
     case TYPE_INT:
@@ -288,9 +650,9 @@ string Generator::GenListGetter(int type, const string& listCode, const std::str
         + ", " + indexCode + ")";
 }
 
-string Generator::GenListSetter(const string& listCode, const std::string& indexCode, const Expression& valueExp) const {
-    string funcName = "";
-    switch (valueExp.type) {
+string Generator::GenListSetter(const string& listCode, const std::string& indexCode, const Expression& valueExp, int elemType) const {
+    string funcName = IsPacked(elemType) ? ("_SetPacked" + GenTypeName(elemType)) : "";
+    switch (IsPacked(elemType) ? TYPE_VOID : valueExp.type) {
     case TYPE_INT:
         funcName = "_SetListInt";
         break;
@@ -316,7 +678,16 @@ string Generator::GenListSetter(const string& listCode, const std::string& index
         + ", " + valueExp.code + ")";
 }
 
-string Generator::GenDictGetter(int type, const string& dictCode, const std::string& indexCode) const {
+// Constant keys are passed along with their hash and the cache of the access site
+string Generator::GenDictKey(const IrNode* node) const {
+    const IrNode* key = node->children[1];
+    if (node->index < 0) return GenExp(key).code;
+    char hash[16];
+    sprintf(hash, "0x%08xu", HashKey(key->data));
+    return GenExp(key).code + ", " + hash + ", &_dictsites[" + strmanip::fromint(node->index) + "]";
+}
+
+string Generator::GenDictGetter(int type, const string& dictCode, const std::string& indexCode, bool cached) const {
     string funcName = "";
     switch (type) {
     case TYPE_INT:
@@ -338,12 +709,12 @@ string Generator::GenDictGetter(int type, const string& dictCode, const std::str
         funcName = "_DictRaw";
         break;
     }
-    return funcName + "("
+    return funcName + (cached ? "At(" : "(")
         + dictCode
         + ", " + indexCode + ")";
 }
 
-string Generator::GenDictSetter(const string& dictCode, const std::string& indexCode, const Expression& valueExp) const {
+string Generator::GenDictSetter(const string& dictCode, const std::string& indexCode, const Expression& valueExp, bool cached) const {
     string funcName = "";
     switch (valueExp.type) {
     case TYPE_INT:
@@ -365,21 +736,12 @@ string Generator::GenDictSetter(const string& dictCode, const std::string& index
         funcName = "_SetDictRaw";
         break;
     }
-    return funcName + "("
+    return funcName + (cached ? "At(" : "(")
         + dictCode
         + ", " + indexCode
         + ", " + valueExp.code + ")";
 }
 
-string Generator::GenIndent(int level) const {
-    const string space = "    ";
-    string indent;
-    for (int i = 0; i < level; ++i) {
-        indent += space;
-    }
-    return indent;
-}
-
 string Generator::GenFunctionHeader(const Function& func) const {
     return GenType(func.type) + " " + GenFuncId(func.name) + GenParams(func);
 }
@@ -410,16 +772,15 @@ string Generator::GenType(int type) {
         case TYPE_VOID:
             return "void";
         default:
-            return ""; // Should not get here
+            return "struct _Record" + strmanip::fromint(type) + "*";
     }
 }
 
-string Generator::GenVarDefs(const std::vector<Var>& locals, const string& indent) const {
-    string str;
-    for (size_t i = 0; i < locals.size(); ++i) {
-        str += indent + GenStatement(GenType(locals[i].type) + " " + GenVarId(locals[i].name) + " = " + GenVarInit(locals[i].type));
+void Generator::GenVarDefs(const std::vector<Var>& vars, int indent, bool isGlobal, Emitter& out) const {
+    for (size_t i = 0; i < vars.size(); ++i) {
+        const string varId = isGlobal ? GenGlobalId(vars[i].name) : GenVarId(vars[i].name);
+        out.Indent(indent) << GenStatement(GenType(vars[i].type) + " " + varId + " = " + GenVarInit(vars[i].type));
     }
-    return str;
 }
 
 string Generator::GenVarInit(int type) {
@@ -439,34 +800,71 @@ string Generator::GenVarInit(int type) {
         case TYPE_VOID:
             return "";
         default:
-            return ""; // Should not get here
+            return "0";
     }
 }
 
-string Generator::GenFuncId(const string& id) {
-    return id;
+// Name of the type in the core runtime functions, like the Int of _ListInt
+string Generator::GenTypeName(int type) {
+    switch (type) {
+        case TYPE_INT:
+            return "Int";
+        case TYPE_FLOAT:
+            return "Float";
+        case TYPE_STRING:
+            return "String";
+        case TYPE_LIST:
+            return "List";
+        case TYPE_DICT:
+            return "Dict";
+        case TYPE_RAW:
+            return "Raw";
+        default:
+            return "";
+    }
+}
+
+string Generator::GenTypeId(int type) {
+    switch (type) {
+        case TYPE_INT:
+            return "TYPE_INT";
+        case TYPE_FLOAT:
+            return "TYPE_FLOAT";
+        case TYPE_STRING:
+            return "TYPE_STRING";
+        default:
+            return "TYPE_VOID";
+    }
+}
+
+string Generator::GenFuncId(const string& id) const {
+    const map<string, string>::const_iterator it = symbols.find(id);
+    return (it != symbols.end()) ? it->second : id;
+}
+
+string Generator::GenGlobalId(const string& id) const {
+    const map<string, string>::const_iterator it = symbols.find(id);
+    return (it != symbols.end()) ? it->second : GenVarId(id);
 }
 
 string Generator::GenVarId(const string& id) {
     return "lf_" + id;
 }
 
-string Generator::GenFunctionCleanup(const Function* func, const vector<Var>& varsInScope, string exclude) {
-    vector<Var> vars = GetManagedVars(varsInScope);
-    if (func) {
-        const vector<Var> params = GetManagedVars(func->params);
-        for (size_t i = 0; i < params.size(); ++i) {
-            if (GenVarId(params[i].name) != exclude) {
-                vars.push_back(params[i]);
-            }
-        }
-    }
-    string str = "_DoAutoDec(); ";
+// The length of the module name keeps apart the ids of names that contain underscores
+string Generator::GenModuleId(const string& module, const string& id) {
+    return "lf" + strmanip::fromint((int)module.length()) + "_" + module + "_" + id;
+}
+
+string Generator::GenInitId(const string& module) {
+    return "_Init_" + module;
+}
+
+string Generator::GenFunctionCleanup(const vector<Var>& varsInScope) {
+    const vector<Var> vars = GetManagedVars(varsInScope);
+    string str = "_DoAutoDecTo(_scope); ";
     for (size_t i = 0; i < vars.size(); ++i) {
-        const Var& var = vars[i];
-        if (GenVarId(var.name) != exclude) {
-            str += "_DecRef(" + GenVarId(var.name) + "); ";
-        }
+        str += "_DecRef(" + GenVarId(vars[i].name) + "); ";
     }
     return str;
 }
@@ -475,7 +873,7 @@ vector<Var> Generator::GetManagedVars(const vector<Var>& vars) {
     vector<Var> result;
     for (size_t i = 0; i < vars.size(); ++i) {
         const Var& var = vars[i];
-        if (var.type == TYPE_LIST || var.type == TYPE_DICT) {
+        if (IsManaged(var.type)) {
             result.push_back(var);
         }
     }
@@ -489,3 +887,19 @@ string Generator::GenBoolExp(int expType, const std::string& expCode) {
 string Generator::GenIsStr(int expType) {
     return (expType == TYPE_STRING) ? "1" : "0";
 }
+
+// Same as _DictHash in the core runtime
+unsigned int Generator::HashKey(const string& key) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < key.size(); ++i) hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    return hash ^ (hash >> 15);
+}
+
+// Whether lists with elements of the type can be packed
+bool Generator::IsPacked(int elemType) {
+    return elemType == TYPE_INT || elemType == TYPE_FLOAT || elemType == TYPE_STRING;
+}
+
+bool Generator::IsConcat(const IrNode* node) {
+    return node->kind == IR_BINARY && node->op == TOK_PLUS && node->type == TYPE_STRING;
+}
@@ -1,50 +1,92 @@
 #pragma once
 
-#include "definitions.h"
+#include <map>
+#include "emitter.h"
 #include "expression.h"
+#include "ir.h"
 #include "lib.h"
 #include "token.h"
 
 class Generator {
 public:
-    std::string GenProgram(const std::vector<std::string>& functions, const std::vector<std::string>& program, const Definitions& definitions) const;
-    std::string GenFunctionDef(const Function& func, const std::string& block, const Definitions& definitions) const;
+    void GenProgram(const IrProgram& program, Emitter& out, int jobs = 1);
+    void GenModule(const IrProgram& program, const std::string& name, Emitter& out, int jobs = 1);
+private:
+    struct Span {
+        int worker;
+        size_t begin;
+        size_t end;
+    };
+
+    struct FunctionJob {
+        const Generator* generator;
+        const IrProgram* program;
+        std::vector<Emitter*> buffers;  // One per worker
+        std::vector<Span> spans;        // Where the code of each function was written
+    };
+
+    std::map<std::string, std::string> symbols;    // C names of the functions and globals of modules
+
+    static void GenFunctionTask(void* data, size_t index, int worker);
+    void AddSymbols(const IrProgram& program, const std::string& module);
+    void GenDeclarations(const IrProgram& program, Emitter& out, int jobs) const;
+    void GenRecord(const Record& record, int type, Emitter& out) const;
+    void GenImportInits(const IrProgram& program, Emitter& out) const;
+    void GenFunctionDef(const IrFunction& def, Emitter& out) const;
+    void GenBlock(const IrNode* block, int indent, const IrFunction* def, Emitter& out) const;
+    void GenStatement(const IrNode* node, int indent, const IrFunction* def, Emitter& out) const;
     std::string GenStatement(const std::string& exp) const;
-    std::string GenIf(const Expression& exp, const std::string& block, const std::string& elseifs, const std::string& else_, const std::string& end) const;
-    std::string GenElseIf(const Expression& exp, const std::string& block) const;
-    std::string GenElse(const std::string& block) const;
+    std::string GenAssignment(const IrNode* node, const IrFunction* def) const;
+    std::string GenOwnedAssignment(const IrNode* node) const;
+    Expression GenExp(const IrNode* node) const;
+    std::string GenOwnedConcat(const IrNode* node, bool inPlace) const;
+    std::string GenIf(const Expression& exp) const;
+    std::string GenElseIf(const Expression& exp) const;
+    std::string GenElse() const;
     std::string GenEnd() const;
-    std::string GenFor(const Var& controlVar, const std::string& assignment, const std::string& to, const std::string& step, const std::string& block, const std::string& end) const;
-    std::string GenWhile(const Expression& exp, const std::string& block, const std::string& end) const;
-    std::string GenReturn(const Function* func, const std::string& exp, const Definitions& definitions) const;
+    std::string GenScopeMark() const;
+    std::string GenLoopTrim() const;
+    std::string GenFor(const std::string& assignment, const std::string& to, const std::string& step) const;
+    std::string GenWhile(const Expression& exp) const;
+    std::string GenReturn(const Function* func, const std::string& exp, const std::vector<Var>& locals) const;
     std::string GenVarDef(const Var& var, int expType, const std::string& exp, bool isGlobal) const;
-    std::string GenAssignment(const Var& var, int expType, const std::string& exp) const;
-    std::string GenBinaryExp(int expType, const Token& token, const std::string& left, const std::string& right) const;
-    std::string GenList(const std::vector<Expression>& values) const;
-    std::string GenDict(const std::vector<Expression>& keys, const std::vector<Expression>& values) const;
+    std::string GenAssignment(const Var& var, int expType, const std::string& exp, bool isGlobal) const;
+    std::string GenBinaryExp(int expType, int tokenType, const std::string& left, const std::string& right) const;
+    std::string GenList(const std::string& listCode, const std::vector<Expression>& values, int elemType) const;
+    std::string GenDict(const std::string& dictCode, const std::vector<Expression>& keys, const std::vector<Expression>& values) const;
     std::string GenNotExp(const Expression& exp) const;
     std::string GenCastExp(int castType, int expType, const std::string& exp) const;
     std::string GenNegExp(const std::string& exp) const;
     std::string GenGroupExp(const std::string& exp) const;
-    std::string GenFunctionCall(const Function& func, const std::string& args) const;
-    std::string GenArgs(const Function& func, const std::vector<Expression>& args) const;
-    std::string GenVar(const Var& var) const;
-    std::string GenLiteral(const Token& token) const;
-    std::string GenListGetter(int type, const std::string& listCode, const std::string& indexCode) const;
-    std::string GenListSetter(const std::string& listCode, const std::string& indexCode, const Expression& valueExp) const;
-    std::string GenDictGetter(int type, const std::string& dictCode, const std::string& indexCode) const;
-    std::string GenDictSetter(const std::string& dictCode, const std::string& indexCode, const Expression& valueExp) const;
-    std::string GenIndent(int level) const;
-private:
+    std::string GenFunctionCall(const std::string& name, const std::string& args) const;
+    std::string GenArgs(const std::vector<Expression>& args) const;
+    std::string GenVar(const Var& var, bool isGlobal) const;
+    std::string GenLiteral(int op, const std::string& data) const;
+    std::string GenNew(int type, const std::string& args) const;
+    std::string GenFieldGetter(const std::string& objectCode, const Var& field) const;
+    std::string GenFieldSetter(const std::string& objectCode, const Var& field, const Expression& valueExp) const;
+    std::string GenListGetter(int type, const std::string& listCode, const std::string& indexCode, int elemType) const;
+    std::string GenListSetter(const std::string& listCode, const std::string& indexCode, const Expression& valueExp, int elemType) const;
+    std::string GenDictKey(const IrNode* node) const;
+    std::string GenDictGetter(int type, const std::string& dictCode, const std::string& indexCode, bool cached) const;
+    std::string GenDictSetter(const std::string& dictCode, const std::string& indexCode, const Expression& valueExp, bool cached) const;
     std::string GenFunctionHeader(const Function& func) const;
     std::string GenParams(const Function& func) const;
     static std::string GenType(int type);
-    std::string GenVarDefs(const std::vector<Var>& locals, const std::string& indent) const;
+    void GenVarDefs(const std::vector<Var>& vars, int indent, bool isGlobal, Emitter& out) const;
     static std::string GenVarInit(int type);
-    static std::string GenFuncId(const std::string& id);
+    static std::string GenTypeName(int type);
+    static std::string GenTypeId(int type);
+    std::string GenFuncId(const std::string& id) const;
+    std::string GenGlobalId(const std::string& id) const;
     static std::string GenVarId(const std::string& id);
-    static std::string GenFunctionCleanup(const Function* func, const std::vector<Var>& varsInScope, const std::string exclude = "");
+    static std::string GenModuleId(const std::string& module, const std::string& id);
+    static std::string GenInitId(const std::string& module);
+    static std::string GenFunctionCleanup(const std::vector<Var>& varsInScope);
     static std::vector<Var> GetManagedVars(const std::vector<Var>& vars);
     static std::string GenBoolExp(int expType, const std::string& expCode);
     static std::string GenIsStr(int expType);
+    static unsigned int HashKey(const std::string& key);
+    static bool IsPacked(int elemType);
+    static bool IsConcat(const IrNode* node);
 };
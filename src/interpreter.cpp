@@ -0,0 +1,203 @@
+#include <math.h>
+#include <string.h>
+#include "builtins.h"
+#include "error.h"
+#include "interpreter.h"
+#include "token.h"
+#include "../_build/libs/core/litemem.h"
+
+using namespace std;
+
+static int StrCompare(const TChar* a, const TChar* b) {
+    return strcmp(a ? a : "", b ? b : "");
+}
+
+static bool StrEqual(const TChar* a, const TChar* b) {
+    return a == b || (lstr_len(a) == lstr_len(b) && (lstr_len(a) == 0 || memcmp(a, b, lstr_len(a)) == 0));
+}
+
+// Null strings have no length, like empty ones
+static const TChar* StrConcat(const TChar* a, const TChar* b) {
+    return (const TChar*)_AutoDec(lstr_cat(a, b));
+}
+
+static Reg ZeroReg() {
+    Reg reg;
+    reg.i = 0;
+    return reg;
+}
+
+static void Retain(const vector<int>& regs, Reg* base) {
+    for (size_t i = 0; i < regs.size(); ++i) {
+        _IncRef(base[regs[i]].p);
+    }
+}
+
+static void Release(const vector<int>& regs, Reg* base) {
+    for (size_t i = 0; i < regs.size(); ++i) {
+        _DecRef(base[regs[i]].p);
+    }
+}
+
+Interpreter::Interpreter(const BcProgram& program)
+        : program(program), stack(INTERP_STACK_SIZE, ZeroReg()), globals(program.globalTypes.size(), ZeroReg()) {
+    frames.reserve(256);
+}
+
+void Interpreter::Run(const string& appName) {
+    char* argv[] = {(char*)appName.c_str(), NULL};
+    _SetArgs(1, argv);
+
+    const Reg* constants = program.constants.empty() ? NULL : &program.constants[0];
+    Reg* const stackEnd = &stack[0] + stack.size();
+    const BcFunction* func = &program.main;
+    Reg* base = &stack[0];
+    const Instr* ip = &func->code[0];
+    const Instr* in;
+    size_t scope = _AutoDecMark();
+
+    // Dispatch through a table of label addresses where the compiler supports it
+#ifdef __GNUC__
+#define BC_LABEL(op) &&L_##op,
+    static void* const labels[] = { BC_OPCODES(BC_LABEL) };
+#undef BC_LABEL
+#define CASE(op) L_##op:
+#define NEXT() in = ip++; goto *labels[in->op]
+    NEXT();
+#else
+#define CASE(op) case op:
+#define NEXT() break
+    for (;;) {
+    in = ip++;
+    switch (in->op) {
+#endif
+
+#define A base[in->a]
+#define B base[in->b]
+#define C base[in->c]
+#define BINARY(op, field, expr) CASE(op) A.field = (expr); NEXT();
+
+    CASE(OP_LOADK) A = constants[in->Wide()]; NEXT();
+    CASE(OP_MOVE) A = B; NEXT();
+    CASE(OP_MOVEM) {
+        void* prev = A.p;
+        _IncRef(B.p);
+        A = B;
+        _DecRef(prev);
+        NEXT();
+    }
+    CASE(OP_GETG) A = globals[in->Wide()]; NEXT();
+    CASE(OP_SETG) globals[in->Wide()] = A; NEXT();
+    CASE(OP_SETGM) {
+        Reg& global = globals[in->Wide()];
+        void* prev = global.p;
+        _IncRef(A.p);
+        global = A;
+        _DecRef(prev);
+        NEXT();
+    }
+    BINARY(OP_ADDI, i, B.i + C.i)
+    BINARY(OP_SUBI, i, B.i - C.i)
+    BINARY(OP_MULI, i, B.i * C.i)
+    BINARY(OP_DIVI, i, B.i / C.i)
+    BINARY(OP_MODI, i, B.i % C.i)
+    BINARY(OP_ADDF, f, B.f + C.f)
+    BINARY(OP_SUBF, f, B.f - C.f)
+    BINARY(OP_MULF, f, B.f * C.f)
+    BINARY(OP_DIVF, f, B.f / C.f)
+    BINARY(OP_MODF, f, fmod(B.f, C.f))
+    BINARY(OP_NEGI, i, -B.i)
+    BINARY(OP_NEGF, f, -B.f)
+    BINARY(OP_EQI, i, B.i == C.i)
+    BINARY(OP_NEI, i, B.i != C.i)
+    BINARY(OP_LTI, i, B.i < C.i)
+    BINARY(OP_LEI, i, B.i <= C.i)
+    BINARY(OP_GTI, i, B.i > C.i)
+    BINARY(OP_GEI, i, B.i >= C.i)
+    BINARY(OP_EQF, i, B.f == C.f)
+    BINARY(OP_NEF, i, B.f != C.f)
+    BINARY(OP_LTF, i, B.f < C.f)
+    BINARY(OP_LEF, i, B.f <= C.f)
+    BINARY(OP_GTF, i, B.f > C.f)
+    BINARY(OP_GEF, i, B.f >= C.f)
+    BINARY(OP_EQS, i, StrEqual(B.s, C.s))
+    BINARY(OP_NES, i, !StrEqual(B.s, C.s))
+    BINARY(OP_LTS, i, StrCompare(B.s, C.s) < 0)
+    BINARY(OP_LES, i, StrCompare(B.s, C.s) <= 0)
+    BINARY(OP_GTS, i, StrCompare(B.s, C.s) > 0)
+    BINARY(OP_GES, i, StrCompare(B.s, C.s) >= 0)
+    BINARY(OP_EQP, i, B.p == C.p)
+    BINARY(OP_NEP, i, B.p != C.p)
+    BINARY(OP_CONCAT, s, StrConcat(B.s, C.s))
+    BINARY(OP_ITOF, f, (TFloat)B.i)
+    BINARY(OP_FTOI, i, (TInt)B.f)
+    BINARY(OP_BOOLF, i, B.f != 0)
+    BINARY(OP_BOOLS, i, B.s && B.s[0])
+    BINARY(OP_BOOLP, i, B.p != NULL)
+    BINARY(OP_NOT, i, !B.i)
+    CASE(OP_JMP) ip = &func->code[in->Wide()]; NEXT();
+    CASE(OP_JMPF) if (!A.i) ip = &func->code[in->Wide()]; NEXT();
+    CASE(OP_JMPT) if (A.i) ip = &func->code[in->Wide()]; NEXT();
+    CASE(OP_LOOP) _TrimAutoDec(scope); ip = &func->code[in->Wide()]; NEXT();
+    CASE(OP_CALL) {
+        const BcFunction* callee = &program.functions[in->Wide()];
+        Reg* calleeBase = &A;
+        if (calleeBase + callee->numRegs > stackEnd) Error("Stack overflow in function " + callee->name);
+        Frame frame = {func, ip, base, scope};
+        frames.push_back(frame);
+        for (int i = callee->numParams; i < callee->numRegs; ++i) {
+            calleeBase[i] = ZeroReg();
+        }
+        Retain(callee->managedParams, calleeBase);
+        scope = _AutoDecMark();
+        func = callee;
+        base = calleeBase;
+        ip = &func->code[0];
+        NEXT();
+    }
+    CASE(OP_CALLB) GetBuiltin(in->Wide())(&A); NEXT();
+    CASE(OP_RET)
+    CASE(OP_RETV) {
+        const Reg result = (in->op == OP_RET) ? A : ZeroReg();
+        const bool managed = in->op == OP_RET && IsManaged(func->returnType);
+        // Keep the result alive while the frame is cleaned up, like the generated C code does
+        if (managed) _IncRef(result.p);
+        _DoAutoDecTo(scope);
+        Release(func->managedLocals, base);
+        if (managed) _AutoDec(result.p);
+        base[0] = result;
+        const Frame& frame = frames.back();
+        func = frame.func;
+        ip = frame.ip;
+        base = frame.base;
+        scope = frame.scope;
+        frames.pop_back();
+        NEXT();
+    }
+    CASE(OP_END) {
+        _DoAutoDec();
+        ReleaseGlobals();
+        return;
+    }
+
+#ifndef __GNUC__
+    }
+    }
+#endif
+
+#undef A
+#undef B
+#undef C
+#undef BINARY
+#undef CASE
+#undef NEXT
+}
+
+void Interpreter::ReleaseGlobals() {
+    for (size_t i = 0; i < globals.size(); ++i) {
+        if (IsManaged(program.globalTypes[i])) {
+            _DecRef(globals[i].p);
+            globals[i].p = NULL;
+        }
+    }
+}
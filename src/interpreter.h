@@ -0,0 +1,26 @@
+#pragma once
+
+#include "bytecode.h"
+
+// Number of registers available to all active frames
+#define INTERP_STACK_SIZE 1048576
+
+class Interpreter {
+public:
+    Interpreter(const BcProgram& program);
+    void Run(const std::string& appName);
+private:
+    struct Frame {
+        const BcFunction* func;
+        const Instr* ip;
+        Reg* base;
+        size_t scope;   // Autorelease mark of the caller
+    };
+
+    const BcProgram& program;
+    std::vector<Reg> stack;
+    std::vector<Reg> globals;
+    std::vector<Frame> frames;
+
+    void ReleaseGlobals();
+};
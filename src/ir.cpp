@@ -0,0 +1,43 @@
+#include "ir.h"
+#include "token.h"
+
+using namespace std;
+
+IrProgram::IrProgram() : main(NULL), numDictSites(0) {
+    main = NewNode(IR_BLOCK, TYPE_VOID);
+}
+
+IrProgram::~IrProgram() {
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        delete nodes[i];
+    }
+}
+
+IrNode* IrProgram::NewNode(int kind, int type) {
+    IrNode* node = new IrNode(kind, type);
+    nodes.push_back(node);
+    return node;
+}
+
+void IrProgram::AdoptNodes(IrProgram& other) {
+    nodes.insert(nodes.end(), other.nodes.begin(), other.nodes.end());
+    other.nodes.clear();
+}
+
+bool MakesTemporaries(const IrNode* node) {
+    // Reading a variable or field does not allocate, and statements take the type of what they assign
+    const bool reads = node->kind == IR_VAR || node->kind == IR_FIELDGET;
+    if (IsManaged(node->type) && !reads && node->kind < IR_BLOCK) return true;
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        if (MakesTemporaries(node->children[i])) return true;
+    }
+    return false;
+}
+
+size_t CountReads(const IrNode* node, int local) {
+    size_t count = (node->kind == IR_VAR && !node->global && node->index == local) ? 1 : 0;
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        count += CountReads(node->children[i], local);
+    }
+    return count;
+}
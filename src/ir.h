@@ -0,0 +1,97 @@
+#pragma once
+
+#include <map>
+#include "common.h"
+#include "lib.h"
+
+// Expressions
+#define IR_LITERAL 1
+#define IR_VAR 2
+#define IR_CALL 3
+#define IR_LIBCALL 4
+#define IR_BINARY 5
+#define IR_NOT 6
+#define IR_NEG 7
+#define IR_GROUP 8
+#define IR_CAST 9
+#define IR_LIST 10
+#define IR_DICT 11
+#define IR_LISTGET 12
+#define IR_DICTGET 13
+#define IR_NEW 14
+#define IR_FIELDGET 15
+
+// Statements
+#define IR_BLOCK 20
+#define IR_EXPSTMT 21
+#define IR_VARDEF 22
+#define IR_ASSIGN 23
+#define IR_LISTSET 24
+#define IR_DICTSET 25
+#define IR_IF 26
+#define IR_ELSEIF 27
+#define IR_ELSE 28
+#define IR_FOR 29
+#define IR_WHILE 30
+#define IR_RETURN 31
+#define IR_FIELDSET 32
+
+struct IrNode {
+    int kind;
+    int type;       // Type of the value produced, or of the variable being assigned
+    int op;         // Token type of literals and operators
+    int argType;    // Type of the operands of binary, not and cast expressions, or of the elements of lists
+                    // packed without tags
+    int index;      // Slot of variables, functions and record fields, number of locals in scope on returns,
+                    // cache of dict accesses with a constant key, or static string of transient literals
+    bool global;    // Whether the slot of a variable refers to a global
+    bool transient; // String literal whose contents are only read, so it needs no managed copy
+    std::string data;   // Value of literals, or name of variables, functions, records and fields
+    std::vector<IrNode*> children;
+
+    IrNode(int kind, int type)
+            : kind(kind), type(type), op(0), argType(TYPE_VOID), index(-1), global(false), transient(false) {
+    }
+};
+
+// Whether evaluating the node, or anything below it, can leave autoreleased values behind
+bool MakesTemporaries(const IrNode* node);
+
+// Times the node, or anything below it, reads the given local
+size_t CountReads(const IrNode* node, int local);
+
+struct IrFunction {
+    Function func;
+    std::vector<Var> locals;    // Includes the parameters first
+    std::vector<bool> owned;    // Per local, whether its value never escapes the function
+    IrNode* block;
+
+    IrFunction(const Function& func, const std::vector<Var>& locals, IrNode* block)
+            : func(func), locals(locals), owned(locals.size(), false), block(block) {
+    }
+};
+
+class IrProgram {
+public:
+    std::vector<Function> functions;    // Every function declared, in source order
+    std::vector<IrFunction> definitions;
+    std::vector<Var> globals;
+    std::vector<Record> records;        // The type of each record is its index + 1
+    IrNode* main;
+    std::vector<std::string> imports;       // Names of the modules imported, in order
+    std::vector<Function> externFunctions;  // Exported by the imported modules
+    std::vector<Var> externGlobals;
+    std::map<std::string, std::string> externModules;  // Module that exports each function and global imported
+    size_t numDictSites;    // Dict accesses with a constant key, which cache where they found it
+    std::vector<std::string> strings;   // Literals that are only read, stored once as static strings
+
+    IrProgram();
+    ~IrProgram();
+    IrNode* NewNode(int kind, int type);
+    void AdoptNodes(IrProgram& other);     // Takes ownership of the nodes allocated by another program
+private:
+    std::vector<IrNode*> nodes;
+
+    IrProgram(const IrProgram& other);
+    IrProgram& operator=(const IrProgram& other);
+};
@@ -1,13 +1,19 @@
 #if defined(_WIN32)
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#include <process.h>
 #undef LoadString
+#define getpid _getpid
 #elif defined(__APPLE__)
 #include <mach-o/dyld.h>
+#include <unistd.h>
 #else
 #include <unistd.h>
 #endif
+#include <stdio.h>
+#include "cache.h"
 #include "leaf.h"
+#include "parallel.h"
 #include "swan/platform.hh"
 #include "../_build/libs/core/core.h"
 
@@ -22,7 +28,42 @@ static string GetFilename(int argc, char** argv) {
     }
 }
 
-static string GetBinDir() {
+static bool HasOption(int argc, char** argv, const string& option) {
+    for (int i = 1; i < argc - 1; ++i) {
+        if (option == argv[i]) return true;
+    }
+    return false;
+}
+
+// Returns the number of threads requested with --jobs=N, or every core for a plain --jobs
+static int GetJobs(int argc, char** argv) {
+    const string option = "--jobs";
+    for (int i = 1; i < argc - 1; ++i) {
+        const string arg = argv[i];
+        if (arg == option) return NumCores();
+        if (arg.compare(0, option.length() + 1, option + "=") == 0) {
+            const int jobs = atoi(arg.c_str() + option.length() + 1);
+            return (jobs > 0) ? jobs : 1;
+        }
+    }
+    return 1;
+}
+
+// Returns the megabytes the arena is limited to with --arena=MB, 0 for a plain --arena, or -1 without it
+static int GetArenaLimit(int argc, char** argv) {
+    const string option = "--arena";
+    for (int i = 1; i < argc - 1; ++i) {
+        const string arg = argv[i];
+        if (arg == option) return 0;
+        if (arg.compare(0, option.length() + 1, option + "=") == 0) {
+            const int limit = atoi(arg.c_str() + option.length() + 1);
+            return (limit > 0) ? limit : 0;
+        }
+    }
+    return -1;
+}
+
+static string GetExePath() {
     char path[FILENAME_MAX];
 #if defined(_WIN32)
     path[GetModuleFileNameA(NULL, path, FILENAME_MAX)] = 0;
@@ -32,64 +73,241 @@ static string GetBinDir() {
 #else
     path[readlink("/proc/self/exe", path, FILENAME_MAX)] = 0;
 #endif
-    return ExtractDir(path);
+    return path;
+}
+
+static string GetBinDir() {
+    return ExtractDir(GetExePath().c_str());
 }
 
 static string GetRootDir() {
-    const string path = Replace(GetBinDir().c_str(), "\\", "/");
-    struct TList* components = Split(path.c_str(), "/");
-    RemoveIndex(components, ListSize(components) - 1);
-    const string str = Join(components, "/");
+    const string str = ExtractDir(swan::strmanip::replaceall(GetBinDir(), "\\", "/").c_str());
     _DoAutoDec();
     return str;
 }
 
+// The runtime and the compiler itself are identified by their stamps instead of their contents, so a
+// new version never picks stale binaries without reading them on every run
+static string GetCompilerKey(const string& lib, const string& rootDir, const string& flags) {
+    vector<string> contents;
+    contents.push_back(lib);
+    contents.push_back(GetFileStamp(rootDir + "/libs/core/core.c"));
+    contents.push_back(GetFileStamp(rootDir + "/libs/core/core.h"));
+    contents.push_back(GetFileStamp(rootDir + "/libs/core/litemem.h"));
+    contents.push_back(GetFileStamp(rootDir + "/libs/core/stb_ds.h"));
+    contents.push_back(flags);
+    contents.push_back(GetFileStamp(GetExePath()));
+    return HashContents(contents);
+}
+
+static string GetCacheKey(const string& file, const string& compilerKey, const vector<Module*>& modules) {
+    vector<string> contents;
+    contents.push_back(file);
+    contents.push_back(compilerKey);
+    for (size_t i = 0; i < modules.size(); ++i) {
+        contents.push_back(modules[i]->key);
+    }
+    return HashContents(contents);
+}
+
+// Each variant of the runtime, built with different defines, is kept in its own archive
+static string GetCoreArchive(const string& rootDir, const string& variant, const string& defines) {
+    const string coreDir = rootDir + "/libs/core";
+    const string archive = coreDir + "/libleafcore" + variant + ".a";
+    vector<string> sources;
+    sources.push_back(coreDir + "/core.c");
+    sources.push_back(coreDir + "/core.h");
+    sources.push_back(coreDir + "/litemem.h");
+    sources.push_back(coreDir + "/stb_ds.h");
+    if (!IsOutdated(archive, sources)) return archive;
+
+    // Rebuild the archive once, so following compilations can just link it
+    const string pid = swan::strmanip::fromint((int)getpid());
+    const string objFilename = archive + "." + pid + ".o";
+    const string tmpFilename = archive + "." + pid + ".tmp";
+    const bool built =
+        System(("gcc -c \"" + coreDir + "/core.c\" -o \"" + objFilename + "\" -w -O2" + defines).c_str()) == 0
+        && System(("ar rcs \"" + tmpFilename + "\" \"" + objFilename + "\"").c_str()) == 0;
+    DeleteFile(objFilename.c_str());
+#ifdef _WIN32
+    if (built) DeleteFile(archive.c_str());
+#endif
+    if (built && rename(tmpFilename.c_str(), archive.c_str()) == 0) return archive;
+    DeleteFile(tmpFilename.c_str());
+    return "";
+}
+
+static void RunBinary(const string& binFilename, const string& appName, bool replace) {
+#ifndef _WIN32
+    // Replace this process with the program, so a cache hit only costs a process spawn
+    if (replace) {
+        execl(binFilename.c_str(), appName.c_str(), (char*)NULL);
+        Error("Could not execute " + binFilename);
+    }
+#endif
+    System(("\"" + binFilename + "\"").c_str());
+}
+
 int main(int argc, char** argv) {
     const string filename = GetFilename(argc, argv);
-    const string file = Replace(Replace(LoadString(filename.c_str()), "\r\n", "\n"), "\r", "\n");
+    const bool interpret = HasOption(argc, argv, "--interp");
+    const bool useCache = !interpret && !HasOption(argc, argv, "--no-cache");
+    const int jobs = GetJobs(argc, argv);
+    const int arenaLimit = GetArenaLimit(argc, argv);
+    if (interpret && arenaLimit != -1) Error("The arena cannot be used when running with --interp");
+    const bool nanbox = HasOption(argc, argv, "--nanbox");
+    if (interpret && nanbox) Error("Values cannot be NaN-boxed when running with --interp");
+    const bool timeJson = HasOption(argc, argv, "--time-passes=json");
+    PassTimer timer(timeJson || HasOption(argc, argv, "--time-passes"));
+
+    timer.Start("load");
+    const string file = LoadString(filename.c_str());
     if (file == "") Error("Could not load source file or it is empty.");
     const string prevDir = CurrentDir();
     ChangeDir(GetBinDir().c_str());
-    const string lib = Replace(Replace(LoadString("../libs/core/core.lb"), "\r\n", "\n"), "\r", "\n");
+    const string lib = LoadString("../libs/core/core.lb");
     if (lib == "") Error("Could not load core module or it is empty.");
     ChangeDir(prevDir.c_str());
     _DoAutoDec();
 
-    const vector<Token> tokens = ParseTokens(file, filename);
-    Parser parser(tokens);
-    parser.ParseLibrary(ParseTokens(lib, "library"));
-    parser.Parse();
-    
-    const string outFilename = string(StripExt(filename.c_str())) + ".c";
-    SaveString(outFilename.c_str(), parser.GetCode().c_str(), false);
-
     const string rootDir = GetRootDir();
 #ifdef _WIN32
     const string binFilename = string(StripExt(filename.c_str())) + ".exe";
 #else
     const string binFilename = StripExt(filename.c_str());
 #endif
+    const string arenaId = (arenaLimit > 0) ? swan::strmanip::fromint(arenaLimit) : "";
+    const string runtimeVariant = ((arenaLimit != -1) ? ("_arena" + arenaId) : "") + (nanbox ? "_nanbox" : "");
+    const string runtimeDefines = ((arenaLimit != -1)
+        ? (" -DLMEM_ARENA" + ((arenaLimit > 0) ? (" -DLMEM_ARENA_LIMIT=" + arenaId) : string("")))
+        : "") + (nanbox ? " -DCORE_NANBOX" : "");
+    const string flags = " -w -lm -O2 -s" + runtimeDefines;
+    timer.Start("lex");
+    const vector<Token> tokens = ParseTokens(file, filename);
+    timer.Count("source_bytes", file.length());
+    timer.Count("tokens", tokens.size());
+    const vector<Token> importNames = FindImports(tokens);
+    if (interpret && !importNames.empty()) {
+        ErrorEx("Modules cannot be imported when running with --interp", importNames[0]);
+    }
+
+    // Imported modules are compiled first, since the binary depends on all of them
+    timer.Start("cache key");
+    const string cacheDir = useCache ? GetCacheDir(rootDir) : "";
+    const string compilerKey = useCache ? GetCompilerKey(lib, rootDir, flags) : "";
+    const bool cacheModules = useCache && !importNames.empty() && CreateDirs(cacheDir + "/modules");
+    timer.Start("modules");
+    ModuleBuilder modules(lib, compilerKey, cacheModules ? (cacheDir + "/modules") : "", rootDir + "/libs", jobs);
+    const vector<const Module*> imports = modules.BuildImports(tokens, string(ExtractDir(filename.c_str())));
+    timer.Count("modules", modules.GetModules().size());
+
+    string cachedFilename;
+    if (useCache) {
+        timer.Start("cache lookup");
+        cachedFilename = cacheDir + "/" + GetCacheKey(file, compilerKey, modules.GetModules());
+#ifdef _WIN32
+        cachedFilename += ".exe";
+#endif
+        if (FileExists(cachedFilename)) {
+            TouchFile(cachedFilename);
+            modules.DeleteTemporaries();
+            timer.Start("run");
+            RunBinary(cachedFilename, binFilename, !timer.IsEnabled());
+            timer.Stop();
+            timer.Report(timeJson);
+            return 0;
+        }
+        if (!CreateDirs(cacheDir)) cachedFilename = "";
+    }
+
+    timer.Start("parse library");
+    Parser parser(tokens);
+    parser.ParseLibrary(ParseTokens(lib, "library"));
+    ImportModules(parser, imports);
+    timer.Start("parse");
+    parser.Parse(jobs);
+    timer.Count("functions", parser.GetProgram().definitions.size());
+    timer.Count("globals", parser.GetProgram().globals.size());
+    if (interpret && !parser.GetProgram().records.empty()) {
+        Error("Records cannot be used when running with --interp");
+    }
+    timer.Start("optimize");
+    Optimizer().FoldConstants(parser.GetProgram());
+    Optimizer().AnalyzeEscapes(parser.GetProgram());
+    Optimizer().NumberDictSites(parser.GetProgram());
+    Optimizer().InferListTypes(parser.GetProgram());
+
+    if (interpret) {
+        // Run the program in this process, without generating C or invoking the compiler
+        timer.Start("bytecode");
+        BcProgram program;
+        BytecodeGen(parser.GetLib()).GenProgram(parser.GetProgram(), program);
+        timer.Start("run");
+        Interpreter(program).Run(binFilename);
+        timer.Stop();
+        timer.Report(timeJson);
+        return 0;
+    }
+    
+    timer.Start("generate");
+    const string outFilename = string(StripExt(filename.c_str())) + ".c";
+    FILE* outFile = fopen(outFilename.c_str(), "wb");
+    if (!outFile) Error("Could not write " + outFilename);
+    {
+        // Write the code to the file as it is generated instead of building it in memory first
+        Emitter out(outFile);
+        Generator().GenProgram(parser.GetProgram(), out, jobs);
+    }
+    timer.Count("c_bytes", ftell(outFile));
+    fclose(outFile);
+
+    // Build into a temporary name first, so concurrent runs never see a partial binary
+    const string tmpFilename = (cachedFilename != "")
+        ? cachedFilename + "." + swan::strmanip::fromint((int)getpid()) + ".tmp"
+        : binFilename;
+    // Link the prebuilt runtime, and only compile it from source if it is not available
+    timer.Start("gcc");
+    const string archive = GetCoreArchive(rootDir, runtimeVariant, runtimeDefines);
+    const string runtime = (archive != "") ? archive : (rootDir + "/libs/core/core.c");
+    string objects;
+    for (size_t i = 0; i < modules.GetModules().size(); ++i) {
+        objects += " \"" + modules.GetModules()[i]->object + "\"";
+    }
     const TInt result = System((
         string("gcc")
-        + " -o \"" + binFilename + "\""
+        + " -o \"" + tmpFilename + "\""
         + " \"" + outFilename + "\""
-        + " \"" + rootDir + "/libs/core/core.c\""
+        + objects
+        + " \"" + runtime + "\""
         + " -I\"" + rootDir + "/libs\""
-        + " -w -lm -O2 -s"
+        + flags
         ).c_str());
+    modules.DeleteTemporaries();
     
     if (result == 0) {
+        DeleteFile(outFilename.c_str());
+        if (cachedFilename != "" && rename(tmpFilename.c_str(), cachedFilename.c_str()) == 0) {
+            _DoAutoDec();
+            PruneCache(cacheDir, GetCacheLimit());
+            timer.Start("run");
+            RunBinary(cachedFilename, binFilename, !timer.IsEnabled());
+            timer.Stop();
+            timer.Report(timeJson);
+            return 0;
+        }
 #ifdef _WIN32
-        const string command = binFilename;
+        const string command = tmpFilename;
 #else
-        const string command = (string(ExtractDir(binFilename.c_str())) == "")
-            ? ("./" + binFilename)
-            : binFilename;
+        const string command = (string(ExtractDir(tmpFilename.c_str())) == "")
+            ? ("./" + tmpFilename)
+            : tmpFilename;
 #endif
+        timer.Start("run");
         System(command.c_str());
-        DeleteFile(binFilename.c_str());
-        DeleteFile(outFilename.c_str());
+        DeleteFile(tmpFilename.c_str());
     }
+    timer.Stop();
+    timer.Report(timeJson);
     
     _DoAutoDec();
     return 0;
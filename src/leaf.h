@@ -1,5 +1,10 @@
 #pragma once
 
 #include "error.h"
+#include "generator.h"
+#include "interpreter.h"
+#include "module.h"
+#include "optimizer.h"
 #include "parser.h"
+#include "timing.h"
 #include "token.h"
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "symbol_table.h"
 
 struct Var {
     const std::string name;
@@ -53,6 +54,32 @@ private:
     }
 };
 
-typedef std::vector<Function> Lib;
+struct Record {
+    const std::string name;
+    const std::vector<Var> fields;
+
+    Record(const std::string& name, const std::vector<Var>& fields) : name(name), fields(fields) {
+    }
+
+    // Copy constructor and assignment operator are required by some old compilers
+    Record(const Record& other) : name(other.name), fields(other.fields) {
+    }
+
+    Record& operator=(const Record& other) {
+        const_cast<std::string&>(name) = other.name;
+        const_cast<std::vector<Var>&>(fields) = other.fields;
+        return *this;
+    }
+
+    // Returns the slot of the field, or -1
+    int FindField(const std::string& field) const {
+        for (size_t i = 0; i < fields.size(); ++i) {
+            if (fields[i].name == field) return (int)i;
+        }
+        return -1;
+    }
+};
+
+typedef SymbolTable<Function> Lib;
 
 size_t FindLibFunction(const Lib& lib, const std::string& name);
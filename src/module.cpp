@@ -0,0 +1,220 @@
+#if defined(_WIN32)
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <algorithm>
+#include "cache.h"
+#include "error.h"
+#include "generator.h"
+#include "module.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "../_build/libs/core/core.h"
+
+using namespace std;
+using namespace swan;
+
+static string LoadFile(const string& filename) {
+    const string contents = LoadString(filename.c_str());
+    _DoAutoDec();
+    return contents;
+}
+
+static string GetFullPath(const string& filename) {
+    const string path = FullPath(filename.c_str());
+    _DoAutoDec();
+    return path;
+}
+
+static string GetDir(const string& filename) {
+    const string dir = ExtractDir(filename.c_str());
+    _DoAutoDec();
+    return dir;
+}
+
+static string TypeTag(int type) {
+    switch (type) {
+    case TYPE_INT:
+        return ":Int";
+    case TYPE_FLOAT:
+        return ":Float";
+    case TYPE_STRING:
+        return ":String";
+    case TYPE_LIST:
+        return ":List";
+    case TYPE_DICT:
+        return ":Dict";
+    case TYPE_RAW:
+        return ":Raw";
+    default:
+        return "";
+    }
+}
+
+ModuleBuilder::ModuleBuilder(const string& lib, const string& compilerKey, const string& cacheDir, const string& includeDir, int jobs)
+        : lib(lib), compilerKey(compilerKey), cacheDir(cacheDir), includeDir(includeDir), jobs(jobs) {
+}
+
+ModuleBuilder::~ModuleBuilder() {
+    for (size_t i = 0; i < modules.size(); ++i) {
+        delete modules[i];
+    }
+}
+
+vector<const Module*> ModuleBuilder::BuildImports(const vector<Token>& tokens, const string& dir) {
+    const vector<Token> names = FindImports(tokens);
+    vector<const Module*> imports;
+    for (size_t i = 0; i < names.size(); ++i) {
+        const string filename = ((dir != "") ? (dir + "/") : "") + string(names[i].data) + ".lf";
+        const Module* module = Build(names[i], filename);
+        if (find(imports.begin(), imports.end(), module) == imports.end()) imports.push_back(module);
+    }
+    return imports;
+}
+
+const vector<Module*>& ModuleBuilder::GetModules() const {
+    return modules;
+}
+
+void ModuleBuilder::DeleteTemporaries() {
+    for (size_t i = 0; i < temporaries.size(); ++i) {
+        DeleteFile(temporaries[i].c_str());
+    }
+    temporaries.clear();
+}
+
+const Module* ModuleBuilder::Build(const Token& nameToken, const string& filename) {
+    // Module names become part of the C symbols, so they must be unique in the program
+    const string name = nameToken.data;
+    for (size_t i = 0; i < modules.size(); ++i) {
+        if (modules[i]->name != name) continue;
+        if (GetFullPath(modules[i]->filename) != GetFullPath(filename)) {
+            ErrorEx("Module " + name + " already imported from " + modules[i]->filename, nameToken);
+        }
+        return modules[i];
+    }
+    if (find(building.begin(), building.end(), name) != building.end()) {
+        ErrorEx("Circular import of module " + name, nameToken);
+    }
+    const string source = LoadFile(filename);
+    if (source == "") ErrorEx("Could not load module " + name + " from " + filename, nameToken);
+
+    building.push_back(name);
+    const vector<Token> tokens = ParseTokens(source, filename);
+    const vector<const Module*> imports = BuildImports(tokens, GetDir(filename));
+    building.pop_back();
+
+    // Changes to the modules imported only affect this one through their exports
+    Module* module = new Module();
+    module->name = name;
+    module->filename = filename;
+    vector<string> contents;
+    contents.push_back(compilerKey);
+    contents.push_back(name);
+    contents.push_back(source);
+    for (size_t i = 0; i < imports.size(); ++i) {
+        contents.push_back(imports[i]->name);
+        contents.push_back(imports[i]->exports);
+    }
+    module->key = HashContents(contents);
+    modules.push_back(module);
+
+    if (cacheDir != "") {
+        module->object = cacheDir + "/" + module->key + ".o";
+        const string exportsFilename = cacheDir + "/" + module->key + ".lb";
+        if (FileExists(module->object) && FileExists(exportsFilename)) {
+            TouchFile(module->object);
+            TouchFile(exportsFilename);
+            module->exports = LoadFile(exportsFilename);
+            return module;
+        }
+    } else {
+        module->object = filename.substr(0, filename.length() - 3) + ".o";
+        temporaries.push_back(module->object);
+    }
+    Compile(*module, tokens, imports);
+    return module;
+}
+
+void ModuleBuilder::Compile(Module& module, const vector<Token>& tokens, const vector<const Module*>& imports) {
+    Parser parser(tokens);
+    parser.ParseLibrary(ParseTokens(lib, "library"));
+    ImportModules(parser, imports);
+    parser.Parse(jobs);
+    Optimizer().FoldConstants(parser.GetProgram());
+    Optimizer().AnalyzeEscapes(parser.GetProgram());
+    Optimizer().NumberDictSites(parser.GetProgram());
+    Optimizer().InferListTypes(parser.GetProgram());
+    module.exports = GenInterface(parser.GetProgram());
+
+    // Build into temporary names first, so concurrent runs never see a partial module
+    const string tmpFilename = module.object + "." + strmanip::fromint((int)getpid()) + ".tmp";
+    const string cFilename = tmpFilename + ".c";
+    FILE* file = fopen(cFilename.c_str(), "wb");
+    if (!file) Error("Could not write " + cFilename);
+    {
+        Emitter out(file);
+        Generator().GenModule(parser.GetProgram(), module.name, out, jobs);
+    }
+    fclose(file);
+    const bool built = System((
+        "gcc -c \"" + cFilename + "\""
+        + " -o \"" + tmpFilename + "\""
+        + " -I\"" + includeDir + "\""
+        + " -w -O2").c_str()) == 0;
+    DeleteFile(cFilename.c_str());
+    if (!built) {
+        DeleteFile(tmpFilename.c_str());
+        Error("Could not compile module " + module.name);
+    }
+    if (cacheDir != "") {
+        const string exportsFilename = cacheDir + "/" + module.key + ".lb";
+        SaveString((tmpFilename + ".lb").c_str(), module.exports.c_str(), false);
+        rename((tmpFilename + ".lb").c_str(), exportsFilename.c_str());
+    }
+#ifdef _WIN32
+    DeleteFile(module.object.c_str());
+#endif
+    rename(tmpFilename.c_str(), module.object.c_str());
+}
+
+vector<Token> FindImports(const vector<Token>& tokens) {
+    vector<Token> names;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (tokens[i].type != TOK_IMPORT) continue;
+        size_t next = i + 1;
+        while (next < tokens.size() && tokens[next].type == TOK_EOL) ++next;
+        if (next < tokens.size() && tokens[next].type == TOK_ID) names.push_back(tokens[next]);
+    }
+    return names;
+}
+
+void ImportModules(Parser& parser, const vector<const Module*>& imports) {
+    for (size_t i = 0; i < imports.size(); ++i) {
+        parser.ParseImport(imports[i]->name, ParseTokens(imports[i]->exports, imports[i]->filename));
+    }
+}
+
+// Records are private to the module that declares them, so anything that refers to one is not exported
+string GenInterface(const IrProgram& program) {
+    string str;
+    for (size_t i = 0; i < program.functions.size(); ++i) {
+        const Function& func = program.functions[i];
+        bool usesRecords = IsRecord(func.type);
+        string params;
+        for (size_t j = 0; j < func.params.size(); ++j) {
+            if (j > 0) params += ", ";
+            params += func.params[j].name + TypeTag(func.params[j].type);
+            usesRecords = usesRecords || IsRecord(func.params[j].type);
+        }
+        if (!usesRecords) str += "function " + func.name + TypeTag(func.type) + "(" + params + ")\n";
+    }
+    for (size_t i = 0; i < program.globals.size(); ++i) {
+        if (IsRecord(program.globals[i].type)) continue;
+        str += program.globals[i].name + TypeTag(program.globals[i].type) + "\n";
+    }
+    return str;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "ir.h"
+#include "token.h"
+
+class Parser;
+
+struct Module {
+    std::string name;
+    std::string filename;
+    std::string key;        // Hash of the source, the compiler and the interfaces of the imported modules
+    std::string exports;    // Declarations of the functions and globals exported, in library syntax
+    std::string object;
+};
+
+// Compiles imported modules into object files, reusing the ones found in the cache
+class ModuleBuilder {
+public:
+    ModuleBuilder(const std::string& lib, const std::string& compilerKey, const std::string& cacheDir, const std::string& includeDir, int jobs);
+    ~ModuleBuilder();
+
+    // Builds the modules imported by the tokens of a source file, and returns them in import order
+    std::vector<const Module*> BuildImports(const std::vector<Token>& tokens, const std::string& dir);
+
+    // Every module built so far, with dependencies before the modules that import them
+    const std::vector<Module*>& GetModules() const;
+
+    // Removes the objects built outside the cache
+    void DeleteTemporaries();
+private:
+    std::string lib;
+    std::string compilerKey;
+    std::string cacheDir;
+    std::string includeDir;
+    int jobs;
+    std::vector<Module*> modules;
+    std::vector<std::string> building;
+    std::vector<std::string> temporaries;
+
+    const Module* Build(const Token& nameToken, const std::string& filename);
+    void Compile(Module& module, const std::vector<Token>& tokens, const std::vector<const Module*>& imports);
+
+    ModuleBuilder(const ModuleBuilder& other);
+    ModuleBuilder& operator=(const ModuleBuilder& other);
+};
+
+std::vector<Token> FindImports(const std::vector<Token>& tokens);
+void ImportModules(Parser& parser, const std::vector<const Module*>& imports);
+std::string GenInterface(const IrProgram& program);
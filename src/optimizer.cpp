@@ -0,0 +1,610 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optimizer.h"
+#include "token.h"
+
+using namespace std;
+
+// How an expression uses the value it produces
+#define USE_KEPT 0      // It may be kept after the statement runs
+#define USE_RETAINED 1  // It may be retained through its reference count, which static strings allow
+#define USE_READ 2      // Only its contents are read
+
+// Elements stored in a list variable, besides their type when they all have the same one
+#define ELEMS_NONE TYPE_VOID    // Nothing stored yet
+#define ELEMS_MIXED 0           // Several types, or lists that may have been created elsewhere
+
+static bool IsFinite(double f) {
+    return f - f == 0;
+}
+
+void Optimizer::FoldConstants(IrProgram& program) {
+    numExterns = program.externGlobals.size();
+    inMain = false;
+    for (size_t i = 0; i < program.definitions.size(); ++i) {
+        locals.clear();
+        globals.clear();
+        FoldBlock(program.definitions[i].block);
+    }
+
+    // Globals are only propagated in the main program, where every function call invalidates them
+    inMain = true;
+    locals.clear();
+    globals.clear();
+    FoldBlock(program.main);
+}
+
+void Optimizer::AnalyzeEscapes(IrProgram& program) {
+    inMain = false;
+    for (size_t i = 0; i < program.definitions.size(); ++i) {
+        IrFunction& def = program.definitions[i];
+        escapes.assign(def.locals.size(), false);
+        reused.assign(def.locals.size(), false);
+        MarkUses(def.block, USE_READ);
+
+        // Parameters are owned by the caller too
+        for (size_t j = def.func.params.size(); j < def.locals.size(); ++j) {
+            const int type = def.locals[j].type;
+            const bool managed = type == TYPE_STRING || type == TYPE_LIST || type == TYPE_DICT;
+            def.owned[j] = managed && !escapes[j] && !reused[j];
+        }
+    }
+
+    // Variables of the main program are globals, so only its literals are considered
+    inMain = true;
+    MarkUses(program.main, USE_READ);
+
+    map<string, int> ids;
+    for (size_t i = 0; i < program.definitions.size(); ++i) {
+        NumberStrings(program.definitions[i].block, program.strings, ids);
+    }
+    NumberStrings(program.main, program.strings, ids);
+}
+
+// Equal literals share the same static string
+void Optimizer::NumberStrings(IrNode* node, vector<string>& strings, map<string, int>& ids) {
+    if (node->kind == IR_LITERAL && node->transient) {
+        map<string, int>::const_iterator it = ids.find(node->data);
+        if (it == ids.end()) {
+            it = ids.insert(make_pair(node->data, (int)strings.size())).first;
+            strings.push_back(node->data);
+        }
+        node->index = it->second;
+    }
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        NumberStrings(node->children[i], strings, ids);
+    }
+}
+
+void Optimizer::NumberDictSites(IrProgram& program) {
+    for (size_t i = 0; i < program.definitions.size(); ++i) {
+        NumberDictSites(program.definitions[i].block, program.numDictSites);
+    }
+    NumberDictSites(program.main, program.numDictSites);
+}
+
+// Keys with escape sequences are left out, since their hash would have to be taken after unescaping
+void Optimizer::NumberDictSites(IrNode* node, size_t& count) {
+    if (node->kind == IR_DICTGET || node->kind == IR_DICTSET) {
+        const IrNode* key = node->children[1];
+        if (key->kind == IR_LITERAL && key->op == TOK_STRINGLITERAL && key->data.find('\\') == string::npos) {
+            node->index = (int)count++;
+        }
+    }
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        NumberDictSites(node->children[i], count);
+    }
+}
+
+void Optimizer::InferListTypes(IrProgram& program) {
+    // Lists from other modules may hold anything
+    numExterns = program.externGlobals.size();
+    globalElems.assign(numExterns, ELEMS_MIXED);
+    globalElems.resize(numExterns + program.globals.size(), ELEMS_NONE);
+    vector<vector<int> > functionElems(program.definitions.size());
+    for (size_t i = 0; i < program.definitions.size(); ++i) {
+        const IrFunction& def = program.definitions[i];
+        localElems.assign(def.func.params.size(), ELEMS_MIXED);
+        localElems.resize(def.locals.size(), ELEMS_NONE);
+        CollectListTypes(def.block);
+        functionElems[i].swap(localElems);
+    }
+    localElems.clear();
+    CollectListTypes(program.main);
+
+    // Every store is known now, so the accesses of each list can be specialized
+    for (size_t i = 0; i < program.definitions.size(); ++i) {
+        localElems.swap(functionElems[i]);
+        PackLists(program.definitions[i].block);
+    }
+    localElems.clear();
+    PackLists(program.main);
+}
+
+// Lists are only packed when created here from literals, and every element stored has the same type
+void Optimizer::CollectListTypes(const IrNode* node) {
+    if ((node->kind == IR_VARDEF || node->kind == IR_ASSIGN) && node->type == TYPE_LIST) {
+        const IrNode* exp = node->children.back();
+        if (exp->kind != IR_LIST) StoreElem(node, ELEMS_MIXED);
+        for (size_t i = 0; exp->kind == IR_LIST && i < exp->children.size(); ++i) {
+            StoreElem(node, exp->children[i]->type);
+        }
+    } else if (node->kind == IR_LISTSET && node->children[0]->kind == IR_VAR) {
+        StoreElem(node->children[0], node->children[2]->type);
+    }
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        CollectListTypes(node->children[i]);
+    }
+}
+
+void Optimizer::StoreElem(const IrNode* var, int type) {
+    int& elems = var->global ? globalElems[var->index] : localElems[var->index];
+    if (type != TYPE_INT && type != TYPE_FLOAT && type != TYPE_STRING) type = ELEMS_MIXED;
+    elems = (elems == ELEMS_NONE || elems == type) ? type : ELEMS_MIXED;
+}
+
+void Optimizer::PackLists(IrNode* node) {
+    if ((node->kind == IR_VARDEF || node->kind == IR_ASSIGN) && node->children.back()->kind == IR_LIST) {
+        node->children.back()->argType = PackedType(node);
+    } else if ((node->kind == IR_LISTGET || node->kind == IR_LISTSET) && node->children[0]->kind == IR_VAR) {
+        node->argType = PackedType(node->children[0]);
+    }
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        PackLists(node->children[i]);
+    }
+}
+
+int Optimizer::PackedType(const IrNode* var) const {
+    const int elems = var->global ? globalElems[var->index] : localElems[var->index];
+    return (elems == ELEMS_MIXED) ? TYPE_VOID : elems;
+}
+
+void Optimizer::MarkUses(IrNode* node, int use) {
+    switch (node->kind) {
+    case IR_LITERAL:
+        // Only literals that are kept need a managed copy, the rest use a static string
+        node->transient = node->op == TOK_STRINGLITERAL && use != USE_KEPT;
+        return;
+    case IR_VAR:
+        if (!node->global && !inMain && use == USE_KEPT) escapes[node->index] = true;
+        return;
+    case IR_VARDEF:
+    case IR_ASSIGN:
+        if (!node->global && !inMain && !IsFresh(node->children.back())) reused[node->index] = true;
+        MarkUses(node->children.back(), USE_KEPT);
+        return;
+    case IR_CALL:
+    case IR_NEW:
+    case IR_RETURN:
+        use = USE_KEPT;
+        break;
+    case IR_BINARY:
+        // Logical operators produce one of their operands, and comparisons retain strings
+        if (node->op == TOK_AND || node->op == TOK_OR) break;
+        use = (node->op >= TOK_EQUAL && node->op <= TOK_LEQUAL) ? USE_RETAINED : USE_READ;
+        break;
+    case IR_GROUP:
+        break;
+    case IR_CAST:
+        if (node->type != node->argType) use = USE_READ;
+        break;
+    case IR_LIST:
+        for (size_t i = 0; i < node->children.size(); ++i) {
+            MarkUses(node->children[i], StoredUse(node->children[i]));
+        }
+        return;
+    case IR_DICT:
+    case IR_LISTSET:
+    case IR_DICTSET:
+        // Containers store their values and dicts retain their keys, while indices and the container
+        // itself are only read
+        for (size_t i = 0; i < node->children.size(); ++i) {
+            const bool isValue = (node->kind == IR_DICT) ? (i % 2 == 1) : (i == 2);
+            const bool isKey = (node->kind == IR_DICT) ? (i % 2 == 0) : (node->kind == IR_DICTSET && i == 1);
+            MarkUses(node->children[i], isValue ? StoredUse(node->children[i]) : isKey ? USE_RETAINED : USE_READ);
+        }
+        return;
+    case IR_FIELDSET:
+        // Fields retain their values, even strings, since records do not copy them
+        MarkUses(node->children[0], USE_READ);
+        MarkUses(node->children[1], USE_KEPT);
+        return;
+    default:
+        // The core library never keeps its arguments, and statements discard their values
+        use = USE_READ;
+    }
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        MarkUses(node->children[i], use);
+    }
+}
+
+// Containers keep a reference to lists and dicts, but store a copy of strings
+int Optimizer::StoredUse(const IrNode* node) {
+    return (node->type == TYPE_STRING) ? USE_RETAINED : USE_KEPT;
+}
+
+// Whether the expression produces a value that no one else references
+bool Optimizer::IsFresh(const IrNode* node) {
+    switch (node->kind) {
+    case IR_LITERAL:
+        return node->op == TOK_STRINGLITERAL;
+    case IR_BINARY:
+        return node->op == TOK_PLUS && node->type == TYPE_STRING;
+    case IR_LIST:
+    case IR_DICT:
+    case IR_NEW:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void Optimizer::FoldBlock(IrNode* block) {
+    for (size_t i = 0; i < block->children.size(); ++i) {
+        FoldStatement(block->children[i]);
+    }
+}
+
+void Optimizer::FoldStatement(IrNode* node) {
+    switch (node->kind) {
+    case IR_IF:
+        FoldIf(node);
+        break;
+    case IR_FOR:
+        FoldStatement(node->children[0]);
+        FoldLoop(node, node->children[0], node->children[3]);
+        break;
+    case IR_WHILE:
+        FoldLoop(node, NULL, node->children[1]);
+        break;
+    default:
+        if (inMain && ContainsCall(node)) globals.clear();
+        for (size_t i = 0; i < node->children.size(); ++i) {
+            FoldExp(node->children[i]);
+        }
+        if (node->kind == IR_VARDEF || node->kind == IR_ASSIGN) Bind(node);
+    }
+}
+
+void Optimizer::FoldIf(IrNode* node) {
+    if (inMain && ContainsCall(node->children[0])) globals.clear();
+    FoldExp(node->children[0]);
+    const map<int, Constant> prevLocals = locals;
+    const map<int, Constant> prevGlobals = globals;
+    FoldBlock(node->children[1]);
+
+    // Each branch starts from the state after evaluating the conditions that precede it
+    map<int, Constant> condLocals = prevLocals;
+    map<int, Constant> condGlobals = prevGlobals;
+    for (size_t i = 2; i < node->children.size(); ++i) {
+        IrNode* child = node->children[i];
+        locals = condLocals;
+        globals = condGlobals;
+        if (child->kind == IR_ELSEIF) {
+            if (inMain && ContainsCall(child->children[0])) globals.clear();
+            FoldExp(child->children[0]);
+            condLocals = locals;
+            condGlobals = globals;
+            FoldBlock(child->children[1]);
+        } else {
+            FoldBlock(child->children[0]);
+        }
+    }
+    locals = prevLocals;
+    globals = prevGlobals;
+    Invalidate(node);
+}
+
+void Optimizer::FoldLoop(IrNode* node, IrNode* assignment, IrNode* block) {
+    // Anything assigned inside the loop is unknown when the condition and body run again
+    Invalidate(node);
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        if (node->children[i] != assignment && node->children[i] != block) FoldExp(node->children[i]);
+    }
+    FoldBlock(block);
+    Invalidate(node);
+}
+
+void Optimizer::FoldExp(IrNode* node) {
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        FoldExp(node->children[i]);
+    }
+    Constant constant;
+    switch (node->kind) {
+    case IR_VAR:
+        FoldVar(node);
+        break;
+    case IR_BINARY:
+        if (node->op == TOK_AND || node->op == TOK_OR) {
+            FoldLogicalExp(node);
+        } else {
+            FoldBinaryExp(node);
+        }
+        break;
+    case IR_NOT:
+        if (GetConstant(node->children[0], constant)) {
+            constant.i = IsTrue(constant) ? 0 : 1;
+            constant.type = TYPE_INT;
+            SetLiteral(node, constant);
+        }
+        break;
+    case IR_NEG:
+        if (GetConstant(node->children[0], constant) && Convert(constant, node->type)) {
+            constant.i = (TInt)(0ULL - (unsigned long long)constant.i);
+            constant.f = -constant.f;
+            SetLiteral(node, constant);
+        }
+        break;
+    case IR_GROUP:
+        if (node->children[0]->kind == IR_LITERAL) Replace(node, node->children[0]);
+        break;
+    case IR_CAST:
+        FoldCastExp(node);
+        break;
+    }
+}
+
+void Optimizer::FoldVar(IrNode* node) {
+    const map<int, Constant>& scope = Scope(node);
+    const map<int, Constant>::const_iterator it = scope.find(node->index);
+    if (it != scope.end()) SetLiteral(node, it->second);
+}
+
+void Optimizer::FoldBinaryExp(IrNode* node) {
+    Constant left, right;
+    if (!GetConstant(node->children[0], left) || !Convert(left, node->argType)
+            || !GetConstant(node->children[1], right) || !Convert(right, node->argType)) {
+        return;
+    }
+    const bool isRelation = IsRelationOp(node->op);
+    Constant result;
+    result.type = node->type;
+    result.i = 0;
+    result.f = 0;
+    int cmp = 0;
+    switch (node->argType) {
+    case TYPE_INT: {
+        // Wrap around on overflow like the generated code does, instead of invoking undefined behavior
+        const unsigned long long l = left.i, r = right.i;
+        cmp = (left.i > right.i) - (left.i < right.i);
+        switch (node->op) {
+        case TOK_PLUS:
+            result.i = (TInt)(l + r);
+            break;
+        case TOK_MINUS:
+            result.i = (TInt)(l - r);
+            break;
+        case TOK_MUL:
+            result.i = (TInt)(l * r);
+            break;
+        case TOK_DIV:
+        case TOK_MOD:
+            // Leave traps for the program to hit at runtime
+            if (right.i == 0 || right.i == -1) return;
+            result.i = (node->op == TOK_DIV) ? (left.i / right.i) : (left.i % right.i);
+            break;
+        }
+        break;
+    }
+    case TYPE_FLOAT:
+        cmp = (left.f > right.f) - (left.f < right.f);
+        switch (node->op) {
+        case TOK_PLUS:
+            result.f = left.f + right.f;
+            break;
+        case TOK_MINUS:
+            result.f = left.f - right.f;
+            break;
+        case TOK_MUL:
+            result.f = left.f * right.f;
+            break;
+        case TOK_DIV:
+            result.f = left.f / right.f;
+            break;
+        case TOK_MOD:
+            result.f = fmod(left.f, right.f);
+            break;
+        }
+        if (!isRelation && !IsFinite(result.f)) return;
+        break;
+    case TYPE_STRING:
+        // Escape sequences are only resolved by the C compiler, and could merge across the operands
+        if (left.s.find('\\') != string::npos || right.s.find('\\') != string::npos) return;
+        cmp = strcmp(left.s.c_str(), right.s.c_str());
+        if (node->op == TOK_PLUS) {
+            result.s = left.s + right.s;
+        } else if (!isRelation) {
+            return;
+        }
+        break;
+    default:
+        return;
+    }
+    if (isRelation) {
+        result.type = TYPE_INT;
+        switch (node->op) {
+        case TOK_EQUAL:
+            result.i = cmp == 0;
+            break;
+        case TOK_NOTEQUAL:
+            result.i = cmp != 0;
+            break;
+        case TOK_GREATER:
+            result.i = cmp > 0;
+            break;
+        case TOK_LESSER:
+            result.i = cmp < 0;
+            break;
+        case TOK_GEQUAL:
+            result.i = cmp >= 0;
+            break;
+        case TOK_LEQUAL:
+            result.i = cmp <= 0;
+            break;
+        }
+    }
+    SetLiteral(node, result);
+}
+
+void Optimizer::FoldLogicalExp(IrNode* node) {
+    Constant left;
+    if (!GetConstant(node->children[0], left)) return;
+
+    // The result is the operand that decides the expression, and the other one is never evaluated
+    const bool pickLeft = (node->op == TOK_AND) ? !IsTrue(left) : IsTrue(left);
+    const IrNode* picked = node->children[pickLeft ? 0 : 1];
+    Constant value;
+    if (GetConstant(picked, value) && Convert(value, node->type)) {
+        SetLiteral(node, value);
+    } else if (picked->type == node->type) {
+        Replace(node, picked);
+    }
+}
+
+void Optimizer::FoldCastExp(IrNode* node) {
+    Constant constant;
+    if (!GetConstant(node->children[0], constant)) return;
+    if (node->type == TYPE_STRING) {
+        if (constant.type == TYPE_INT) {
+            constant.s = Str(constant.i);
+        } else if (constant.type == TYPE_FLOAT) {
+            constant.s = StrF((TFloat)constant.f);
+        }
+        constant.type = TYPE_STRING;
+    } else if (constant.type == TYPE_STRING) {
+        // Escape sequences are only resolved by the C compiler, so those strings are parsed at runtime
+        if (constant.s.find('\\') != string::npos) return;
+        if (node->type == TYPE_INT) {
+            constant.i = Val(constant.s.c_str());
+        } else {
+            constant.f = ValF(constant.s.c_str());
+        }
+        constant.type = node->type;
+    } else if (!Convert(constant, node->type)) {
+        return;
+    }
+    SetLiteral(node, constant);
+}
+
+void Optimizer::Bind(const IrNode* node) {
+    // Globals exported by other modules can be changed by any call into them
+    if (node->global && (!inMain || node->index < (int)numExterns)) return;
+    Constant constant;
+    if (GetConstant(node->children[0], constant) && Convert(constant, node->type)) {
+        Scope(node)[node->index] = constant;
+    } else {
+        Scope(node).erase(node->index);
+    }
+}
+
+void Optimizer::Invalidate(const IrNode* node) {
+    if (node->kind == IR_VARDEF || node->kind == IR_ASSIGN) {
+        Scope(node).erase(node->index);
+    } else if (node->kind == IR_CALL && inMain) {
+        globals.clear();
+    }
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        Invalidate(node->children[i]);
+    }
+}
+
+bool Optimizer::ContainsCall(const IrNode* node) const {
+    if (node->kind == IR_CALL) return true;
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        if (ContainsCall(node->children[i])) return true;
+    }
+    return false;
+}
+
+map<int, Optimizer::Constant>& Optimizer::Scope(const IrNode* node) {
+    return node->global ? globals : locals;
+}
+
+bool Optimizer::GetConstant(const IrNode* node, Constant& constant) {
+    if (node->kind != IR_LITERAL) return false;
+    constant.i = 0;
+    constant.f = 0;
+    constant.s = "";
+    switch (node->op) {
+    case TOK_INTLITERAL:
+        constant.type = TYPE_INT;
+        constant.i = (TInt)strtoll(node->data.c_str(), NULL, 10);
+        return true;
+    case TOK_FLOATLITERAL:
+        constant.type = TYPE_FLOAT;
+        constant.f = strtod(node->data.c_str(), NULL);
+        return true;
+    case TOK_STRINGLITERAL:
+        constant.type = TYPE_STRING;
+        constant.s = node->data;
+        return true;
+    case TOK_TRUELITERAL:
+    case TOK_FALSELITERAL:
+        constant.type = TYPE_INT;
+        constant.i = (node->op == TOK_TRUELITERAL) ? 1 : 0;
+        return true;
+    default:
+        return false;
+    }
+}
+
+void Optimizer::SetLiteral(IrNode* node, const Constant& constant) {
+    char buffer[64];
+    node->kind = IR_LITERAL;
+    node->type = constant.type;
+    node->argType = TYPE_VOID;
+    node->index = -1;
+    node->global = false;
+    node->children.clear();
+    switch (constant.type) {
+    case TYPE_INT:
+        node->op = TOK_INTLITERAL;
+        sprintf(buffer, "%lld", (long long)constant.i);
+        node->data = buffer;
+        break;
+    case TYPE_FLOAT:
+        // Use the shortest representation that reads back as the same number
+        node->op = TOK_FLOATLITERAL;
+        sprintf(buffer, "%.15g", constant.f);
+        if (strtod(buffer, NULL) != constant.f) sprintf(buffer, "%.17g", constant.f);
+        if (!strpbrk(buffer, ".e")) strcat(buffer, ".0");
+        node->data = buffer;
+        break;
+    case TYPE_STRING:
+        node->op = TOK_STRINGLITERAL;
+        node->data = constant.s;
+        break;
+    }
+}
+
+void Optimizer::Replace(IrNode* node, const IrNode* other) {
+    *node = *other;
+}
+
+bool Optimizer::Convert(Constant& constant, int type) {
+    if (constant.type == type) {
+        return true;
+    } else if (constant.type == TYPE_INT && type == TYPE_FLOAT) {
+        constant.f = (double)constant.i;
+    } else if (constant.type == TYPE_FLOAT && type == TYPE_INT) {
+        if (!(constant.f > -9.2e18 && constant.f < 9.2e18)) return false;
+        constant.i = (TInt)constant.f;
+    } else {
+        return false;
+    }
+    constant.type = type;
+    return true;
+}
+
+bool Optimizer::IsTrue(const Constant& constant) {
+    switch (constant.type) {
+    case TYPE_INT:
+        return constant.i != 0;
+    case TYPE_FLOAT:
+        return constant.f != 0;
+    default:
+        return constant.s != "";
+    }
+}
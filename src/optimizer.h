@@ -0,0 +1,64 @@
+#pragma once
+
+#include <map>
+#include "ir.h"
+
+class Optimizer {
+public:
+    // Evaluates expressions whose operands are known at compile time, replacing them with literals
+    void FoldConstants(IrProgram& program);
+
+    // Finds the managed locals that are only assigned new values and never outlive their function, and
+    // the string literals that are only read, which are numbered to be stored statically
+    void AnalyzeEscapes(IrProgram& program);
+
+    // Numbers the dict accesses whose key is a string literal, so each one can cache where it found it
+    void NumberDictSites(IrProgram& program);
+
+    // Finds the list variables that only ever hold elements of one scalar type, so they can be packed
+    void InferListTypes(IrProgram& program);
+private:
+    struct Constant {
+        int type;
+        TInt i;
+        double f;
+        std::string s;
+    };
+
+    std::map<int, Constant> locals;
+    std::map<int, Constant> globals;
+    size_t numExterns;
+    bool inMain;
+    std::vector<bool> escapes;  // Per local, whether its value may be kept beyond its function
+    std::vector<bool> reused;   // Per local, whether it is assigned a value that exists elsewhere
+    std::vector<int> localElems;    // Per local and global, type of the elements stored in the lists
+    std::vector<int> globalElems;   // assigned to it
+
+    void FoldBlock(IrNode* block);
+    void FoldStatement(IrNode* node);
+    void FoldIf(IrNode* node);
+    void FoldLoop(IrNode* node, IrNode* assignment, IrNode* block);
+    void FoldExp(IrNode* node);
+    void FoldVar(IrNode* node);
+    void FoldBinaryExp(IrNode* node);
+    void FoldLogicalExp(IrNode* node);
+    void FoldCastExp(IrNode* node);
+    void Bind(const IrNode* node);
+    void Invalidate(const IrNode* node);
+    bool ContainsCall(const IrNode* node) const;
+    std::map<int, Constant>& Scope(const IrNode* node);
+    void MarkUses(IrNode* node, int use);
+    static void NumberStrings(IrNode* node, std::vector<std::string>& strings, std::map<std::string, int>& ids);
+    static void NumberDictSites(IrNode* node, size_t& count);
+    void CollectListTypes(const IrNode* node);
+    void StoreElem(const IrNode* var, int type);
+    void PackLists(IrNode* node);
+    int PackedType(const IrNode* var) const;
+    static int StoredUse(const IrNode* node);
+    static bool IsFresh(const IrNode* node);
+    static bool GetConstant(const IrNode* node, Constant& constant);
+    static void SetLiteral(IrNode* node, const Constant& constant);
+    static void Replace(IrNode* node, const IrNode* other);
+    static bool Convert(Constant& constant, int type);
+    static bool IsTrue(const Constant& constant);
+};
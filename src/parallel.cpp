@@ -0,0 +1,160 @@
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include <setjmp.h>
+#include "error.h"
+#include "parallel.h"
+
+using namespace std;
+
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+struct Pool {
+    size_t count;
+    size_t next;
+    ParallelTask task;
+    void* data;
+    size_t failedIndex;     // Earliest task that failed, or count
+    string error;
+#if defined(_WIN32)
+    CRITICAL_SECTION mutex;
+#else
+    pthread_mutex_t mutex;
+#endif
+};
+
+struct Worker {
+    Pool* pool;
+    int index;
+    size_t taskIndex;
+    jmp_buf failed;
+};
+
+static THREAD_LOCAL Worker* currentWorker = NULL;
+
+static void Lock(Pool* pool) {
+#if defined(_WIN32)
+    EnterCriticalSection(&pool->mutex);
+#else
+    pthread_mutex_lock(&pool->mutex);
+#endif
+}
+
+static void Unlock(Pool* pool) {
+#if defined(_WIN32)
+    LeaveCriticalSection(&pool->mutex);
+#else
+    pthread_mutex_unlock(&pool->mutex);
+#endif
+}
+
+static bool TakeIndex(Pool* pool, size_t& index) {
+    Lock(pool);
+    index = pool->next;
+    if (pool->next < pool->count) pool->next++;
+    Unlock(pool);
+    return index < pool->count;
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI RunWorker(LPVOID param) {
+#else
+static void* RunWorker(void* param) {
+#endif
+    Worker* worker = (Worker*)param;
+    currentWorker = worker;
+    // A failed task jumps back here, and the worker stops, since the task left its state half updated
+    if (setjmp(worker->failed) == 0) {
+        while (TakeIndex(worker->pool, worker->taskIndex)) {
+            worker->pool->task(worker->pool->data, worker->taskIndex, worker->index);
+        }
+    }
+    currentWorker = NULL;
+    return 0;
+}
+
+void FailTask(const string& message) {
+    Worker* worker = currentWorker;
+    if (!worker) return;
+    Pool* pool = worker->pool;
+    Lock(pool);
+    if (worker->taskIndex < pool->failedIndex) {
+        pool->failedIndex = worker->taskIndex;
+        pool->error = message;
+    }
+    // Tasks are handed out in order, so the ones left all come after the failed one
+    pool->next = pool->count;
+    Unlock(pool);
+    longjmp(worker->failed, 1);
+}
+
+void RunParallel(size_t count, int numWorkers, ParallelTask task, void* data) {
+    if (numWorkers > (int)count) numWorkers = (int)count;
+    if (numWorkers <= 1) {
+        for (size_t i = 0; i < count; ++i) task(data, i, 0);
+        return;
+    }
+
+    Pool pool;
+    pool.count = count;
+    pool.next = 0;
+    pool.task = task;
+    pool.data = data;
+    pool.failedIndex = count;
+    vector<Worker> workers(numWorkers);
+#if defined(_WIN32)
+    InitializeCriticalSection(&pool.mutex);
+    vector<HANDLE> threads(numWorkers - 1);
+#else
+    pthread_mutex_init(&pool.mutex, NULL);
+    vector<pthread_t> threads(numWorkers - 1);
+#endif
+
+    // The calling thread is the last worker
+    for (int i = 0; i < numWorkers; ++i) {
+        workers[i].pool = &pool;
+        workers[i].index = i;
+    }
+    for (int i = 0; i < numWorkers - 1; ++i) {
+#if defined(_WIN32)
+        threads[i] = CreateThread(NULL, 0, RunWorker, &workers[i], 0, NULL);
+#else
+        pthread_create(&threads[i], NULL, RunWorker, &workers[i]);
+#endif
+    }
+    RunWorker(&workers[numWorkers - 1]);
+    for (int i = 0; i < numWorkers - 1; ++i) {
+#if defined(_WIN32)
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+
+#if defined(_WIN32)
+    DeleteCriticalSection(&pool.mutex);
+#else
+    pthread_mutex_destroy(&pool.mutex);
+#endif
+    if (pool.failedIndex < count) Error(pool.error);
+}
+
+int NumCores() {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cores > 0) ? (int)cores : 1;
+#endif
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "common.h"
+
+typedef void (*ParallelTask)(void* data, size_t index, int worker);
+
+// Calls the task for every index below count, using the given number of worker threads.
+// Indices are handed out in increasing order, so each worker sees its indices in order.
+// If tasks fail, the error of the earliest one is reported once every worker has stopped.
+void RunParallel(size_t count, int numWorkers, ParallelTask task, void* data);
+
+// Called with every error. Inside a task run by worker threads, it keeps the message for RunParallel and
+// abandons the task without returning, since exiting would pull the process from under the other workers.
+void FailTask(const std::string& message);
+
+int NumCores();
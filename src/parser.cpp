@@ -1,4 +1,5 @@
 #include "error.h"
+#include "parallel.h"
 #include "parser.h"
 
 using namespace std;
@@ -6,19 +7,48 @@ using namespace std;
 Parser::Parser(const vector<Token>& tokens) : stream(tokens), currentFunc(NULL) {
 }
 
-void Parser::Parse() {
+// Creates a parser for function bodies that shares the declarations of the parent
+Parser::Parser(const Parser* parent) : lib(parent->lib), stream(parent->stream), currentFunc(NULL) {
+    for (size_t i = 0; i < parent->definitions.NumRecords(); ++i) {
+        definitions.AddRecord(*parent->definitions.GetRecord(i));
+    }
+    for (size_t i = 0; i < parent->definitions.NumFunctions(); ++i) {
+        definitions.AddFunction(*parent->definitions.GetFunction(i));
+    }
+}
+
+Parser::~Parser() {
+    for (size_t i = 0; i < workers.size(); ++i) {
+        delete workers[i];
+    }
+}
+
+void Parser::Parse(int jobs) {
+    ScanRecords();
     ScanFunctions();
-    vector<string> functions;
-    vector<string> program;
     while (stream.HasNext()) {
         const Token& token = stream.Peek();
-        if (token.type == TOK_FUNCTION) {
-            functions.push_back(ParseFunctionDef());
+        if (token.type == TOK_IMPORT) {
+            ParseImportStatement();
+        } else if (token.type == TOK_RECORD) {
+            SkipRecord();
+        } else if (token.type != TOK_FUNCTION) {
+            program.main->children.push_back(ParseStatement());
+        } else if (jobs > 1) {
+            DeferFunctionDef();
         } else {
-            program.push_back(ParseStatement(0));
+            ParseFunctionDef();
         }
     }
-    code = generator.GenProgram(functions, program, definitions);
+    if (!deferred.empty()) ParseDeferredFunctions(jobs);
+    for (size_t i = 0; i < definitions.NumRecords(); ++i) {
+        program.records.push_back(*definitions.GetRecord(i));
+    }
+    for (size_t i = 0; i < definitions.NumFunctions(); ++i) {
+        program.functions.push_back(*definitions.GetFunction(i));
+    }
+    const vector<Var>& globals = definitions.GetGlobals();
+    program.globals.assign(globals.begin() + program.externGlobals.size(), globals.end());
 }
 
 void Parser::ParseLibrary(const vector<Token>& tokens) {
@@ -30,17 +60,116 @@ void Parser::ParseLibrary(const vector<Token>& tokens) {
             const Function func = ScanFunctionHeader();
             ParseStatementEnd();
             definitions.ClearLocals();
-            lib.push_back(func);
+            lib.Add(func);
         } else {
-            ErrorEx("Library can only contain function headers", token.file, token.line);
+            ErrorEx("Library can only contain function headers", token);
         }
     }
     stream = prevStream;
 }
 
-void Parser::ScanFunctions() {
+// Declares the functions and globals exported by a module. Must be called before Parse.
+void Parser::ParseImport(const string& module, const vector<Token>& tokens) {
     TokenStream prevStream = stream;
-    stream = TokenStream(*prevStream.tokens);
+    stream = TokenStream(tokens);
+    while (stream.HasNext()) {
+        const Token& token = stream.Peek();
+        const Token& nameToken = stream.Peek((token.type == TOK_FUNCTION) ? 1 : 0);
+        const map<string, string>::const_iterator other = program.externModules.find(nameToken.data);
+        if (other != program.externModules.end()) {
+            const Token* importToken = FindImportToken(prevStream, module);
+            ErrorEx("Identifier exported by modules " + other->second + " and " + module + ": " + string(nameToken.data),
+                importToken ? *importToken : nameToken);
+        }
+        if (token.type == TOK_FUNCTION) {
+            const Function func = ScanFunctionHeader();
+            ParseStatementEnd();
+            definitions.ClearLocals();
+            lib.Add(func);
+            program.externFunctions.push_back(func);
+            program.externModules[func.name] = module;
+        } else if (token.type == TOK_ID && IsType(stream.Peek(1).type)) {
+            const string name = ParseVarName();
+            const Var global(name, GetType(stream.Next().type));
+            ParseStatementEnd();
+            definitions.AddGlobal(global);
+            program.externGlobals.push_back(global);
+            program.externModules[name] = module;
+        } else {
+            ErrorEx("Module interface can only contain function headers and globals", token);
+        }
+    }
+    stream = prevStream;
+    program.imports.push_back(module);
+}
+
+// Errors about the interface of a module are reported on the statement that imports it
+const Token* Parser::FindImportToken(const TokenStream& source, const string& module) {
+    for (size_t i = 0; i + 1 < source.tokens.size(); ++i) {
+        if (source.tokens[i]->type == TOK_IMPORT && string(source.tokens[i + 1]->data) == module) {
+            return source.tokens[i + 1];
+        }
+    }
+    return NULL;
+}
+
+// Records are declared before functions, so every signature can refer to them
+void Parser::ScanRecords() {
+    const int prevOffset = stream.offset;
+    stream.Seek(0);
+    while (stream.HasNext()) {
+        const Token& token = stream.Peek();
+        if (token.type == TOK_FUNCTION) {
+            stream.Skip(1); // function
+            SkipFunction();
+        } else if (token.type == TOK_RECORD) {
+            definitions.AddRecord(ScanRecord());
+        } else {
+            stream.Skip(1);
+        }
+    }
+    stream.Seek(prevOffset);
+}
+
+Record Parser::ScanRecord() {
+    stream.Skip(1); // record
+    const Token& nameToken = stream.Next();
+    const string name = CheckId(nameToken);
+    if (FindLibFunction(lib, name) != -1) {
+        ErrorEx(LibFunctionError(name), nameToken);
+    } else if (definitions.FindRecord(name) != NULL) {
+        ErrorEx("Identifier already used as record: " + name, nameToken);
+    }
+    ParseStatementEnd();
+    vector<Var> fields;
+    while (stream.Peek().type != TOK_END && stream.HasNext()) {
+        const Token& fieldToken = stream.Next();
+        const string field = CheckId(fieldToken);
+        for (size_t i = 0; i < fields.size(); ++i) {
+            if (fields[i].name == field) ErrorEx("Field already declared: " + field, fieldToken);
+        }
+        const Token& typeToken = stream.Next();
+        if (!IsType(typeToken.type)) {
+            ErrorEx("Expected field type", typeToken);
+        }
+        fields.push_back(Var(field, GetType(typeToken.type)));
+        ParseStatementEnd();
+    }
+    ParseEnd();
+    if (fields.empty()) {
+        ErrorEx("Record must have at least one field", nameToken);
+    }
+    return Record(name, fields);
+}
+
+void Parser::SkipRecord() {
+    while (stream.HasNext() && stream.Next().type != TOK_END) {
+    }
+}
+
+void Parser::ScanFunctions() {
+    const int prevOffset = stream.offset;
+    stream.Seek(0);
     while (stream.HasNext()) {
         const Token& token = stream.Peek();
         if (token.type == TOK_FUNCTION) {
@@ -52,7 +181,7 @@ void Parser::ScanFunctions() {
             stream.Skip(1);
         }
     }
-    stream = prevStream;
+    stream.Seek(prevOffset);
 }
 
 Function Parser::ScanFunctionHeader() {
@@ -63,14 +192,16 @@ Function Parser::ScanFunctionHeader() {
     return Function(name, returnType, params);
 }
 
-const string& Parser::ScanFunctionName() {
+string Parser::ScanFunctionName() {
     const Token& nameToken = stream.Next();
     if (nameToken.type != TOK_ID) {
-        ErrorEx("Expected identifier, got '" + nameToken.data + "'", nameToken.file, nameToken.line);
+        ErrorEx("Expected identifier, got '" + nameToken.data + "'", nameToken);
     } else if (FindLibFunction(lib, nameToken.data) != -1) {
-        ErrorEx("Identifier already used as library function: " + nameToken.data, nameToken.file, nameToken.line);
+        ErrorEx(LibFunctionError(nameToken.data), nameToken);
     } else if (definitions.FindFunction(nameToken.data) != NULL) {
-        ErrorEx("Identifier already used as function: " + nameToken.data, nameToken.file, nameToken.line);
+        ErrorEx("Identifier already used as function: " + nameToken.data, nameToken);
+    } else if (definitions.FindRecord(nameToken.data) != NULL) {
+        ErrorEx("Identifier already used as record: " + nameToken.data, nameToken);
     }
     return nameToken.data;
 }
@@ -84,6 +215,7 @@ void Parser::SkipFunction() {
             case TOK_IF:
             case TOK_FOR:
             case TOK_WHILE:
+            case TOK_RECORD:
                 ++block;
                 break;
             case TOK_END:
@@ -93,15 +225,61 @@ void Parser::SkipFunction() {
     }
 }
 
-string Parser::ParseFunctionDef() {
+void Parser::ParseImportStatement() {
+    stream.Skip(1); // import
+    const Token& nameToken = stream.Next();
+    if (nameToken.type != TOK_ID) {
+        ErrorEx("Expected module name, got '" + nameToken.data + "'", nameToken);
+    }
+    ParseStatementEnd();
+}
+
+void Parser::ParseFunctionDef() {
     const Function func = ParseFunctionHeader();
     currentFunc = definitions.FindFunction(func.name);
-    const string block = ParseBlock(1);
-    ParseEnd(0);
-    const string code = generator.GenFunctionDef(func, block, definitions);
+    IrNode* block = ParseBlock();
+    ParseEnd();
+    program.definitions.push_back(IrFunction(func, definitions.GetLocals(), block));
     definitions.ClearLocals();
     currentFunc = NULL;
-    return code;
+}
+
+void Parser::DeferFunctionDef() {
+    deferred.push_back(DeferredFunction(stream.offset, definitions.GetGlobals().size()));
+    const Function func = ParseFunctionHeader();
+    SkipFunction();
+    definitions.ClearLocals();
+    program.definitions.push_back(IrFunction(func, vector<Var>(), NULL));
+}
+
+void Parser::ParseDeferredFunctions(int jobs) {
+    // Bodies only read the declarations, so each worker parses them with its own scope and nodes
+    for (int i = 0; i < jobs; ++i) {
+        workers.push_back(new Parser(this));
+    }
+    RunParallel(deferred.size(), jobs, ParseDeferredTask, this);
+    for (size_t i = 0; i < workers.size(); ++i) {
+        program.AdoptNodes(workers[i]->program);
+        delete workers[i];
+    }
+    workers.clear();
+    deferred.clear();
+}
+
+void Parser::ParseDeferredTask(void* data, size_t index, int worker) {
+    Parser* parent = (Parser*)data;
+    Parser* parser = parent->workers[worker];
+    const DeferredFunction& func = parent->deferred[index];
+
+    // Functions arrive in source order, so the globals visible to each one extend those of the previous
+    const vector<Var>& globals = parent->definitions.GetGlobals();
+    for (size_t i = parser->definitions.GetGlobals().size(); i < func.numGlobals; ++i) {
+        parser->definitions.AddGlobal(globals[i]);
+    }
+    parser->stream.Seek(func.offset);
+    parser->ParseFunctionDef();
+    parent->program.definitions[index] = parser->program.definitions.back();
+    parser->program.definitions.pop_back();
 }
 
 Function Parser::ParseFunctionHeader() {
@@ -112,12 +290,12 @@ Function Parser::ParseFunctionHeader() {
     return Function(name, returnType, params);
 }
 
-const string& Parser::ParseFunctionName() {
+string Parser::ParseFunctionName() {
     const Token& nameToken = stream.Next();
     if (nameToken.type != TOK_ID) {
-        ErrorEx("Expected identifier, got '" + nameToken.data + "'", nameToken.file, nameToken.line);
+        ErrorEx("Expected identifier, got '" + nameToken.data + "'", nameToken);
     } else if (definitions.FindVar(nameToken.data) != NULL) {
-        ErrorEx("Identifier already used for variable: " + nameToken.data, nameToken.file, nameToken.line);
+        ErrorEx("Identifier already used for variable: " + nameToken.data, nameToken);
     }
     return nameToken.data;
 }
@@ -137,32 +315,42 @@ vector<Var> Parser::ParseParams() {
     return params;
 }
 
-const string& Parser::ParseVarName() {
+string Parser::ParseVarName() {
     const Token& nameToken = stream.Next();
     if (nameToken.type != TOK_ID) {
-        ErrorEx("Expected identifier, got '" + nameToken.data + "'", nameToken.file, nameToken.line);
+        ErrorEx("Expected identifier, got '" + nameToken.data + "'", nameToken);
     } else if (FindLibFunction(lib, nameToken.data) != -1) {
-        ErrorEx("Identifier already used as library function: " + nameToken.data, nameToken.file, nameToken.line);
+        ErrorEx(LibFunctionError(nameToken.data), nameToken);
     } else if (definitions.FindFunction(nameToken.data) != NULL) {
-        ErrorEx("Identifier already used as function: " + nameToken.data, nameToken.file, nameToken.line);
+        ErrorEx("Identifier already used as function: " + nameToken.data, nameToken);
+    } else if (definitions.FindRecord(nameToken.data) != NULL) {
+        ErrorEx("Identifier already used as record: " + nameToken.data, nameToken);
     } else if (definitions.FindVar(nameToken.data) != NULL) {
-        ErrorEx("Identifier already used for variable: " + nameToken.data, nameToken.file, nameToken.line);
+        ErrorEx("Identifier already used for variable: " + nameToken.data, nameToken);
     }
     return nameToken.data;
 }
 
+// Functions imported from modules are added to the library, but are reported as such
+string Parser::LibFunctionError(const string& name) const {
+    const map<string, string>::const_iterator it = program.externModules.find(name);
+    return (it != program.externModules.end())
+        ? ("Identifier already imported from module " + it->second + ": " + name)
+        : ("Identifier already used as library function: " + name);
+}
+
 void Parser::ParseOpenParen() {
     const Token& token = stream.Next();
     if (token.type != TOK_OPENPAREN) {
-        ErrorEx("Expected '(', got '" + token.data + "'", token.file, token.line);
+        ErrorEx("Expected '(', got '" + token.data + "'", token);
     }
 }
 
 int Parser::ParseParamType() {
-    if (IsType(stream.Peek().type)) {
-        return GetType(stream.Next().type);
+    if (IsTypeNext()) {
+        return ParseType();
     } else {
-        ErrorEx("Expected parameter type", stream.Peek().file, stream.Peek().line);
+        ErrorEx("Expected parameter type", stream.Peek());
         return TYPE_VOID;
     }
 }
@@ -170,38 +358,56 @@ int Parser::ParseParamType() {
 void Parser::ParseCloseParen() {
     const Token& token = stream.Next();
     if (token.type != TOK_CLOSEPAREN) {
-        ErrorEx("Expected ')', got '" + token.data + "'", token.file, token.line);
+        ErrorEx("Expected ')', got '" + token.data + "'", token);
     }
 }
 
 int Parser::ParseReturnType() {
-    if (IsType(stream.Peek().type)) {
-        return GetType(stream.Next().type);
+    if (IsTypeNext()) {
+        return ParseType();
     } else {
         return TYPE_VOID;
     }
 }
 
-string Parser::ParseBlock(int indent) {
-    string block;
+// Records are written as ':' followed by their name, since only builtin types have tags
+bool Parser::IsTypeNext() const {
+    return IsType(stream.Peek().type)
+        || (stream.Peek().type == TOK_COLON && stream.Peek(1).type == TOK_ID
+            && definitions.FindRecord(stream.Peek(1).data) != NULL);
+}
+
+int Parser::ParseType() {
+    const Token& token = stream.Next();
+    return IsType(token.type) ? GetType(token.type) : definitions.FindRecordType(stream.Next().data);
+}
+
+IrNode* Parser::ParseBlock() {
+    IrNode* block = program.NewNode(IR_BLOCK, TYPE_VOID);
     while (stream.Peek().type != TOK_EOF && stream.Peek().type != TOK_ELSEIF
             && stream.Peek().type != TOK_ELSE && stream.Peek().type != TOK_END) {
-        block += ParseStatement(indent);
+        block->children.push_back(ParseStatement());
     }
     return block;
 }
 
-string Parser::ParseStatement(int indent) {
+IrNode* Parser::ParseStatement() {
+    if (stream.Peek().type == TOK_IMPORT) {
+        ErrorEx("Modules can only be imported at the top level", stream.Peek());
+    } else if (stream.Peek().type == TOK_RECORD) {
+        ErrorEx("Records can only be declared at the top level", stream.Peek());
+    }
     if (IsAssignment()) {
-        const string assignment = generator.GenIndent(indent) + generator.GenStatement(ParseAssignment());
+        IrNode* assignment = ParseAssignment();
         ParseStatementEnd();
         return assignment;
     } else if (IsControl(stream.Peek().type)) {
-        return ParseControlStatement(indent);
+        return ParseControlStatement();
     } else {
-        const Expression exp = ParseExp();
+        IrNode* statement = program.NewNode(IR_EXPSTMT, TYPE_VOID);
+        statement->children.push_back(ParseExp());
         ParseStatementEnd();
-        return generator.GenIndent(indent) + generator.GenStatement(exp.code);
+        return statement;
     }
 }
 
@@ -212,53 +418,47 @@ bool Parser::IsAssignment() const {
 }
 
 int Parser::OffsetAfterIndexing(int offset) const {
+    if (stream.Peek(offset).type == TOK_DOT) offset += 2;
     while (stream.Peek(offset).type == TOK_OPENBRACKET) {
-        ++offset;
-        while (stream.HasNext() && stream.Peek(offset).type != TOK_CLOSEBRACKET) {
-            ++offset;
-        }
-        ++offset;
+        offset = stream.ClosingOffset(offset) + 1;
     }
     return offset;
 }
 
-string Parser::ParseAssignment() {
+IrNode* Parser::ParseAssignment() {
     const Token& nameToken = stream.Peek();
     const string varName = CheckId(nameToken);
     if (definitions.FindFunction(varName) || FindLibFunction(lib, varName) != -1) {
-        ErrorEx("Cannot assign to a function", nameToken.file, nameToken.line);
+        ErrorEx("Cannot assign to a function", nameToken);
     }
     const Var* var = definitions.FindVar(varName);
     if (var == NULL) return ParseVarDef();
     stream.Skip(1); // name
-    if (stream.Peek().type == TOK_OPENBRACKET) {
-        if (var->type == TYPE_LIST) {
-            return ParseListAccess(generator.GenVar(*var), true).code;
-        } else if (var->type == TYPE_DICT) {
-            return ParseDictAccess(generator.GenVar(*var), true).code;
-        } else {
-            ErrorEx("Only lists and dicts can be indexed", nameToken.file, nameToken.line);
-            return "";
-        }
+    if (stream.Peek().type == TOK_DOT) {
+        return ParseFieldAccess(NewVarNode(IR_VAR, *var), nameToken, true);
+    } else if (stream.Peek().type == TOK_OPENBRACKET) {
+        return ParseIndexing(NewVarNode(IR_VAR, *var), nameToken, true);
     } else {
         stream.Skip(1); // =
         const Token token = stream.Peek();
-        const Expression exp = ParseExp();
-        CheckTypes(var->type, exp.type, token);
-        return generator.GenAssignment(*var, exp.type, exp.code);
+        IrNode* exp = ParseExp();
+        CheckTypes(var->type, exp->type, token);
+        IrNode* assignment = NewVarNode(IR_ASSIGN, *var);
+        assignment->children.push_back(exp);
+        return assignment;
     }
 }
 
-const string& Parser::CheckId(const Token& token) const {
+string Parser::CheckId(const Token& token) const {
     if (token.type != TOK_ID) {
-        ErrorEx("Expected identifier, got '" + token.data + "'", token.file, token.line);
+        ErrorEx("Expected identifier, got '" + token.data + "'", token);
     }
     return token.data;
 } 
 
 void Parser::CheckTypes(int expected, int got, const Token& token) {
     if (!AreCompatible(expected, got)) {
-        ErrorEx("Incompatible types", token.file, token.line);
+        ErrorEx("Incompatible types", token);
     }
 }
 
@@ -268,396 +468,443 @@ void Parser::ParseStatementEnd() {
         const Token& token = stream.Peek();
         if (token.type != TOK_SEMICOLON && token.type != TOK_END
                 && token.type != TOK_ELSEIF && token.type != TOK_ELSE) {
-            ErrorEx("Expected ';' or new line, got '" + token.data + "'", token.file, token.line);
+            ErrorEx("Expected ';' or new line, got '" + token.data + "'", token);
         }
         if (token.type == TOK_SEMICOLON) stream.Skip(1);
     }
 }
 
-std::string Parser::ParseControlStatement(int indent) {
+IrNode* Parser::ParseControlStatement() {
     switch (stream.Peek().type) {
     case TOK_IF:
-        return ParseIf(indent);
+        return ParseIf();
         break;
     case TOK_FOR:
-        return ParseFor(indent);
+        return ParseFor();
         break;
     case TOK_WHILE:
-        return ParseWhile(indent);
+        return ParseWhile();
         break;
     case TOK_RETURN:
-        return ParseReturn(indent);
+        return ParseReturn();
     }
-    return "";
+    return NULL;
 }
 
-string Parser::ParseIf(int indent) {
+IrNode* Parser::ParseIf() {
     stream.Skip(1); // if
-    const Expression exp = ParseExp();
+    IrNode* if_ = program.NewNode(IR_IF, TYPE_VOID);
+    if_->children.push_back(ParseExp());
     CheckThen();
-    const string block = ParseBlock(indent + 1);
-    string elseifs;
+    if_->children.push_back(ParseBlock());
     while (stream.Peek().type == TOK_ELSEIF) {
-        elseifs += ParseElseIf(indent);
+        if_->children.push_back(ParseElseIf());
     }
-    string else_;
     if (stream.Peek().type == TOK_ELSE) {
-        else_ = ParseElse(indent);
+        if_->children.push_back(ParseElse());
     }
-    const string end = ParseEnd(indent);
-    return generator.GenIndent(indent) + generator.GenIf(exp, block, elseifs, else_, end);
+    ParseEnd();
+    return if_;
 }
 
 void Parser::CheckThen() {
     const Token& token = stream.Next();
     if (token.type != TOK_THEN) {
-        ErrorEx("Expected 'then', got '" + token.data + "'", token.file, token.line);
+        ErrorEx("Expected 'then', got '" + token.data + "'", token);
     }
 }
 
-string Parser::ParseElseIf(int indent) {
+IrNode* Parser::ParseElseIf() {
     stream.Skip(1); //elseif
-    const Expression exp = ParseExp();
+    IrNode* elseif = program.NewNode(IR_ELSEIF, TYPE_VOID);
+    elseif->children.push_back(ParseExp());
     CheckThen();
-    const string block = ParseBlock(indent + 1);
-    return generator.GenIndent(indent) + generator.GenElseIf(exp, block);
+    elseif->children.push_back(ParseBlock());
+    return elseif;
 }
 
-string Parser::ParseElse(int indent) {
+IrNode* Parser::ParseElse() {
     stream.Skip(1); //else
-    const string block = ParseBlock(indent + 1);
-    return generator.GenIndent(indent) + generator.GenElse(block);
+    IrNode* else_ = program.NewNode(IR_ELSE, TYPE_VOID);
+    else_->children.push_back(ParseBlock());
+    return else_;
 }
 
-string Parser::ParseEnd(int indent) {
+void Parser::ParseEnd() {
     const Token& token = stream.Next();
     if (token.type != TOK_END) {
-        ErrorEx("Expected 'end', got '" + token.data + "'", token.file, token.line);
+        ErrorEx("Expected 'end', got '" + token.data + "'", token);
     }
-    return generator.GenIndent(indent) + generator.GenEnd();
 }
 
-string Parser::ParseFor(int indent) {
+IrNode* Parser::ParseFor() {
     stream.Skip(1); // for
     const Token& varToken = stream.Peek();
-    const string assignment = ParseAssignment();
+    IrNode* for_ = program.NewNode(IR_FOR, TYPE_VOID);
+    for_->children.push_back(ParseAssignment());
     const Var& var = *definitions.FindVar(varToken.data);
-    const Expression to = ParseTo();
-    CheckTypes(var.type, to.type, varToken);
-    const Expression step = ParseStep();
-    CheckTypes(var.type, step.type, varToken);
+    IrNode* to = ParseTo();
+    CheckTypes(var.type, to->type, varToken);
+    IrNode* step = ParseStep();
+    CheckTypes(var.type, step->type, varToken);
     CheckDo();
-    const string block = ParseBlock(indent + 1);
-    const string end = ParseEnd(indent);
-    return generator.GenIndent(indent) + generator.GenFor(var, assignment, to.code, step.code, block, end);
+    for_->children.push_back(to);
+    for_->children.push_back(step);
+    for_->children.push_back(ParseBlock());
+    ParseEnd();
+    return for_;
 }
 
-Expression Parser::ParseTo() {
+IrNode* Parser::ParseTo() {
     const Token& token = stream.Next();
     if (token.type != TOK_TO) {
-        ErrorEx("Expected 'to', got '" + token.data + "'", token.file, token.line);
+        ErrorEx("Expected 'to', got '" + token.data + "'", token);
     }
     return ParseExp();
 }
 
-Expression Parser::ParseStep() {
+IrNode* Parser::ParseStep() {
     if (stream.Peek().type == TOK_STEP) {
         stream.Skip(1); // step
         return ParseExp();
     } else {
-        return Expression(TYPE_INT, "1");
+        IrNode* step = program.NewNode(IR_LITERAL, TYPE_INT);
+        step->op = TOK_INTLITERAL;
+        step->data = "1";
+        return step;
     }
 }
 
 void Parser::CheckDo() {
     const Token& token = stream.Next();
     if (token.type != TOK_DO) {
-        ErrorEx("Expected 'do', got '" + token.data + "'", token.file, token.line);
+        ErrorEx("Expected 'do', got '" + token.data + "'", token);
     }
 }
 
-string Parser::ParseWhile(int indent) {
+IrNode* Parser::ParseWhile() {
     stream.Skip(1); // while
-    const Expression exp = ParseExp();
+    IrNode* while_ = program.NewNode(IR_WHILE, TYPE_VOID);
+    while_->children.push_back(ParseExp());
     CheckDo();
-    const string block = ParseBlock(indent + 1);
-    const string end = ParseEnd(indent);
-    return generator.GenIndent(indent) + generator.GenWhile(exp, block, end);
+    while_->children.push_back(ParseBlock());
+    ParseEnd();
+    return while_;
 }
 
-string Parser::ParseReturn(int indent) {
+IrNode* Parser::ParseReturn() {
     const Token& returnToken = stream.Next();
     if (currentFunc == NULL) {
-        ErrorEx("Cannot use return statement outside a function",
-            returnToken.file, returnToken.line);
+        ErrorEx("Cannot use return statement outside a function", returnToken);
     }
-    Expression exp(TOK_EOF, "");
+    IrNode* return_ = program.NewNode(IR_RETURN, currentFunc->type);
     if (stream.Peek().type != TOK_SEMICOLON) {
         if (currentFunc->type == TYPE_VOID) {
-            ErrorEx("Function cannot return a value", returnToken.file, returnToken.line);
+            ErrorEx("Function cannot return a value", returnToken);
         }
-        exp = ParseExp();
-        CheckTypes(currentFunc->type, exp.type, returnToken);
+        IrNode* exp = ParseExp();
+        CheckTypes(currentFunc->type, exp->type, returnToken);
+        return_->children.push_back(exp);
     } else if (currentFunc->type != TYPE_VOID) {
-        ErrorEx("Function must return a value", returnToken.file, returnToken.line);
+        ErrorEx("Function must return a value", returnToken);
     }
     ParseStatementEnd();
-    return generator.GenIndent(indent) + generator.GenReturn(currentFunc, exp.code, definitions);
+    return_->index = definitions.GetLocals().size();
+    return return_;
 }
 
-string Parser::ParseVarDef() {
+IrNode* Parser::ParseVarDef() {
     const string name = ParseVarName();
     const Token& assignToken = stream.Next();
     if (assignToken.type != TOK_ASSIGN) {
-        ErrorEx("Variables must be initialized", assignToken.file, assignToken.line);
+        ErrorEx("Variables must be initialized", assignToken);
     }
-    const Expression exp = ParseExp();
-    const VarDef def(Var(name, exp.type), exp);
+    IrNode* exp = ParseExp();
+    const Var var(name, exp->type);
     if (currentFunc == NULL) {
-        definitions.AddGlobal(def.var);
+        definitions.AddGlobal(var);
     } else {
-        definitions.AddLocal(def.var);
+        definitions.AddLocal(var);
     }
-    return generator.GenVarDef(def.var, def.initExp.type, def.initExp.code, currentFunc == NULL);
+    IrNode* def = NewVarNode(IR_VARDEF, var);
+    def->children.push_back(exp);
+    return def;
 }
 
-Expression Parser::ParseExp() {
+IrNode* Parser::ParseExp() {
     return ParseOrExp();
 }
 
-Expression Parser::ParseOrExp() {
-    Expression exp = ParseAndExp();
+IrNode* Parser::ParseOrExp() {
+    IrNode* exp = ParseAndExp();
     while (stream.Peek().type == TOK_OR) {
         const Token& token = stream.Next();
-        const Expression exp2 = ParseAndExp();
-        if (!AreCompatible(exp.type, exp2.type)) {
-            ErrorEx("Boolean operands must be of compatible types", token.file, token.line);
+        IrNode* exp2 = ParseAndExp();
+        if (!AreCompatible(exp->type, exp2->type)) {
+            ErrorEx("Boolean operands must be of compatible types", token);
         }
-        const int balancedTypes = BalanceTypes(exp.type, exp2.type);
-        exp = Expression(balancedTypes, generator.GenBinaryExp(balancedTypes, token, exp.code, exp2.code));      
+        const int balancedTypes = BalanceTypes(exp->type, exp2->type);
+        exp = NewBinaryNode(balancedTypes, balancedTypes, token, exp, exp2);
     }
     return exp;
 }
 
-Expression Parser::ParseAndExp() {
-    Expression exp = ParseEqualExp();
+IrNode* Parser::ParseAndExp() {
+    IrNode* exp = ParseEqualExp();
     while (stream.Peek().type == TOK_AND) {
         const Token& token = stream.Next();
-        const Expression exp2 = ParseEqualExp();
-        if (!AreCompatible(exp.type, exp2.type)) {
-            ErrorEx("Boolean operands must be of compatible types", token.file, token.line);
+        IrNode* exp2 = ParseEqualExp();
+        if (!AreCompatible(exp->type, exp2->type)) {
+            ErrorEx("Boolean operands must be of compatible types", token);
         }
-        const int balancedTypes = BalanceTypes(exp.type, exp2.type);
-        exp = Expression(balancedTypes, generator.GenBinaryExp(balancedTypes, token, exp.code, exp2.code));
+        const int balancedTypes = BalanceTypes(exp->type, exp2->type);
+        exp = NewBinaryNode(balancedTypes, balancedTypes, token, exp, exp2);
     }
     return exp;
 }
 
-Expression Parser::ParseEqualExp() {
-    Expression exp = ParseRelExp();
+IrNode* Parser::ParseEqualExp() {
+    IrNode* exp = ParseRelExp();
     while (stream.Peek().type == TOK_EQUAL || stream.Peek().type == TOK_NOTEQUAL) {
         const Token& token = stream.Next();
-        const Expression exp2 = ParseRelExp();
-        CheckTypes(exp.type, exp2.type, token);
-        const int expType = BalanceTypes(exp.type, exp2.type);
-        exp = Expression(TYPE_INT, generator.GenBinaryExp(expType, token, exp.code, exp2.code));
+        IrNode* exp2 = ParseRelExp();
+        CheckTypes(exp->type, exp2->type, token);
+        const int expType = BalanceTypes(exp->type, exp2->type);
+        exp = NewBinaryNode(TYPE_INT, expType, token, exp, exp2);
     }
     return exp;
 }
 
-Expression Parser::ParseRelExp() {
-    Expression exp = ParseAddExp();
+IrNode* Parser::ParseRelExp() {
+    IrNode* exp = ParseAddExp();
     while (stream.Peek().type == TOK_LESSER || stream.Peek().type == TOK_LEQUAL
             || stream.Peek().type == TOK_GREATER || stream.Peek().type == TOK_GEQUAL) {
         const Token& token = stream.Next();
-        if (exp.type != TYPE_INT && exp.type != TYPE_FLOAT && exp.type != TYPE_STRING) {
-            ErrorEx("Relational operators can only be applied to numeric and string types",
-                token.file, token.line);
+        if (exp->type != TYPE_INT && exp->type != TYPE_FLOAT && exp->type != TYPE_STRING) {
+            ErrorEx("Relational operators can only be applied to numeric and string types", token);
         }
-        const Expression exp2 = ParseAddExp();
-        CheckTypes(exp.type, exp2.type, token);
-        const int expType = BalanceTypes(exp.type, exp2.type);
-        exp = Expression(TYPE_INT, generator.GenBinaryExp(expType, token, exp.code, exp2.code));
+        IrNode* exp2 = ParseAddExp();
+        CheckTypes(exp->type, exp2->type, token);
+        const int expType = BalanceTypes(exp->type, exp2->type);
+        exp = NewBinaryNode(TYPE_INT, expType, token, exp, exp2);
     }
     return exp;
 }
 
-Expression Parser::ParseAddExp() {
-    Expression exp = ParseMulExp();
+IrNode* Parser::ParseAddExp() {
+    IrNode* exp = ParseMulExp();
     while (stream.Peek().type == TOK_PLUS || stream.Peek().type == TOK_MINUS) {
         const Token& token = stream.Next();
-        if (token.type == TOK_PLUS && exp.type != TYPE_INT && exp.type != TYPE_FLOAT && exp.type != TYPE_STRING) {
-            ErrorEx("Addition can only be applied to numeric and string types", token.file, token.line);
-        } else if (token.type == TOK_MINUS && exp.type != TYPE_INT && exp.type != TYPE_FLOAT) {
-            ErrorEx("Subtraction can only be applied to numeric types", token.file, token.line);
+        if (token.type == TOK_PLUS && exp->type != TYPE_INT && exp->type != TYPE_FLOAT && exp->type != TYPE_STRING) {
+            ErrorEx("Addition can only be applied to numeric and string types", token);
+        } else if (token.type == TOK_MINUS && exp->type != TYPE_INT && exp->type != TYPE_FLOAT) {
+            ErrorEx("Subtraction can only be applied to numeric types", token);
         }
-        const Expression exp2 = ParseMulExp();
-        CheckTypes(exp.type, exp2.type, token);
-        const int expType = BalanceTypes(exp.type, exp2.type);
-        exp = Expression(expType, generator.GenBinaryExp(expType, token, exp.code, exp2.code));
+        IrNode* exp2 = ParseMulExp();
+        CheckTypes(exp->type, exp2->type, token);
+        const int expType = BalanceTypes(exp->type, exp2->type);
+        exp = NewBinaryNode(expType, expType, token, exp, exp2);
     }
     return exp;
 }
 
-Expression Parser::ParseMulExp() {
-    Expression exp = ParseListExp();
+IrNode* Parser::ParseMulExp() {
+    IrNode* exp = ParseListExp();
     while (stream.Peek().type == TOK_MUL || stream.Peek().type == TOK_DIV
             || stream.Peek().type == TOK_MOD) {
         const Token& token = stream.Next();
-        if (exp.type != TYPE_INT && exp.type != TYPE_FLOAT) {
-            ErrorEx("Multiplication and division can only be applied to numeric types",
-                token.file, token.line);
+        if (exp->type != TYPE_INT && exp->type != TYPE_FLOAT) {
+            ErrorEx("Multiplication and division can only be applied to numeric types", token);
         }
-        const Expression exp2 = ParseListExp();
-        CheckTypes(exp.type, exp2.type, token);
-        const int expType = BalanceTypes(exp.type, exp2.type);
-        exp = Expression(expType, generator.GenBinaryExp(expType, token, exp.code, exp2.code));
+        IrNode* exp2 = ParseListExp();
+        CheckTypes(exp->type, exp2->type, token);
+        const int expType = BalanceTypes(exp->type, exp2->type);
+        exp = NewBinaryNode(expType, expType, token, exp, exp2);
     }
     return exp;
 }
 
-Expression Parser::ParseListExp() {
+IrNode* Parser::ParseListExp() {
     if (stream.Peek().type == TOK_OPENBRACKET) {
-        vector<Expression> values;
+        IrNode* list = program.NewNode(IR_LIST, TYPE_LIST);
         stream.Skip(1); // [
         if (stream.Peek().type != TOK_CLOSEBRACKET) {
-            values.push_back(ParseExp());
+            list->children.push_back(ParseStoredExp());
             while (stream.Peek().type == TOK_COMMA) {
                 stream.Skip(1); // ,
-                values.push_back(ParseExp());
+                list->children.push_back(ParseStoredExp());
             }
         }
         const Token& closeToken = stream.Next();
         if (closeToken.type != TOK_CLOSEBRACKET) {
-            ErrorEx("Expected ']', got '" + closeToken.data + "'", closeToken.file, closeToken.line);
+            ErrorEx("Expected ']', got '" + closeToken.data + "'", closeToken);
         }
-        return Expression(TYPE_LIST, generator.GenList(values));
+        return list;
     } else {
         return ParseDictExp();
     }
 }
 
-Expression Parser::ParseDictExp() {
+IrNode* Parser::ParseDictExp() {
     if (stream.Peek().type == TOK_OPENBRACE) {
-        vector<Expression> keys;
-        vector<Expression> values;
+        IrNode* dict = program.NewNode(IR_DICT, TYPE_DICT);
         stream.Skip(1); // {
         if (stream.Peek().type != TOK_CLOSEBRACE) {
-            ParseDictEntry(keys, values);
+            ParseDictEntry(dict);
             while (stream.Peek().type == TOK_COMMA) {
                 stream.Skip(1); // ,
-                ParseDictEntry(keys, values);
+                ParseDictEntry(dict);
             }
         }
         const Token& closeToken = stream.Next();
         if (closeToken.type != TOK_CLOSEBRACE) {
-            ErrorEx("Expected '}', got '" + closeToken.data + "'", closeToken.file, closeToken.line);
+            ErrorEx("Expected '}', got '" + closeToken.data + "'", closeToken);
         }
-        return Expression(TYPE_DICT, generator.GenDict(keys, values));
+        return dict;
     } else {
         return ParseNotExp();
     }
 }
 
-void Parser::ParseDictEntry(vector<Expression>& keys, vector<Expression>& values) {
+void Parser::ParseDictEntry(IrNode* dict) {
     const Token& keyToken = stream.Peek();
-    const Expression keyExp = ParseExp();
-    if (keyExp.type != TYPE_STRING) {
-        ErrorEx("Expected string expression as key.", keyToken.file, keyToken.line);
+    IrNode* keyExp = ParseExp();
+    if (keyExp->type != TYPE_STRING) {
+        ErrorEx("Expected string expression as key.", keyToken);
     }
     const Token& colonToken = stream.Next();
     if (colonToken.type != TOK_COLON) {
-        ErrorEx("Expected ':', got '" + colonToken.data + "'", colonToken.file, colonToken.line);
+        ErrorEx("Expected ':', got '" + colonToken.data + "'", colonToken);
+    }
+    IrNode* valueExp = ParseStoredExp();
+    dict->children.push_back(keyExp);
+    dict->children.push_back(valueExp);
+}
+
+// Parses a value to store in a list or dict, which can only hold builtin types
+IrNode* Parser::ParseStoredExp() {
+    const Token& token = stream.Peek();
+    IrNode* exp = ParseExp();
+    if (IsRecord(exp->type)) {
+        ErrorEx("Records cannot be stored in lists or dicts", token);
     }
-    const Expression valueExp = ParseExp();
-    keys.push_back(keyExp);
-    values.push_back(valueExp);
+    return exp;
 }
 
-Expression Parser::ParseNotExp() {
+IrNode* Parser::ParseNotExp() {
     const bool isNot = stream.Peek().type == TOK_NOT;
     if (isNot) stream.Skip(1);
-    const Expression exp = ParseCastExp();
-    return isNot ? Expression(TYPE_INT, generator.GenNotExp(exp)) : exp;
+    IrNode* exp = ParseCastExp();
+    if (!isNot) return exp;
+    IrNode* not_ = program.NewNode(IR_NOT, TYPE_INT);
+    not_->argType = exp->type;
+    not_->children.push_back(exp);
+    return not_;
 }
 
-Expression Parser::ParseCastExp() {
-    const Expression exp = ParseNegExp();
+IrNode* Parser::ParseCastExp() {
+    IrNode* exp = ParseNegExp();
     if (IsType(stream.Peek().type)) {
         const Token& typeToken = stream.Next();
         const int tokenType = GetType(typeToken.type);
-        if (exp.type < TYPE_LIST || exp.type > 0) {
-            ErrorEx("Can only cast numeric, string, list and dict types", typeToken.file, typeToken.line);
+        if (exp->type < TYPE_LIST || exp->type > 0) {
+            ErrorEx("Can only cast numeric, string, list and dict types", typeToken);
         }
         if (tokenType < TYPE_STRING || tokenType > 0) {
-            ErrorEx("Can only cast to numeric and string types", typeToken.file, typeToken.line);
+            ErrorEx("Can only cast to numeric and string types", typeToken);
         }
-        return Expression(tokenType, generator.GenCastExp(tokenType, exp.type, exp.code));
+        IrNode* cast = program.NewNode(IR_CAST, tokenType);
+        cast->argType = exp->type;
+        cast->children.push_back(exp);
+        return cast;
     } else {
         return exp;
     }
 }
 
-Expression Parser::ParseNegExp() {
+IrNode* Parser::ParseNegExp() {
     const Token* token = (stream.Peek().type == TOK_NOT || stream.Peek().type == TOK_MINUS)
         ? &stream.Next()
         : NULL;
-    const Expression exp = ParseGroupExp();
-    if (token != NULL && exp.type != TYPE_INT && exp.type != TYPE_FLOAT) {
-        ErrorEx("Unary '-' operator must be applied to numeric types", token->file, token->line);
+    IrNode* exp = ParseGroupExp();
+    if (token != NULL && exp->type != TYPE_INT && exp->type != TYPE_FLOAT) {
+        ErrorEx("Unary '-' operator must be applied to numeric types", *token);
     }
-    return (token != NULL) ? Expression(exp.type, generator.GenNegExp(exp.code)) : exp;
+    if (token == NULL) return exp;
+    IrNode* neg = program.NewNode(IR_NEG, exp->type);
+    neg->children.push_back(exp);
+    return neg;
 }
 
-Expression Parser::ParseGroupExp() {
+IrNode* Parser::ParseGroupExp() {
     if (stream.Peek().type == TOK_OPENPAREN) {
         stream.Skip(1); // (
-        const Expression exp = ParseExp();
+        IrNode* exp = ParseExp();
         ParseCloseParen();
-        return Expression(exp.type, generator.GenGroupExp(exp.code));
+        IrNode* group = program.NewNode(IR_GROUP, exp->type);
+        group->children.push_back(exp);
+        return group;
     } else {
         return ParseAtomicExp();
     }
 }
 
-Expression Parser::ParseAtomicExp() {
+IrNode* Parser::ParseAtomicExp() {
     const Token& token = stream.Next();
+    int type = TYPE_VOID;
     switch (token.type) {
     case TOK_INTLITERAL:
-        return Expression(TYPE_INT, generator.GenLiteral(token));
+        type = TYPE_INT;
+        break;
     case TOK_FLOATLITERAL:
-        return Expression(TYPE_FLOAT, generator.GenLiteral(token));
+        type = TYPE_FLOAT;
+        break;
     case TOK_STRINGLITERAL:
-        return Expression(TYPE_STRING, generator.GenLiteral(token));
+        type = TYPE_STRING;
+        break;
     case TOK_NULLLITERAL:
-        return Expression(TYPE_RAW, generator.GenLiteral(token));
+        type = TYPE_RAW;
+        break;
     case TOK_TRUELITERAL:
     case TOK_FALSELITERAL:
-        return Expression(TYPE_INT, generator.GenLiteral(token));
+        type = TYPE_INT;
+        break;
     case TOK_ID:
-        return (stream.Peek().type == TOK_OPENPAREN)
-            ? ParseFunctionCall(token)
-            : ParseVarAccess(token);
+        if (stream.Peek().type != TOK_OPENPAREN) {
+            return ParseVarAccess(token);
+        } else {
+            IrNode* exp = (definitions.FindRecord(token.data) != NULL)
+                ? ParseNew(token)
+                : ParseFunctionCall(token);
+            return (stream.Peek().type == TOK_DOT) ? ParseFieldAccess(exp, token, false) : exp;
+        }
     default:
-        ErrorEx("Unexpected element '" + token.data + "'", token.file, token.line);
+        ErrorEx("Unexpected element '" + token.data + "'", token);
+        return NULL;
     }
-    return Expression(TYPE_VOID, "");
+    IrNode* literal = program.NewNode(IR_LITERAL, type);
+    literal->op = token.type;
+    literal->data = token.data;
+    return literal;
 }
 
-Expression Parser::ParseFunctionCall(const Token& nameToken) {
+IrNode* Parser::ParseFunctionCall(const Token& nameToken) {
     const size_t index = FindLibFunction(lib, nameToken.data);
     const Function* func = (index != -1)
         ? &lib[index]
         : definitions.FindFunction(nameToken.data);
     if (func == NULL) {
-        ErrorEx("Unknown function", nameToken.file, nameToken.line);
+        ErrorEx("Unknown function", nameToken);
     }
-    const Expression args = ParseArgs(func);
-    return Expression(func->type, generator.GenFunctionCall(*func, args.code));
+    IrNode* call = program.NewNode((index != -1) ? IR_LIBCALL : IR_CALL, func->type);
+    call->data = func->name;
+    call->index = (index != -1) ? (int)index : definitions.FindFunctionIndex(func->name);
+    ParseArgs(func, call);
+    return call;
 }
 
-Expression Parser::ParseArgs(const Function* func) {
-    vector<Expression> args;
+void Parser::ParseArgs(const Function* func, IrNode* call) {
+    vector<IrNode*>& args = call->children;
     ParseOpenParen();
     if (stream.Peek().type != TOK_CLOSEPAREN) {
         args.push_back(ParseArg(func->params[args.size()].type, stream.Peek()));
@@ -666,116 +913,223 @@ Expression Parser::ParseArgs(const Function* func) {
             if (args.size() < func->params.size()) {
                 args.push_back(ParseArg(func->params[args.size()].type, stream.Peek()));
             } else {
-                ErrorEx("Too many arguments", stream.Peek().file, stream.Peek().line);
+                ErrorEx("Too many arguments", stream.Peek());
             }
         }
     }
     if (args.size() < func->params.size()) {
-        ErrorEx("Not enough arguments", stream.Peek().file, stream.Peek().line);
+        ErrorEx("Not enough arguments", stream.Peek());
     }
     ParseCloseParen();
-    return Expression(TYPE_VOID, generator.GenArgs(*func, args));
 }
 
-Expression Parser::ParseArg(int paramType, const Token& token) {
-    const Expression exp = ParseExp();
-    CheckTypes(exp.type, paramType, token);
+IrNode* Parser::ParseArg(int paramType, const Token& token) {
+    IrNode* exp = ParseExp();
+    CheckTypes(exp->type, paramType, token);
     return exp;
 }
 
-Expression Parser::ParseVarAccess(const Token& nameToken) {
+// Without arguments, fields start with the default value of their type
+IrNode* Parser::ParseNew(const Token& nameToken) {
+    const int type = definitions.FindRecordType(nameToken.data);
+    const Record* record = definitions.GetRecordType(type);
+    IrNode* new_ = program.NewNode(IR_NEW, type);
+    new_->data = record->name;
+    if (stream.Peek(1).type == TOK_CLOSEPAREN) {
+        stream.Skip(2); // ()
+        for (size_t i = 0; i < record->fields.size(); ++i) {
+            new_->children.push_back(NewDefaultNode(record->fields[i].type));
+        }
+    } else {
+        const Function constructor(record->name, type, record->fields);
+        ParseArgs(&constructor, new_);
+    }
+    return new_;
+}
+
+IrNode* Parser::ParseVarAccess(const Token& nameToken) {
     const Var* var = definitions.FindVar(nameToken.data);
     if (var != NULL) {
-        const Expression& exp = Expression(var->type, generator.GenVar(*var));
+        IrNode* exp = NewVarNode(IR_VAR, *var);
         const Token& nextToken = stream.Peek();
-        if (nextToken.type == TOK_OPENBRACKET) {
-            if (var->type == TYPE_LIST) {
-                return ParseListAccess(exp.code, false);
-            } else if (var->type == TYPE_DICT) {
-                return ParseDictAccess(exp.code, false);
-            } else {
-                ErrorEx("Only lists and dicts can be indexed", nameToken.file, nameToken.line);
-                return Expression(TYPE_VOID, "");
-            }
+        if (nextToken.type == TOK_DOT) {
+            return ParseFieldAccess(exp, nameToken, false);
+        } else if (nextToken.type == TOK_OPENBRACKET) {
+            return ParseIndexing(exp, nameToken, false);
         } else {
             return exp;
         }
     } else {
         if (definitions.FindFunction(nameToken.data) != NULL) {
-            ErrorEx("Expected '(' in function call", nameToken.file, nameToken.line);
+            ErrorEx("Expected '(' in function call", nameToken);
         } else {
-            ErrorEx("Variable has not been initialized: " + nameToken.data, nameToken.file, nameToken.line);
+            ErrorEx("Variable has not been initialized: " + nameToken.data, nameToken);
         }
-        return Expression(TYPE_VOID, "");
+        return NULL;
     }
 }
 
-Expression Parser::ParseListAccess(string listCode, bool isSetter) {
-    Expression indexExp(TYPE_VOID, "");
+IrNode* Parser::ParseFieldAccess(IrNode* object, const Token& objectToken, bool isSetter) {
+    const Record* record = definitions.GetRecordType(object->type);
+    if (record == NULL) {
+        ErrorEx("Only records have fields", objectToken);
+    }
+    stream.Skip(1); // .
+    const Token& fieldToken = stream.Next();
+    const int index = record->FindField(CheckId(fieldToken));
+    if (index == -1) {
+        ErrorEx("Unknown field: " + fieldToken.data, fieldToken);
+    }
+    const Var& field = record->fields[index];
+    if (stream.Peek().type == TOK_OPENBRACKET || !isSetter) {
+        IrNode* getter = program.NewNode(IR_FIELDGET, field.type);
+        getter->index = index;
+        getter->data = field.name;
+        getter->children.push_back(object);
+        return (stream.Peek().type == TOK_OPENBRACKET) ? ParseIndexing(getter, fieldToken, isSetter) : getter;
+    }
+    stream.Skip(1); // =
+    const Token& token = stream.Peek();
+    IrNode* exp = ParseExp();
+    CheckTypes(field.type, exp->type, token);
+    IrNode* setter = program.NewNode(IR_FIELDSET, field.type);
+    setter->index = index;
+    setter->data = field.name;
+    setter->children.push_back(object);
+    setter->children.push_back(exp);
+    return setter;
+}
+
+IrNode* Parser::ParseIndexing(IrNode* container, const Token& containerToken, bool isSetter) {
+    if (container->type == TYPE_LIST) {
+        return ParseListAccess(container, isSetter);
+    } else if (container->type == TYPE_DICT) {
+        return ParseDictAccess(container, isSetter);
+    } else {
+        ErrorEx("Only lists and dicts can be indexed", containerToken);
+        return NULL;
+    }
+}
+
+IrNode* Parser::ParseListAccess(IrNode* list, bool isSetter) {
+    IrNode* indexExp = NULL;
     while (stream.Peek().type == TOK_OPENBRACKET) {
         stream.Skip(1); // [
         const Token& expToken = stream.Peek();
         indexExp = ParseExp();
-        if (indexExp.type != TYPE_INT) {
-            ErrorEx("Only int expressions can be used as list indices", expToken.file, expToken.line);
+        if (indexExp->type != TYPE_INT) {
+            ErrorEx("Only int expressions can be used as list indices", expToken);
         }
         const Token& closeToken = stream.Next();
         if (closeToken.type != TOK_CLOSEBRACKET) {
-            ErrorEx("Expected ']', got '" + closeToken.data + "'", closeToken.file, closeToken.line);
+            ErrorEx("Expected ']', got '" + closeToken.data + "'", closeToken);
         }
         if (stream.Peek().type == TOK_OPENBRACKET) {
-            listCode = generator.GenListGetter(TYPE_LIST, listCode, indexExp.code);
+            IrNode* getter = program.NewNode(IR_LISTGET, TYPE_LIST);
+            getter->children.push_back(list);
+            getter->children.push_back(indexExp);
+            list = getter;
         }
     }
     if (isSetter) {
         stream.Skip(1); // =
-        const Expression exp = ParseExp();
-        return Expression(exp.type, generator.GenListSetter(listCode, indexExp.code, exp));
+        IrNode* exp = ParseStoredExp();
+        IrNode* setter = program.NewNode(IR_LISTSET, exp->type);
+        setter->children.push_back(list);
+        setter->children.push_back(indexExp);
+        setter->children.push_back(exp);
+        return setter;
     } else {
         const Token& typeToken = stream.Next();
         if (!IsType(typeToken.type)) {
-            ErrorEx("Expected type suffix at end of dict indexing", typeToken.file, typeToken.line);
+            ErrorEx("Expected type suffix at end of dict indexing", typeToken);
         }
-        const int type = GetType(typeToken.type);
-        return Expression(type, generator.GenListGetter(type, listCode, indexExp.code));
+        IrNode* getter = program.NewNode(IR_LISTGET, GetType(typeToken.type));
+        getter->children.push_back(list);
+        getter->children.push_back(indexExp);
+        return getter;
     }
 }
 
-Expression Parser::ParseDictAccess(string dictCode, bool isSetter) {
-    Expression indexExp(TYPE_VOID, "");
+IrNode* Parser::ParseDictAccess(IrNode* dict, bool isSetter) {
+    IrNode* indexExp = NULL;
     while (stream.Peek().type == TOK_OPENBRACKET) {
         stream.Skip(1); // [
         const Token& expToken = stream.Peek();
         indexExp = ParseExp();
-        if (indexExp.type != TYPE_STRING) {
-            ErrorEx("Only string expressions can be used as dict indices", expToken.file, expToken.line);
+        if (indexExp->type != TYPE_STRING) {
+            ErrorEx("Only string expressions can be used as dict indices", expToken);
         }
         const Token& closeToken = stream.Next();
         if (closeToken.type != TOK_CLOSEBRACKET) {
-            ErrorEx("Expected ']', got '" + closeToken.data + "'", closeToken.file, closeToken.line);
+            ErrorEx("Expected ']', got '" + closeToken.data + "'", closeToken);
         }
         if (stream.Peek().type == TOK_OPENBRACKET) {
-            dictCode = generator.GenDictGetter(TYPE_DICT, dictCode, indexExp.code);
+            IrNode* getter = program.NewNode(IR_DICTGET, TYPE_DICT);
+            getter->children.push_back(dict);
+            getter->children.push_back(indexExp);
+            dict = getter;
         }
     }
     if (isSetter) {
         stream.Skip(1); // =
-        const Expression exp = ParseExp();
-        return Expression(exp.type, generator.GenDictSetter(dictCode, indexExp.code, exp));
+        IrNode* exp = ParseStoredExp();
+        IrNode* setter = program.NewNode(IR_DICTSET, exp->type);
+        setter->children.push_back(dict);
+        setter->children.push_back(indexExp);
+        setter->children.push_back(exp);
+        return setter;
     } else {
         const Token& typeToken = stream.Next();
         if (!IsType(typeToken.type)) {
-            ErrorEx("Expected type suffix at end of dict indexing", typeToken.file, typeToken.line);
+            ErrorEx("Expected type suffix at end of dict indexing", typeToken);
         }
-        const int type = GetType(typeToken.type);
-        return Expression(type, generator.GenDictGetter(type, dictCode, indexExp.code));
+        IrNode* getter = program.NewNode(IR_DICTGET, GetType(typeToken.type));
+        getter->children.push_back(dict);
+        getter->children.push_back(indexExp);
+        return getter;
     }
 }
 
+IrNode* Parser::NewVarNode(int kind, const Var& var) {
+    IrNode* node = program.NewNode(kind, var.type);
+    const int localIndex = definitions.FindLocalIndex(var.name);
+    node->data = var.name;
+    node->global = localIndex == -1;
+    node->index = node->global ? definitions.FindGlobalIndex(var.name) : localIndex;
+    return node;
+}
+
+IrNode* Parser::NewDefaultNode(int type) {
+    if (type == TYPE_LIST || type == TYPE_DICT) {
+        return program.NewNode((type == TYPE_LIST) ? IR_LIST : IR_DICT, type);
+    }
+    IrNode* literal = program.NewNode(IR_LITERAL, type);
+    literal->op =
+        (type == TYPE_INT) ? TOK_INTLITERAL :
+        (type == TYPE_FLOAT) ? TOK_FLOATLITERAL :
+        (type == TYPE_STRING) ? TOK_STRINGLITERAL :
+        TOK_NULLLITERAL;
+    literal->data =
+        (type == TYPE_INT) ? "0" :
+        (type == TYPE_FLOAT) ? "0.0" :
+        "";
+    return literal;
+}
+
+IrNode* Parser::NewBinaryNode(int type, int argType, const Token& token, IrNode* left, IrNode* right) {
+    IrNode* node = program.NewNode(IR_BINARY, type);
+    node->op = token.type;
+    node->argType = argType;
+    node->children.push_back(left);
+    node->children.push_back(right);
+    return node;
+}
+
 const Lib& Parser::GetLib() const {
     return lib;
 }
 
-const string& Parser::GetCode() const {
-    return code;
+IrProgram& Parser::GetProgram() {
+    return program;
 }
@@ -1,81 +1,112 @@
 #pragma once
 
 #include "definitions.h"
-#include "expression.h"
-#include "generator.h"
+#include "ir.h"
 #include "lib.h"
 #include "token.h"
 #include "token_stream.h"
-#include "var_def.h"
 
 class Parser {
 public:
     Parser(const std::vector<Token>& tokens);
-    void Parse();
+    ~Parser();
+    void Parse(int jobs = 1);
     void ParseLibrary(const std::vector<Token>& tokens);
+    void ParseImport(const std::string& module, const std::vector<Token>& tokens);
     const Lib& GetLib() const;
-    const std::string& GetCode() const;
+    IrProgram& GetProgram();
 private:
+    struct DeferredFunction {
+        int offset;         // Offset of the 'function' token
+        size_t numGlobals;  // Number of globals defined before the function
+
+        DeferredFunction(int offset, size_t numGlobals) : offset(offset), numGlobals(numGlobals) {
+        }
+    };
+
     Lib lib;
-    Generator generator;
     Definitions definitions;
     TokenStream stream;
-    std::string code;
+    IrProgram program;
     const Function* currentFunc;
-    
+    std::vector<DeferredFunction> deferred;
+    std::vector<Parser*> workers;
+
+    explicit Parser(const Parser* parent);
+    Parser(const Parser& other);
+    Parser& operator=(const Parser& other);
+
+    static const Token* FindImportToken(const TokenStream& source, const std::string& module);
+    void ScanRecords();
+    Record ScanRecord();
+    void SkipRecord();
     void ScanFunctions();
     Function ScanFunctionHeader();
-    const std::string& ScanFunctionName();
+    std::string ScanFunctionName();
     void SkipFunction();
-    std::string ParseFunctionDef();
+    void ParseImportStatement();
+    void ParseFunctionDef();
+    void DeferFunctionDef();
+    void ParseDeferredFunctions(int jobs);
+    static void ParseDeferredTask(void* data, size_t index, int worker);
     Function ParseFunctionHeader();
-    const std::string& ParseFunctionName();
+    std::string ParseFunctionName();
     std::vector<Var> ParseParams();
-    const std::string& ParseVarName();
+    std::string ParseVarName();
+    std::string LibFunctionError(const std::string& name) const;
     void ParseOpenParen();
     int ParseParamType();
     void ParseCloseParen();
     int ParseReturnType();
-    std::string ParseBlock(int indent);
-    std::string ParseStatement(int indent);
+    bool IsTypeNext() const;
+    int ParseType();
+    IrNode* ParseBlock();
+    IrNode* ParseStatement();
     bool IsAssignment() const;
     int OffsetAfterIndexing(int offset) const;
-    std::string ParseAssignment();
-    const std::string& CheckId(const Token& token) const;
+    IrNode* ParseAssignment();
+    std::string CheckId(const Token& token) const;
     void CheckTypes(int expected, int got, const Token& token);
     void ParseStatementEnd();
-    std::string ParseControlStatement(int indent);
-    std::string ParseIf(int indent);
+    IrNode* ParseControlStatement();
+    IrNode* ParseIf();
     void CheckThen();
-    std::string ParseElseIf(int indent);
-    std::string ParseElse(int indent);
-    std::string ParseEnd(int indent);
-    std::string ParseFor(int indent);
-    Expression ParseTo();
-    Expression ParseStep();
+    IrNode* ParseElseIf();
+    IrNode* ParseElse();
+    void ParseEnd();
+    IrNode* ParseFor();
+    IrNode* ParseTo();
+    IrNode* ParseStep();
     void CheckDo();
-    std::string ParseWhile(int indent);
-    std::string ParseReturn(int indent);
-    std::string ParseVarDef();
-    Expression ParseExp();
-    Expression ParseOrExp();
-    Expression ParseAndExp();
-    Expression ParseEqualExp();
-    Expression ParseRelExp();
-    Expression ParseAddExp();
-    Expression ParseMulExp();
-    Expression ParseListExp();
-    Expression ParseDictExp();
-    void ParseDictEntry(std::vector<Expression>& keys, std::vector<Expression>& values);
-    Expression ParseNotExp();
-    Expression ParseCastExp();
-    Expression ParseNegExp();
-    Expression ParseGroupExp();
-    Expression ParseAtomicExp();
-    Expression ParseFunctionCall(const Token& nameToken);
-    Expression ParseArgs(const Function* func);
-    Expression ParseArg(int paramType, const Token& token);
-    Expression ParseVarAccess(const Token& nameToken);
-    Expression ParseListAccess(std::string listCode, bool isSetter);
-    Expression ParseDictAccess(std::string dictCode, bool isSetter);
+    IrNode* ParseWhile();
+    IrNode* ParseReturn();
+    IrNode* ParseVarDef();
+    IrNode* ParseExp();
+    IrNode* ParseOrExp();
+    IrNode* ParseAndExp();
+    IrNode* ParseEqualExp();
+    IrNode* ParseRelExp();
+    IrNode* ParseAddExp();
+    IrNode* ParseMulExp();
+    IrNode* ParseListExp();
+    IrNode* ParseDictExp();
+    void ParseDictEntry(IrNode* dict);
+    IrNode* ParseStoredExp();
+    IrNode* ParseNotExp();
+    IrNode* ParseCastExp();
+    IrNode* ParseNegExp();
+    IrNode* ParseGroupExp();
+    IrNode* ParseAtomicExp();
+    IrNode* ParseFunctionCall(const Token& nameToken);
+    void ParseArgs(const Function* func, IrNode* call);
+    IrNode* ParseArg(int paramType, const Token& token);
+    IrNode* ParseNew(const Token& nameToken);
+    IrNode* ParseVarAccess(const Token& nameToken);
+    IrNode* ParseFieldAccess(IrNode* object, const Token& objectToken, bool isSetter);
+    IrNode* ParseIndexing(IrNode* container, const Token& containerToken, bool isSetter);
+    IrNode* ParseListAccess(IrNode* list, bool isSetter);
+    IrNode* ParseDictAccess(IrNode* dict, bool isSetter);
+    IrNode* NewVarNode(int kind, const Var& var);
+    IrNode* NewDefaultNode(int type);
+    IrNode* NewBinaryNode(int type, int argType, const Token& token, IrNode* left, IrNode* right);
 };
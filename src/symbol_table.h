@@ -0,0 +1,93 @@
+#pragma once
+
+#include "common.h"
+
+// Symbols in declaration order, indexed by a hash of their name. Lookups that
+// miss in a table continue in its parent, so tables can be chained into scopes.
+template <typename T>
+class SymbolTable {
+public:
+    SymbolTable(const SymbolTable* parent = NULL) : parent(parent), slots(16, -1) {
+    }
+
+    size_t Add(const T& symbol) {
+        if ((symbols.size() + 1) * 2 > slots.size()) Rehash(slots.size() * 2);
+        const unsigned int hash = Hash(symbol.name);
+        const size_t slot = FreeSlot(hash);
+        slots[slot] = symbols.size();
+        symbols.push_back(symbol);
+        hashes.push_back(hash);
+        symbolSlots.push_back(slot);
+        return symbols.size() - 1;
+    }
+
+    void Clear() {
+        for (size_t i = 0; i < symbolSlots.size(); ++i) {
+            slots[symbolSlots[i]] = -1;
+        }
+        symbols.clear();
+        hashes.clear();
+        symbolSlots.clear();
+    }
+
+    // Returns the index of the symbol in this table, or -1
+    int Find(const std::string& name) const {
+        const unsigned int hash = Hash(name);
+        const size_t mask = slots.size() - 1;
+        for (size_t slot = hash & mask; slots[slot] != -1; slot = (slot + 1) & mask) {
+            const int index = slots[slot];
+            if (hashes[index] == hash && symbols[index].name == name) return index;
+        }
+        return -1;
+    }
+
+    // Returns the symbol from this table or the closest parent that defines it
+    const T* Lookup(const std::string& name) const {
+        for (const SymbolTable* table = this; table != NULL; table = table->parent) {
+            const int index = table->Find(name);
+            if (index != -1) return &table->symbols[index];
+        }
+        return NULL;
+    }
+
+    const std::vector<T>& GetSymbols() const {
+        return symbols;
+    }
+
+    size_t size() const {
+        return symbols.size();
+    }
+
+    const T& operator[](size_t index) const {
+        return symbols[index];
+    }
+private:
+    const SymbolTable* parent;
+    std::vector<T> symbols;
+    std::vector<unsigned int> hashes;
+    std::vector<size_t> symbolSlots;
+    std::vector<int> slots;     // Open addressing table of indices into symbols, -1 when empty
+
+    size_t FreeSlot(unsigned int hash) const {
+        const size_t mask = slots.size() - 1;
+        size_t slot = hash & mask;
+        while (slots[slot] != -1) slot = (slot + 1) & mask;
+        return slot;
+    }
+
+    void Rehash(size_t size) {
+        slots.assign(size, -1);
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            symbolSlots[i] = FreeSlot(hashes[i]);
+            slots[symbolSlots[i]] = i;
+        }
+    }
+
+    static unsigned int Hash(const std::string& name) {
+        unsigned int hash = 2166136261u;
+        for (size_t i = 0; i < name.length(); ++i) {
+            hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+        }
+        return hash;
+    }
+};
@@ -0,0 +1,139 @@
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define PSAPI_VERSION 2
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#endif
+#include <stdio.h>
+#include "timing.h"
+
+using namespace std;
+
+// Seconds since an arbitrary point
+static double WallTime() {
+#if defined(_WIN32)
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return double(counter.QuadPart) / frequency.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+}
+
+// Seconds of CPU used by this process and its finished children
+static double CpuTime() {
+#if defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+    const unsigned long long k = ((unsigned long long)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    const unsigned long long u = ((unsigned long long)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (k + u) / 10000000.0;
+#else
+    double seconds = 0;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    seconds += usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0;
+    seconds += usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+    getrusage(RUSAGE_CHILDREN, &usage);
+    seconds += usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0;
+    seconds += usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+    return seconds;
+#endif
+}
+
+// Peak resident set size in kilobytes, of this process or of its largest finished child
+static double PeakRss(bool children) {
+#if defined(_WIN32)
+    if (children) return 0;
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / 1024.0;
+#else
+    struct rusage usage;
+    getrusage(children ? RUSAGE_CHILDREN : RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024.0;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+PassTimer::PassTimer(bool enabled) : enabled(enabled), startWall(0), startCpu(0) {
+}
+
+bool PassTimer::IsEnabled() const {
+    return enabled;
+}
+
+void PassTimer::Start(const string& phase) {
+    if (!enabled) return;
+    Stop();
+    current = phase;
+    startWall = WallTime();
+    startCpu = CpuTime();
+}
+
+void PassTimer::Stop() {
+    if (!enabled || current == "") return;
+    Pass pass;
+    pass.name = current;
+    pass.wall = WallTime() - startWall;
+    pass.cpu = CpuTime() - startCpu;
+    passes.push_back(pass);
+    current = "";
+}
+
+void PassTimer::Count(const string& name, double value) {
+    if (!enabled) return;
+    for (size_t i = 0; i < counters.size(); ++i) {
+        if (counters[i].name == name) {
+            counters[i].value += value;
+            return;
+        }
+    }
+    Counter counter;
+    counter.name = name;
+    counter.value = value;
+    counters.push_back(counter);
+}
+
+void PassTimer::Report(bool json) const {
+    if (!enabled) return;
+    double wall = 0, cpu = 0;
+    for (size_t i = 0; i < passes.size(); ++i) {
+        wall += passes[i].wall;
+        cpu += passes[i].cpu;
+    }
+    const double peakRss = PeakRss(false);
+    const double childPeakRss = PeakRss(true);
+    if (json) {
+        fprintf(stderr, "{\"phases\": [");
+        for (size_t i = 0; i < passes.size(); ++i) {
+            fprintf(stderr, "%s{\"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f}",
+                (i > 0) ? ", " : "", passes[i].name.c_str(), passes[i].wall * 1000, passes[i].cpu * 1000);
+        }
+        fprintf(stderr, "], \"total\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}, \"counters\": {", wall * 1000, cpu * 1000);
+        for (size_t i = 0; i < counters.size(); ++i) {
+            fprintf(stderr, "\"%s\": %.0f, ", counters[i].name.c_str(), counters[i].value);
+        }
+        fprintf(stderr, "\"peak_rss_kb\": %.0f, \"child_peak_rss_kb\": %.0f}}\n", peakRss, childPeakRss);
+    } else {
+        fprintf(stderr, "%-16s %12s %12s\n", "Phase", "Wall (ms)", "CPU (ms)");
+        for (size_t i = 0; i < passes.size(); ++i) {
+            fprintf(stderr, "%-16s %12.3f %12.3f\n", passes[i].name.c_str(), passes[i].wall * 1000, passes[i].cpu * 1000);
+        }
+        fprintf(stderr, "%-16s %12.3f %12.3f\n\n", "total", wall * 1000, cpu * 1000);
+        for (size_t i = 0; i < counters.size(); ++i) {
+            fprintf(stderr, "%-24s %12.0f\n", counters[i].name.c_str(), counters[i].value);
+        }
+        fprintf(stderr, "%-24s %12.0f\n", "peak_rss_kb", peakRss);
+        fprintf(stderr, "%-24s %12.0f\n", "child_peak_rss_kb", childPeakRss);
+    }
+}
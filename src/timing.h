@@ -0,0 +1,33 @@
+#pragma once
+
+#include "common.h"
+
+// Measures the wall and CPU time of consecutive compiler phases, and collects counters to report
+// with them. CPU time includes the child processes waited for, like gcc and the program itself.
+class PassTimer {
+public:
+    PassTimer(bool enabled);
+    bool IsEnabled() const;
+    void Start(const std::string& phase);   // Also stops the running phase
+    void Stop();
+    void Count(const std::string& name, double value);
+    void Report(bool json) const;           // Written to stderr, so it does not mix with program output
+private:
+    struct Pass {
+        std::string name;
+        double wall;
+        double cpu;
+    };
+
+    struct Counter {
+        std::string name;
+        double value;
+    };
+
+    bool enabled;
+    std::vector<Pass> passes;
+    std::vector<Counter> counters;
+    std::string current;
+    double startWall;
+    double startCpu;
+};
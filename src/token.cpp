@@ -1,4 +1,4 @@
-#include <map>
+#include <set>
 #include "error.h"
 #include "token.h"
 
@@ -6,59 +6,124 @@ using namespace std;
 using namespace swan;
 
 struct Lexer {
-    const std::string& buffer;
-    int offset;
-    const std::string& file;
+    const char* p;
+    const char* end;
+    const string* file;
     int line;
-    
-    Lexer(const std::string& buffer, const std::string& file)
-            : buffer(buffer), offset(0), file(file), line(1) {
-    }
-    
-    size_t BufferSize() const {
-        return buffer.length();
+    vector<Token>& tokens;
+
+    Lexer(const string& buffer, const string* file, vector<Token>& tokens)
+            : p(buffer.c_str()), end(buffer.c_str() + buffer.length()), file(file), line(1), tokens(tokens) {
     }
-    
+
     char Char(size_t offset = 0) const {
-        if (Valid(offset)) {
-            return buffer[this->offset + offset];
-        } else {
-            return '\0';
-        }
+        return (p + offset < end) ? p[offset] : '\0';
     }
 
-    bool Valid(size_t offset = 0) const {
-        return (this->offset + offset) < buffer.length();
+    void Add(int type, const char* start) {
+        tokens.push_back(Token(type, TokenData(start, p - start), file, line));
     }
 };
 
-Token NextToken(Lexer& lexer);
-Token SkipBlank(Lexer& lexer);
-bool IsSlComment(const Lexer& lexer);
-bool IsMlComment(const Lexer& lexer);
-bool IsNumber(char c);
-bool IsAlpha(char c);
-string CheckSymbol(const Lexer& lexer);
-int TokenType(const string& str);
+static void AddEol(Lexer& lexer);
+static void SkipComment(Lexer& lexer);
+static void ScanNumber(Lexer& lexer);
+static void ScanString(Lexer& lexer);
+static void ScanWord(Lexer& lexer);
+static void ScanTypeTag(Lexer& lexer);
+static int KeywordType(const char* str, size_t length);
+static bool IsNumber(char c);
+static bool IsAlpha(char c);
 
 vector<Token> ParseTokens(const string& buffer, const string& filename) {
-    Lexer lexer(buffer, filename);
     vector<Token> tokens;
-    while (true) {
-        Token token = NextToken(lexer);
-        if (token.type == TOK_EOF) {
-			break;
-        } else if (token.type != TOK_EOL
-                || (tokens.size() > 0 && !IsStatementEnd(tokens.back().type))) {
-            tokens.push_back(token);
+    tokens.reserve(buffer.length() / 4);
+    Lexer lexer(buffer, InternFilename(filename), tokens);
+    while (lexer.p < lexer.end) {
+        const char* start = lexer.p;
+        switch (*lexer.p) {
+        case ' ':
+        case '\t':
+            ++lexer.p;
+            break;
+        case '\r':
+            // A CR is only a line break on its own, as part of CRLF the LF ends the line
+            if (lexer.Char(1) == '\n') {
+                ++lexer.p;
+                break;
+            }
+            // Falls through
+        case '\n':
+            AddEol(lexer);
+            ++lexer.p;
+            ++lexer.line;
+            break;
+        case '/':
+            if (lexer.Char(1) == '/' || lexer.Char(1) == '*') {
+                SkipComment(lexer);
+            } else {
+                ++lexer.p;
+                lexer.Add(TOK_DIV, start);
+            }
+            break;
+        case '-':
+            if (IsNumber(lexer.Char(1))) {
+                ScanNumber(lexer);
+            } else {
+                ++lexer.p;
+                lexer.Add(TOK_MINUS, start);
+            }
+            break;
+        case '=':
+            lexer.p += (lexer.Char(1) == '=') ? 2 : 1;
+            lexer.Add((lexer.p - start == 2) ? TOK_EQUAL : TOK_ASSIGN, start);
+            break;
+        case '<':
+            lexer.p += (lexer.Char(1) == '>' || lexer.Char(1) == '=') ? 2 : 1;
+            lexer.Add((lexer.p - start == 1) ? TOK_LESSER : (start[1] == '>') ? TOK_NOTEQUAL : TOK_LEQUAL, start);
+            break;
+        case '>':
+            lexer.p += (lexer.Char(1) == '=') ? 2 : 1;
+            lexer.Add((lexer.p - start == 2) ? TOK_GEQUAL : TOK_GREATER, start);
+            break;
+        case '+': ++lexer.p; lexer.Add(TOK_PLUS, start); break;
+        case '*': ++lexer.p; lexer.Add(TOK_MUL, start); break;
+        case ',': ++lexer.p; lexer.Add(TOK_COMMA, start); break;
+        case '.': ++lexer.p; lexer.Add(TOK_DOT, start); break;
+        case ';': ++lexer.p; lexer.Add(TOK_SEMICOLON, start); break;
+        case '(': ++lexer.p; lexer.Add(TOK_OPENPAREN, start); break;
+        case ')': ++lexer.p; lexer.Add(TOK_CLOSEPAREN, start); break;
+        case '[': ++lexer.p; lexer.Add(TOK_OPENBRACKET, start); break;
+        case ']': ++lexer.p; lexer.Add(TOK_CLOSEBRACKET, start); break;
+        case '{': ++lexer.p; lexer.Add(TOK_OPENBRACE, start); break;
+        case '}': ++lexer.p; lexer.Add(TOK_CLOSEBRACE, start); break;
+        case ':':
+            ScanTypeTag(lexer);
+            break;
+        case '"':
+            ScanString(lexer);
+            break;
+        default:
+            if (IsNumber(*lexer.p)) {
+                ScanNumber(lexer);
+            } else if (IsAlpha(*lexer.p)) {
+                ScanWord(lexer);
+            } else {
+                ErrorEx("Unrecognized token", *lexer.file, lexer.line);
+            }
         }
     }
-    if (!IsStatementEnd(tokens.back().type)) {
-        tokens.push_back(Token(TOK_EOL, "\n", lexer.file, lexer.line));
+    if (tokens.empty() || !IsStatementEnd(tokens.back().type)) {
+        tokens.push_back(Token(TOK_EOL, TokenData("\n", 1), lexer.file, lexer.line));
     }
     return tokens;
 }
 
+const string* InternFilename(const string& filename) {
+    static set<string> filenames;
+    return &*filenames.insert(filename).first;
+}
+
 bool IsControl(int type) {
     return type == TOK_IF || type == TOK_FOR || type == TOK_WHILE || type == TOK_RETURN;
 }
@@ -106,6 +171,16 @@ int GetType(int type) {
     }
 }
 
+// Records have positive types, one past their index in the declaration order
+bool IsRecord(int type) {
+    return type > 0;
+}
+
+// Whether values of the type are reference counted
+bool IsManaged(int type) {
+    return type == TYPE_STRING || type == TYPE_LIST || type == TYPE_DICT || IsRecord(type);
+}
+
 bool IsStatementEnd(int type) {
     return type == TOK_EOL || type == TOK_SEMICOLON;
 }
@@ -134,206 +209,140 @@ int BalanceTypes(int type1, int type2) {
     }
 }
 
-Token NextToken(Lexer& lexer) {
-    // Skip blank characters. If an end of line is found, return it
-    const Token maybeEol = SkipBlank(lexer);
-    if (maybeEol.type == TOK_EOL) return maybeEol;
-
-    // Check end of file
-    if (!lexer.Valid()) return Token(TOK_EOF, "", lexer.file, lexer.line);
-
-    // Check numeric literal
-    const bool negNumber = (lexer.Char() == '-' && IsNumber(lexer.Char(1)))
-        ? true
-        : false;
-    if (negNumber || IsNumber(lexer.Char())) {
-        string str = "";
-        if (lexer.Char() == '-') {
-            str = "-";
-            lexer.offset++;
-        }
-        while (IsNumber(lexer.Char())) {
-            str += lexer.Char();
-            lexer.offset++;
-        }
-        if (lexer.Char() == '.') {
-            str += '.';
-            lexer.offset++;
-            if (!IsNumber(lexer.Char())) ErrorEx("Invalid float number", lexer.file, lexer.line);
-            while (IsNumber(lexer.Char())) {
-                str += lexer.Char();
-                lexer.offset++;
-            }
-            return Token(TOK_FLOATLITERAL, str, lexer.file, lexer.line);
-        } else {
-            return Token(TOK_INTLITERAL, str, lexer.file, lexer.line);
-        }
-    }
-
-    // Check symbol
-    string symbol = CheckSymbol(lexer);
-    if (symbol != "") {
-        lexer.offset += symbol.length();
-        return Token(TokenType(symbol), symbol, lexer.file, lexer.line);
+static void AddEol(Lexer& lexer) {
+    // Blank lines and line breaks after a statement end do not produce tokens
+    if (!lexer.tokens.empty() && !IsStatementEnd(lexer.tokens.back().type)) {
+        lexer.tokens.push_back(Token(TOK_EOL, TokenData("\n", 1), lexer.file, lexer.line));
     }
+}
 
-    // Check string
-    if (lexer.Char() == '"') {
-        string str;
-        lexer.offset++; // Skip "
-        while (lexer.Valid() && lexer.Char() != '"' && lexer.Char() != '\n') {
-            str += lexer.Char();
-            lexer.offset++;
-        }
-        if (lexer.Char() != '"') ErrorEx("String must be closed", lexer.file, lexer.line);
-        lexer.offset++;
-        return Token(TOK_STRINGLITERAL, str, lexer.file, lexer.line);
+static void SkipComment(Lexer& lexer) {
+    if (lexer.Char(1) == '/') {
+        while (lexer.p < lexer.end && *lexer.p != '\n' && *lexer.p != '\r') ++lexer.p;
+        return;
     }
-
-    // Check keyword, identifier or null literal
-    if (IsAlpha(lexer.Char())) {
-        string str = "";
-        while (IsAlpha(lexer.Char()) || IsNumber(lexer.Char())) {
-            str += lexer.Char();
-            lexer.offset++;
-        }
-        return Token(TokenType(str), str, lexer.file, lexer.line);
+    lexer.p += 2;
+    while (lexer.p < lexer.end && (*lexer.p != '*' || lexer.Char(1) != '/')) {
+        if (*lexer.p == '\n' || (*lexer.p == '\r' && lexer.Char(1) != '\n')) lexer.line++;
+        ++lexer.p;
     }
-
-    // Not recognized
-    ErrorEx("Unrecognized token", lexer.file, lexer.line);
-    return Token(TOK_EOF, "", lexer.file, lexer.line);
+    if (lexer.p == lexer.end) ErrorEx("Comment must be closed", *lexer.file, lexer.line);
+    lexer.p += 2;
 }
 
-Token SkipBlank(Lexer& lexer) {
-    while (lexer.Char() == ' ' || lexer.Char() == '\t'
-            || lexer.Char() == '\n' || IsSlComment(lexer) || IsMlComment(lexer)) {
-        if (IsSlComment(lexer)) {
-            while (lexer.Valid() && lexer.Char() != '\n') lexer.offset++;
-        }
-        if (IsMlComment(lexer)) {
-            lexer.offset += 2;
-            while (lexer.Valid() && (lexer.Char() != '*' || lexer.Char(1) != '/')) {
-                if (lexer.Char() == '\n') lexer.line++;
-                lexer.offset++;
-            }
-            if (lexer.Char(1) != '/') {
-                ErrorEx("Comment must be closed", lexer.file, lexer.line);
-            }
-            lexer.offset++;
-        }
-        const bool isEol = lexer.Char() == '\n';
-        if (isEol) lexer.line++;
-        if (lexer.Valid()) lexer.offset++;
-        if (isEol) return Token(TOK_EOL, "\n", lexer.file, lexer.line - 1);
+static void ScanNumber(Lexer& lexer) {
+    const char* start = lexer.p;
+    if (*lexer.p == '-') ++lexer.p;
+    while (IsNumber(lexer.Char())) ++lexer.p;
+    if (lexer.Char() == '.') {
+        ++lexer.p;
+        if (!IsNumber(lexer.Char())) ErrorEx("Invalid float number", *lexer.file, lexer.line);
+        while (IsNumber(lexer.Char())) ++lexer.p;
+        lexer.Add(TOK_FLOATLITERAL, start);
+    } else {
+        lexer.Add(TOK_INTLITERAL, start);
     }
-    return Token(TOK_EOF, "", lexer.file, lexer.line);
 }
 
-bool IsSlComment(const Lexer& lexer) {
-    return lexer.Char() == '/' && lexer.Char(1) == '/';
+static void ScanString(Lexer& lexer) {
+    const char* start = ++lexer.p; // Skip "
+    while (lexer.p < lexer.end && *lexer.p != '"' && *lexer.p != '\n' && *lexer.p != '\r') ++lexer.p;
+    if (lexer.Char() != '"') ErrorEx("String must be closed", *lexer.file, lexer.line);
+    lexer.Add(TOK_STRINGLITERAL, start);
+    ++lexer.p; // Skip "
 }
 
-bool IsMlComment(const Lexer& lexer) {
-    return lexer.Char() == '/' && lexer.Char(1) == '*';
+static void ScanWord(Lexer& lexer) {
+    const char* start = lexer.p;
+    while (IsAlpha(lexer.Char()) || IsNumber(lexer.Char())) ++lexer.p;
+    lexer.Add(KeywordType(start, lexer.p - start), start);
 }
 
-bool IsNumber(char c) {
-    return c >= '0' && c <= '9';
+static void ScanTypeTag(Lexer& lexer) {
+    static const struct {
+        const char* name;
+        size_t length;
+        int type;
+    } tags[] = {
+        {":Int", 4, TOK_INT},
+        {":Float", 6, TOK_FLOAT},
+        {":String", 7, TOK_STRING},
+        {":List", 5, TOK_LIST},
+        {":Dict", 5, TOK_DICT},
+        {":Raw", 4, TOK_RAW}
+    };
+    const char* start = lexer.p;
+    for (size_t i = 0; i < sizeof(tags) / sizeof(tags[0]); ++i) {
+        // Tags must end there, so that records named like them (such as ':Integer') are not split
+        const size_t length = tags[i].length;
+        if ((size_t)(lexer.end - start) >= length && memcmp(start, tags[i].name, length) == 0
+                && !IsAlpha(lexer.Char(length)) && !IsNumber(lexer.Char(length))) {
+            lexer.p += tags[i].length;
+            lexer.Add(tags[i].type, start);
+            return;
+        }
+    }
+    ++lexer.p;
+    lexer.Add(TOK_COLON, start);
 }
 
-bool IsAlpha(char c) {
-    return c == '_' || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+static int KeywordType(const char* str, size_t length) {
+#define KEYWORD(name, type) if (length == sizeof(name) - 1 && memcmp(str, name, length) == 0) return type
+    switch (str[0]) {
+    case 'a':
+        KEYWORD("and", TOK_AND);
+        break;
+    case 'd':
+        KEYWORD("do", TOK_DO);
+        break;
+    case 'e':
+        KEYWORD("end", TOK_END);
+        KEYWORD("else", TOK_ELSE);
+        KEYWORD("elseif", TOK_ELSEIF);
+        break;
+    case 'f':
+        KEYWORD("for", TOK_FOR);
+        KEYWORD("function", TOK_FUNCTION);
+        KEYWORD("false", TOK_FALSELITERAL);
+        break;
+    case 'i':
+        KEYWORD("if", TOK_IF);
+        KEYWORD("import", TOK_IMPORT);
+        break;
+    case 'm':
+        KEYWORD("mod", TOK_MOD);
+        break;
+    case 'n':
+        KEYWORD("not", TOK_NOT);
+        KEYWORD("null", TOK_NULLLITERAL);
+        break;
+    case 'o':
+        KEYWORD("or", TOK_OR);
+        break;
+    case 'r':
+        KEYWORD("return", TOK_RETURN);
+        KEYWORD("record", TOK_RECORD);
+        break;
+    case 's':
+        KEYWORD("step", TOK_STEP);
+        break;
+    case 't':
+        KEYWORD("then", TOK_THEN);
+        KEYWORD("to", TOK_TO);
+        KEYWORD("true", TOK_TRUELITERAL);
+        break;
+    case 'w':
+        KEYWORD("while", TOK_WHILE);
+        break;
+    }
+#undef KEYWORD
+    return TOK_ID;
 }
 
-string CheckSymbol(const Lexer& lexer) {
-    static vector<string> symbols;
-    if (symbols.size() == 0) {
-        symbols.push_back("==");
-        symbols.push_back("<>");
-        symbols.push_back(">=");
-        symbols.push_back("<=");
-        symbols.push_back("<");
-        symbols.push_back(">");
-        symbols.push_back("+");
-        symbols.push_back("-");
-        symbols.push_back("*");
-        symbols.push_back("/");
-        symbols.push_back("=");
-        symbols.push_back(",");
-        symbols.push_back(";");
-        symbols.push_back("(");
-        symbols.push_back(")");
-        symbols.push_back("[");
-        symbols.push_back("]");
-        symbols.push_back("{");
-        symbols.push_back("}");
-        symbols.push_back(":Int");
-        symbols.push_back(":Float");
-        symbols.push_back(":String");
-        symbols.push_back(":List");
-        symbols.push_back(":Dict");
-        symbols.push_back(":Raw");
-        symbols.push_back(":");
-    }
-    for (size_t i = 0; i < symbols.size(); ++i) {
-        string str = "";
-        for (size_t j = 0; j < symbols[i].length(); ++j) {
-            if (lexer.Valid(j)) str += lexer.Char(j);
-        }
-        if (str == symbols[i]) return str;
-    }
-    return "";
+static bool IsNumber(char c) {
+    return c >= '0' && c <= '9';
 }
 
-int TokenType(const string& str) {
-    static map<string, int> types;
-    if (types.size() == 0) {
-        types["not"] = TOK_NOT;
-        types["and"] = TOK_AND;
-        types["or"] = TOK_OR;
-        types["=="] = TOK_EQUAL;
-        types["<>"] = TOK_NOTEQUAL;
-        types[">"] = TOK_GREATER;
-        types["<"] = TOK_LESSER;
-        types[">="] = TOK_GEQUAL;
-        types["<="] = TOK_LEQUAL;
-        types["+"] = TOK_PLUS;
-        types["-"] = TOK_MINUS;
-        types["*"] = TOK_MUL;
-        types["/"] = TOK_DIV;
-        types["mod"] = TOK_MOD;
-        types["="] = TOK_ASSIGN;
-        types[","] = TOK_COMMA;
-        types[":"] = TOK_COLON;
-        types[";"] = TOK_SEMICOLON;
-        types["("] = TOK_OPENPAREN;
-        types[")"] = TOK_CLOSEPAREN;
-        types["["] = TOK_OPENBRACKET;
-        types["]"] = TOK_CLOSEBRACKET;
-        types["{"] = TOK_OPENBRACE;
-        types["}"] = TOK_CLOSEBRACE;
-        types["end"] = TOK_END;
-        types["if"] = TOK_IF;
-        types["then"] = TOK_THEN;
-        types["elseif"] = TOK_ELSEIF;
-        types["else"] = TOK_ELSE;
-        types["for"] = TOK_FOR;
-        types["to"] = TOK_TO;
-        types["step"] = TOK_STEP;
-        types["do"] = TOK_DO;
-        types["while"] = TOK_WHILE;
-        types["return"] = TOK_RETURN;
-        types["function"] = TOK_FUNCTION;
-        types[":Int"] = TOK_INT;
-        types[":Float"] = TOK_FLOAT;
-        types[":String"] = TOK_STRING;
-        types[":List"] = TOK_LIST;
-        types[":Dict"] = TOK_DICT;
-        types[":Raw"] = TOK_RAW;
-        types["null"] = TOK_NULLLITERAL;
-        types["true"] = TOK_TRUELITERAL;
-        types["false"] = TOK_FALSELITERAL;
-    }
-    return (types.count(str) > 0) ? types[str] : TOK_ID;
+static bool IsAlpha(char c) {
+    return c == '_' || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
 }
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <string.h>
 #include "common.h"
+#include "error.h"
 
 // End of file
 #define TOK_EOF 0
@@ -29,6 +31,7 @@
 #define TOK_DIV 22
 #define TOK_MOD 23
 #define TOK_ASSIGN 24
+#define TOK_DOT 25
 
 // Separators
 #define TOK_COMMA 30
@@ -55,6 +58,8 @@
 #define TOK_RETURN 49
 #define TOK_FUNCTION 50
 #define TOK_END 51
+#define TOK_IMPORT 52
+#define TOK_RECORD 53
 
 // Identifiers
 #define TOK_ID 55
@@ -67,27 +72,35 @@
 #define TOK_DICT 64
 #define TOK_RAW 65
 
-struct Token {
-    const int type;
-    const std::string data;
-    const std::string file;
-    const int line;
+// Slice of the source buffer that a token was read from
+struct TokenData {
+    const char* ptr;
+    size_t length;
 
-    Token(int type, const std::string& data, const std::string& file, int line) :
-            type(type), data(data), file(file), line(line) {
+    TokenData(const char* ptr, size_t length) : ptr(ptr), length(length) {
+    }
+
+    operator std::string() const {
+        return std::string(ptr, length);
     }
-    
-    // Copy constructor and assignment operator are required by some old compilers
-    Token(const Token& other) :
-            type(other.type), data(other.data), file(other.file), line(other.line) {
+
+    bool operator==(const TokenData& other) const {
+        return length == other.length && memcmp(ptr, other.ptr, length) == 0;
     }
-    
-    Token& operator=(const Token& other) {
-        const_cast<int&>(type) = other.type;
-        const_cast<std::string&>(data) = other.data;
-        const_cast<std::string&>(file) = other.file;
-        const_cast<int&>(line) = other.line;
-        return *this;
+};
+
+inline std::string operator+(const std::string& str, const TokenData& data) {
+    return str + std::string(data);
+}
+
+struct Token {
+    int type;
+    TokenData data;
+    const std::string* file;    // Interned, so tokens from the same file share it
+    int line;
+
+    Token(int type, const TokenData& data, const std::string* file, int line) :
+            type(type), data(data), file(file), line(line) {
     }
 
     bool operator==(const Token& other) const {
@@ -98,7 +111,13 @@ struct Token {
     }
 };
 
+inline void ErrorEx(const std::string& message, const Token& token) {
+    ErrorEx(message, *token.file, token.line);
+}
+
+// Tokens point into the buffer, so it must outlive them
 std::vector<Token> ParseTokens(const std::string& buffer, const std::string& filename);
+const std::string* InternFilename(const std::string& filename);
 bool IsControl(int type);
 bool IsBooleanOp(int type);
 bool IsRelationOp(int type);
@@ -107,6 +126,8 @@ bool IsMultiplicativeOp(int type);
 bool IsUnaryOp(int type);
 bool IsType(int type);
 int GetType(int type);
+bool IsRecord(int type);
+bool IsManaged(int type);
 bool IsStatementEnd(int type);
 bool AreCompatible(int type1, int type2);
 int BalanceTypes(int type1, int type2);
@@ -3,50 +3,75 @@
 #include "token.h"
 
 struct TokenStream {
-    const std::vector<Token>* tokens;
+    std::vector<const Token*> tokens;   // Every token except EOLs
+    std::vector<bool> eols;             // Whether each token, or the end of the stream, follows an EOL
+    std::vector<int> closings;          // Index of the matching ']' for each '['
     int offset;
-    
-    TokenStream(const std::vector<Token>& tokens) : tokens(&tokens), offset(0) {}
-    
+
+    TokenStream(const std::vector<Token>& source) : offset(0), skippedEol(-1) {
+        std::vector<int> openings;
+        bool eol = false;
+        tokens.reserve(source.size());
+        for (size_t i = 0; i < source.size(); ++i) {
+            const Token& token = source[i];
+            if (token.type == TOK_EOL) {
+                eol = true;
+                continue;
+            }
+            if (token.type == TOK_OPENBRACKET) {
+                openings.push_back(tokens.size());
+            } else if (token.type == TOK_CLOSEBRACKET && !openings.empty()) {
+                closings[openings.back()] = tokens.size();
+                openings.pop_back();
+            }
+            tokens.push_back(&token);
+            eols.push_back(eol);
+            closings.push_back(-1);
+            eol = false;
+        }
+        eols.push_back(eol);
+    }
+
     bool HasNext() const {
-        TokenStream copy(*tokens);
-        copy.offset = offset;
-        copy.SkipEols();
-        return copy.offset < tokens->size();
+        return offset < (int)tokens.size();
     }
 
     const Token& Peek(int offset = 0) const {
-        TokenStream copy(*tokens);
-        copy.offset = this->offset;
-        copy.Skip(offset);
-        return copy.Next();
+        const size_t index = this->offset + offset;
+        return (index < tokens.size()) ? *tokens[index] : GetEofToken();
     }
-    
+
     const Token& Next() {
-        SkipEols();
-        if (HasNext()) {
-            offset++;
-            return (*tokens)[offset-1];
-        } else {
-            return GetEofToken();
-        }
+        const Token& token = Peek();
+        if (HasNext()) offset++;
+        return token;
     }
 
     void Skip(int count) {
-        for (int i = 0; i < count; ++i) {
-            Next();
-        }
+        offset = (offset + count < (int)tokens.size()) ? (offset + count) : (int)tokens.size();
+    }
+
+    void Seek(int offset) {
+        this->offset = offset;
+        skippedEol = -1;
     }
 
     bool SkipEols() {
-        const bool skipped = offset < tokens->size() && (*tokens)[offset].type == TOK_EOL;
-        while (offset < tokens->size() && (*tokens)[offset].type == TOK_EOL)
-            ++offset;
+        const bool skipped = eols[offset] && skippedEol != offset;
+        skippedEol = offset;
         return skipped;
     }
+
+    // Returns the offset of the ']' that closes the '[' at the given offset, or the end of the stream
+    int ClosingOffset(int offset) const {
+        const int closing = closings[this->offset + offset];
+        return ((closing != -1) ? closing : (int)tokens.size()) - this->offset;
+    }
 private:
+    int skippedEol;
+
     static Token& GetEofToken() {
-        static Token eofToken(TOK_EOF, "", "", 0);
+        static Token eofToken(TOK_EOF, TokenData("", 0), InternFilename(""), 0);
         return eofToken;
     }
 };